@@ -41,6 +41,22 @@ typedef struct {
 #define ATOMIC_DECLARE(name, value)  atomic_t name = { value }
 
 
+/** Full memory barrier
+ *
+ * Make sure all memory accesses issued before the barrier
+ * are visible to other processors before any memory access
+ * issued after the barrier.
+ *
+ */
+static inline void memory_barrier (void)
+{
+	asm volatile (
+		"sync\n"
+		::: "memory"
+	);
+}
+
+
 /** Get the value of an atomic variable
  *
  * @param var The variable to read.
@@ -240,4 +256,95 @@ static inline native_t atomic_sub (atomic_t *var, const native_t num)
 }
 
 
+/** Exchange the value of an atomic variable
+ *
+ * @param var The variable to exchange.
+ * @param val The new value of the variable.
+ * @return The original value of the variable.
+ *
+ */
+static inline native_t atomic_swap (atomic_t *var, const native_t val)
+{
+	/*
+	 * This is an optimistic algorithm that keeps trying
+	 * to store until the LL and SC pair of instructions
+	 * succeeds, which means there was no other access to the
+	 * same variable in the meantime.
+	 */
+	
+	native_t orig, result;
+	
+	asm volatile (
+		".set push\n"
+		".set noreorder\n"
+		
+		"1: ll %[orig], %[value]\n"
+		"   move %[result], %[val]\n"
+		"   sc %[result], %[value]\n"
+		"   beqz %[result], 1b\n"
+		"   nop\n"
+		
+		"   sync\n"
+		
+		".set pop\n"
+		: [orig] "=&r" (orig),
+		  [result] "=&r" (result),
+		  [value] "+m" ((var)->value)
+		: [val] "r" (val)
+		: "memory"
+	);
+	
+	return orig;
+}
+
+
+/** Compare and swap the value of an atomic variable
+ *
+ * The new value is stored only if the variable
+ * contains the expected value.
+ *
+ * @param var The variable to update.
+ * @param old The expected value of the variable.
+ * @param val The new value of the variable.
+ * @return True if the new value has been stored.
+ *
+ */
+static inline bool atomic_cas (atomic_t *var, const native_t old,
+    const native_t val)
+{
+	/*
+	 * This is an optimistic algorithm that keeps trying
+	 * to store until the LL and SC pair of instructions
+	 * succeeds or the variable does not contain the
+	 * expected value.
+	 */
+	
+	native_t orig, result;
+	
+	asm volatile (
+		".set push\n"
+		".set noreorder\n"
+		
+		"1: ll %[orig], %[value]\n"
+		"   bne %[orig], %[old], 2f\n"
+		"   move %[result], %[val]\n"
+		"   sc %[result], %[value]\n"
+		"   beqz %[result], 1b\n"
+		"   nop\n"
+		
+		"2: sync\n"
+		
+		".set pop\n"
+		: [orig] "=&r" (orig),
+		  [result] "=&r" (result),
+		  [value] "+m" ((var)->value)
+		: [old] "r" (old),
+		  [val] "r" (val)
+		: "memory"
+	);
+	
+	return (orig == old);
+}
+
+
 #endif
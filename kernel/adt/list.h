@@ -216,6 +216,28 @@ static inline void list_append (list_t *list, link_t *link)
 	list->head.prev = link;
 }
 
+/** Insert item before another item
+ *
+ * Insert a new item into the list the other item is part of,
+ * right in front of the other item.
+ *
+ * @param link The new item link.
+ * @param next The link of the item to insert in front of.
+ *
+ */
+static inline void list_insert_before (link_t *link, link_t *next)
+{
+	assert (link != NULL);
+	assert (next != NULL);
+	
+	link->next = next;
+	link->prev = next->prev;
+	
+	next->prev->next = link;
+	next->prev = link;
+}
+
+
 /** Remove an item from a list
  *
  * Remove an item from any list it is currently part of.
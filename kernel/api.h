@@ -22,19 +22,26 @@
 #include <mm/falloc.h>
 #include <mm/malloc.h>
 #include <mm/vmm.h>
+#include <mm/percpu.h>
 #include <adt/atomic.h>
 #include <proc/thread.h>
+#include <sched/sched.h>
+#include <sched/smp.h>
+#include <synch/waitqueue.h>
 #include <synch/sem.h>
 #include <synch/mutex.h>
 #include <synch/rmutex.h>
 #include <synch/condvar.h>
 #include <synch/rwlock.h>
+#include <synch/brlock.h>
+#include <time/time.h>
 #include <time/timer.h>
 #include <lib/print.h>
 #include <lib/debug.h>
 #include <lib/stdarg.h>
 #include <drivers/kbd.h>
 #include <drivers/dorder.h>
+#include <drivers/timer.h>
 #include <drivers/disk.h>
 
 
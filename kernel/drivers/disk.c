@@ -3,6 +3,12 @@
  *
  * Disk.
  *
+ * The driver queues the requests for the ddisk device in the request
+ * scheduler and has at most one of them in progress. Completion is
+ * signalled by the device interrupt, whose handler starts the next
+ * request and then either runs the completion callbacks of the
+ * finished requests or wakes up the threads waiting for them.
+ *
  * Kalisto
  *
  * Copyright (c) 2001-2015
@@ -17,33 +23,308 @@
 
 #include <adt/list.h>
 #include <proc/thread.h>
+#include <synch/spinlock.h>
+#include <synch/waitqueue.h>
+#include <lib/string.h>
+#include <drivers/elevator.h>
 
 #include <drivers/disk.h>
 
 
+/** Registers of the disk device */
+static volatile ddisk_regs_t *const disk_regs =
+    (volatile ddisk_regs_t *) DDISK_ADDRESS;
+
+/** Number of blocks of the disk */
+static size_t disk_nblocks;
+
+/** Lock protecting the request queue and the device */
+static SPINLOCK_DECLARE (disk_lock);
+
+/** Scheduler of the requests waiting for the device */
+static struct elevator disk_elevator;
+
+/** The request in progress */
+static struct disk_request *disk_active;
+
+/** Threads waiting for the completion of their requests */
+static WAITQUEUE_DECLARE (disk_wait_queue, &disk_lock);
+
+
+/** Initialize the disk driver
+ *
+ * @return EOK on success.
+ *
+ */
 int disk_init (void)
 {
-	// TODO
+	elevator_init (&disk_elevator);
+	disk_active = NULL;
+	
+	/* Acknowledge any interrupt left from the bootstrap. */
+	disk_regs->status = DDISK_STATUS_INT;
+	disk_nblocks = disk_regs->size / DISK_BLOCK_SIZE;
+	
 	return EOK;
 }
 
 
+/** Get the number of blocks of the disk
+ *
+ * @param nblocks Where to store the number of blocks.
+ *
+ * @return EOK on success.
+ *
+ */
 int disk_get_nblocks (size_t *nblocks)
 {
-	// TODO
+	*nblocks = disk_nblocks;
 	return EOK;
 }
 
 
-int disk_read (size_t block, void *data)
+/** Start the next request
+ *
+ * Must be called with the disk lock held and the device idle.
+ *
+ */
+static void disk_start (void)
 {
-	// TODO
+	disk_active = elevator_next (&disk_elevator);
+	if (disk_active == NULL)
+		return;
+	
+	uintptr_t phys = ADDR_FROM_KSEG0 ((uintptr_t) disk_active->data);
+	
+	disk_regs->addr_lo = phys;
+	disk_regs->addr_hi = 0;
+	disk_regs->secno = disk_active->block;
+	disk_regs->status = (disk_active->op == DISK_READ) ?
+	    DDISK_STATUS_READ : DDISK_STATUS_WRITE;
+}
+
+
+/** Complete a disk request
+ *
+ * Must be called with the disk lock held. The requests with
+ * a completion callback are only moved to the given list, the
+ * callbacks are run once the lock is released.
+ *
+ * @param request   Request to complete.
+ * @param rc        Result of the request.
+ * @param callbacks List of requests to run the callbacks of.
+ *
+ * @return True if a thread waits for the request.
+ *
+ */
+static bool disk_complete (struct disk_request *request, const int rc,
+    list_t *callbacks)
+{
+	request->rc = rc;
+	
+	if (request->callback != NULL) {
+		list_append (callbacks, &request->link);
+		return false;
+	}
+	
+	request->done = true;
+	return true;
+}
+
+
+/** Handle the disk interrupt
+ *
+ * Called from the interrupt handler with interrupts disabled. The
+ * interrupt may be delivered to several CPUs, only the one which
+ * finds it pending completes the request in progress.
+ *
+ */
+void disk_handle (void)
+{
+	spinlock_lock (&disk_lock);
+	
+	uint32_t status = disk_regs->status;
+	if ((status & DDISK_STATUS_INT) == 0) {
+		spinlock_unlock (&disk_lock);
+		return;
+	}
+	
+	disk_regs->status = DDISK_STATUS_INT;
+	
+	struct disk_request *request = disk_active;
+	disk_active = NULL;
+	
+	/* Keep the device busy while completing the request. */
+	disk_start ();
+	
+	if (request == NULL) {
+		spinlock_unlock (&disk_lock);
+		return;
+	}
+	
+	int rc = ((status & DDISK_STATUS_ERROR) != 0) ? EIO : EOK;
+	bool wake = false;
+	
+	list_t callbacks;
+	list_init (&callbacks);
+	
+	/* The merged requests share the transferred block. */
+	while (!list_empty (&request->merged)) {
+		struct disk_request *merged = list_item (
+		    list_pop (&request->merged), struct disk_request, link);
+		
+		if (rc == EOK)
+			memcpy (merged->data, request->data, DISK_BLOCK_SIZE);
+		
+		wake = disk_complete (merged, rc, &callbacks) || wake;
+	}
+	
+	wake = disk_complete (request, rc, &callbacks) || wake;
+	
+	if (wake)
+		waitqueue_wake_all (&disk_wait_queue);
+	
+	spinlock_unlock (&disk_lock);
+	
+	/* The callbacks may submit other requests. */
+	while (!list_empty (&callbacks)) {
+		request = list_item (list_pop (&callbacks),
+		    struct disk_request, link);
+		request->callback (request);
+	}
+}
+
+
+/** Initialize a disk request
+ *
+ * @param request  Request to initialize.
+ * @param op       Operation to perform.
+ * @param block    Block to transfer.
+ * @param data     Block buffer, it has to reside in KSEG0.
+ * @param callback Completion callback or NULL to wait for
+ *                 the request with disk_wait().
+ * @param arg      Callback argument.
+ *
+ */
+void disk_request_init (struct disk_request *request, const disk_op_t op,
+    const size_t block, void *data, disk_callback_t callback, void *arg)
+{
+	link_init (&request->link);
+	request->op = op;
+	request->block = block;
+	request->data = data;
+	request->callback = callback;
+	request->arg = arg;
+	request->rc = EOK;
+	request->done = false;
+}
+
+
+/** Submit a disk request
+ *
+ * Queues the request and returns without waiting for it. The
+ * request completes by calling its callback or by waking up
+ * the thread in disk_wait(). Can be called from the completion
+ * callback of another request.
+ *
+ * @param request Initialized request.
+ *
+ * @return EOK if the request has been queued.
+ * @return EINVAL if the block or the buffer is invalid.
+ *
+ */
+int disk_submit (struct disk_request *request)
+{
+	if ((request->block >= disk_nblocks) ||
+	    (ADDR_IN_KSEG0 ((uintptr_t) request->data) !=
+	    (uintptr_t) request->data))
+		return EINVAL;
+	
+	request->done = false;
+	
+	ipl_t state = spinlock_lock_irqsave (&disk_lock);
+	
+	elevator_add (&disk_elevator, request);
+	if (disk_active == NULL)
+		disk_start ();
+	
+	spinlock_unlock_irqrestore (&disk_lock, state);
+	
 	return EOK;
 }
 
 
+/** Wait for a disk request
+ *
+ * Blocks until a request submitted without
+ * a completion callback completes.
+ *
+ * @param request Submitted request.
+ *
+ * @return Result of the request.
+ *
+ */
+int disk_wait (struct disk_request *request)
+{
+	waitqueue_wait_event (&disk_wait_queue, request->done);
+	return request->rc;
+}
+
+
+/** Get the disk request statistics
+ *
+ * @param stats Where to store the statistics.
+ *
+ */
+void disk_get_stats (struct disk_stats *stats)
+{
+	ipl_t state = spinlock_lock_irqsave (&disk_lock);
+	*stats = disk_elevator.stats;
+	spinlock_unlock_irqrestore (&disk_lock, state);
+}
+
+
+/** Read a block synchronously
+ *
+ * @param block Block to read.
+ * @param data  Buffer for the block, it has to reside in KSEG0.
+ *
+ * @return EOK on success.
+ * @return EINVAL if the block or the buffer is invalid.
+ * @return EIO if the device has failed.
+ *
+ */
+int disk_read (size_t block, void *data)
+{
+	struct disk_request request;
+	disk_request_init (&request, DISK_READ, block, data, NULL, NULL);
+	
+	int rc = disk_submit (&request);
+	if (rc != EOK)
+		return rc;
+	
+	return disk_wait (&request);
+}
+
+
+/** Write a block synchronously
+ *
+ * @param block Block to write.
+ * @param data  Content of the block, it has to reside in KSEG0.
+ *
+ * @return EOK on success.
+ * @return EINVAL if the block or the buffer is invalid.
+ * @return EIO if the device has failed.
+ *
+ */
 int disk_write (size_t block, void *data)
 {
-	// TODO
-	return EOK;
+	struct disk_request request;
+	disk_request_init (&request, DISK_WRITE, block, data, NULL, NULL);
+	
+	int rc = disk_submit (&request);
+	if (rc != EOK)
+		return rc;
+	
+	return disk_wait (&request);
 }
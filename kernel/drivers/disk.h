@@ -18,16 +18,147 @@
 #include <include/shared.h>
 #include <include/c.h>
 
+#include <adt/list.h>
+
 
 #define DDISK_ADDRESS  (ADDR_IN_KSEG1 (DEVICE_DDISK_ADDR))
 
 #define DISK_BLOCK_SIZE  512
 
 
+/** Registers of the ddisk device
+ *
+ */
+typedef struct {
+	/** Physical address of the DMA buffer (bits 0 .. 31) */
+	uint32_t addr_lo;
+	
+	/** Physical address of the DMA buffer (bits 32 .. 35) */
+	uint32_t addr_hi;
+	
+	/** Number of the sector to transfer */
+	uint32_t secno;
+	
+	/** Status (read) and command (write) register */
+	uint32_t status;
+	
+	/** Size of the disk in bytes */
+	uint32_t size;
+} ddisk_regs_t;
+
+/** Read command and operation in progress */
+#define DDISK_STATUS_READ   0x01
+
+/** Write command and operation in progress */
+#define DDISK_STATUS_WRITE  0x02
+
+/** Interrupt pending and interrupt acknowledge command */
+#define DDISK_STATUS_INT    0x04
+
+/** The last operation has failed */
+#define DDISK_STATUS_ERROR  0x08
+
+
+/** Disk operation
+ *
+ */
+typedef enum {
+	DISK_READ,
+	DISK_WRITE
+} disk_op_t;
+
+
+struct disk_request;
+
+
+/** Disk request completion callback
+ *
+ * Runs in the interrupt handler, with interrupts disabled.
+ * The request is not touched by the driver afterwards.
+ *
+ */
+typedef void (* disk_callback_t) (struct disk_request *request);
+
+
+/** Asynchronous disk request
+ *
+ * The structure is owned by the driver from the submission
+ * until the completion, the caller must keep it alive.
+ *
+ */
+struct disk_request {
+	/** Link in the request queue or in the list of merged requests */
+	link_t link;
+	
+	/** Requested operation */
+	disk_op_t op;
+	
+	/** Block to transfer */
+	size_t block;
+	
+	/** Block buffer in KSEG0 */
+	void *data;
+	
+	/** Completion callback or NULL to wait with disk_wait() */
+	disk_callback_t callback;
+	
+	/** Callback argument */
+	void *arg;
+	
+	/** Result of the request */
+	int rc;
+	
+	/** The request has completed */
+	bool done;
+	
+	/** Link in the list of queued requests in the order of arrival */
+	link_t fifo_link;
+	
+	/** Jiffy by which the request should be dispatched */
+	unsigned int deadline;
+	
+	/** Requests for the same block merged into this one */
+	list_t merged;
+};
+
+
+/** Disk request statistics
+ *
+ */
+struct disk_stats {
+	/** Submitted requests */
+	unsigned int submitted;
+	
+	/** Transfers issued to the device */
+	unsigned int transfers;
+	
+	/** Requests merged into a queued request */
+	unsigned int merged;
+	
+	/** Requests dispatched out of order because of their deadline */
+	unsigned int expired;
+	
+	/** Currently queued requests */
+	unsigned int depth;
+	
+	/** Maximum number of queued requests */
+	unsigned int max_depth;
+	
+	/** Sum of the queue depths found by the submitted requests */
+	unsigned int depth_sum;
+};
+
+
 /* Externals are commented with implementation */
 extern int disk_init (void);
 extern void disk_handle (void);
 extern int disk_get_nblocks (size_t *nblocks);
+extern void disk_request_init (struct disk_request *request,
+    const disk_op_t op, const size_t block, void *data,
+    disk_callback_t callback, void *arg);
+extern int disk_submit (struct disk_request *request);
+extern int disk_wait (struct disk_request *request);
+extern void disk_get_stats (struct disk_stats *stats);
 extern int disk_read (size_t block, void *data);
 extern int disk_write (size_t block, void *data);
 
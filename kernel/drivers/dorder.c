@@ -16,38 +16,104 @@
 #include <include/c.h>
 
 #include <adt/atomic.h>
-#include <adt/list.h>
 #include <proc/thread.h>
+#include <sched/sched.h>
+#include <sched/smp.h>
+#include <synch/spinlock.h>
+#include <synch/waitqueue.h>
 
 #include <drivers/dorder.h>
 
 
-/** Message buffer size
+/** Message ring size
+ *
+ * Must be a power of two.
  *
  */
 #define MSG_BUF_SIZE  128
 
 
-/** Message buffer head index
+/** Message slot of a ring
+ *
+ * The sequence number of a slot is the position at which the slot
+ * is free for a producer, and one more when the slot has been filled
+ * for the consumer. The consumer frees the slot for the position one
+ * lap ahead. The positions run freely and wrap together with the
+ * sequence numbers.
  *
  */
-static ATOMIC_DECLARE (msg_head, 0);
+struct msg_slot {
+	/** Sequence number of the slot */
+	atomic_t seq;
+	
+	/** The message */
+	volatile native_t msg;
+};
 
-/** Message buffer tail index
+
+/** Message ring of a single CPU
+ *
+ * A bounded lock-free ring with many producers and a single
+ * consumer, the CPU the ring belongs to. Producers claim positions
+ * by a compare-and-swap on the head, fill the slot and only then
+ * mark it filled, the consumer therefore never reads a message
+ * which is still being written. The indices run freely, a slot
+ * and a lap of the ring are derived from them.
+ *
+ * An interrupt is sent only when the ring has not been notified
+ * since the consumer last started draining it, the consumer then
+ * processes all the messages sent in the meantime in one batch.
+ * Reschedule and cross-CPU call requests are idempotent
+ * and only set a flag.
  *
  */
-static ATOMIC_DECLARE (msg_tail, 0);
+struct msg_queue {
+	/** Position of the next message to send */
+	atomic_t head;
+	
+	/** Padding to keep the producers off the consumer cache line */
+	uint8_t pad_head [CACHE_LINE_SIZE - sizeof (atomic_t)];
+	
+	/** Position of the next message to receive */
+	unative_t tail;
+	
+	/** Interrupt sent and not yet handled */
+	atomic_t notified;
+	
+	/** Reschedule request pending */
+	atomic_t resched;
+	
+	/** Cross-CPU call request pending */
+	atomic_t call;
+	
+	/** Padding to keep the slots off the consumer cache line */
+	uint8_t pad_tail [CACHE_LINE_SIZE - sizeof (unative_t) -
+	    3 * sizeof (atomic_t)];
+	
+	/** Message slots */
+	struct msg_slot slots [MSG_BUF_SIZE];
+};
+
 
-/** Message buffer
+/** Message rings of all CPUs
+ *
+ * The sequence numbers of the slots are
+ * set up by dorder_init().
  *
  */
-static volatile native_t msg_buffer [MSG_BUF_SIZE];
+static struct msg_queue msg_queues [MAX_CPU];
+
+
+/** Lock protecting the wait queue for dorder events
+ *
+ */
+static SPINLOCK_DECLARE (dorder_lock);
 
 
 /** Wait queue for dorder events
  *
  */
-static LIST_DECLARE (dorder_wait_queue);
+static WAITQUEUE_DECLARE (dorder_wait_queue, &dorder_lock);
 
 
 /** Dorder signal
@@ -56,25 +122,64 @@ static LIST_DECLARE (dorder_wait_queue);
 static ATOMIC_DECLARE (dorder_signal, 1);
 
 
+/** Initialize the message rings
+ *
+ * Free every slot for its position in the first lap. Must
+ * be called before any message is sent.
+ *
+ */
+void dorder_init (void)
+{
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++) {
+		struct msg_queue *queue = &msg_queues [cpu];
+		
+		for (unsigned int i = 0; i < MSG_BUF_SIZE; i++)
+			atomic_set (&queue->slots [i].seq, i);
+	}
+}
+
+
 /** Process dorder interrupt
  *
- * Consume messages from the dorder message buffer.
+ * Consume all the messages from the message ring of the current CPU.
  *
  */
 void dorder_handle (void)
 {
-	// TODO: Deassert dorder interrupt pending
+	struct msg_queue *queue = &msg_queues [cpuid ()];
+	
+	/*
+	 * Deassert the interrupt and clear the notification before
+	 * draining the ring, a message sent in the meantime
+	 * asserts the interrupt again.
+	 */
+	dorder_deassert (cpuid ());
+	atomic_set (&queue->notified, 0);
+	memory_barrier ();
+	
+	if (atomic_swap (&queue->resched, 0) != 0)
+		dorder_receive (DORDER_MSG_RESCHEDULE);
+	
+	if (atomic_swap (&queue->call, 0) != 0)
+		dorder_receive (DORDER_MSG_CALL);
 	
 	/*
-	 * Read the messages from the buffer and
+	 * Read the messages from the ring and
 	 * process them.
 	 */
-	while (atomic_get (&msg_tail) != atomic_get (&msg_head)) {
-		native_t msg_tail_index =
-		    atomic_get (&msg_tail) % sizeof_array (msg_buffer);
+	while (true) {
+		unative_t tail = queue->tail;
+		struct msg_slot *slot = &queue->slots [tail % MSG_BUF_SIZE];
+		
+		if ((unative_t) atomic_get (&slot->seq) != tail + 1)
+			break;
+		
+		native_t msg = slot->msg;
 		
-		native_t msg = msg_buffer [msg_tail_index];
-		atomic_add (&msg_tail, 1);
+		/* Read the message before handing the slot over. */
+		memory_barrier ();
+		atomic_set (&slot->seq, tail + MSG_BUF_SIZE);
+		queue->tail = tail + 1;
 		
 		dorder_receive (msg);
 	}
@@ -90,6 +195,20 @@ void dorder_handle (void)
  */
 void dorder_receive (native_t msg)
 {
+	/*
+	 * Reschedule requests are frequent and
+	 * handled by the scheduler.
+	 */
+	if (msg == DORDER_MSG_RESCHEDULE) {
+		sched_ipi ();
+		return;
+	}
+	
+	if (msg == DORDER_MSG_CALL) {
+		smp_call_ipi ();
+		return;
+	}
+	
 	/*
 	 * Print out the message (for debugging
 	 * purposes)
@@ -100,32 +219,46 @@ void dorder_receive (native_t msg)
 	 * Process the messages
 	 */
 	if (msg == DORDER_MSG_SIGNAL) {
-		// TODO: Set the signal atomic variable
-		
-		ipl_t status = query_and_disable_interrupts ();
+		/* Zero signal means there is a pending signal */
+		atomic_set (&dorder_signal, 0);
 		
 		/*
 		 * Wake up the first waiter.
 		 */
-		link_t *link = list_pop (&dorder_wait_queue);
-		if (link != NULL) {
-			struct thread *thread =
-			    list_item (link, struct thread, wait_queue_link);
-			
-			// TODO: Remove the following line and
-			//       wake up the thread here
-			(void) thread;
-		}
-		
-		conditionally_enable_interrupts (status);
+		ipl_t status = spinlock_lock_irqsave (&dorder_lock);
+		waitqueue_wake_one (&dorder_wait_queue);
+		spinlock_unlock_irqrestore (&dorder_lock, status);
 	}
 }
 
 
+/** Notify a CPU of new messages
+ *
+ * Send the interrupt unless it has already been
+ * sent and the CPU has not started handling it.
+ *
+ * @param cpuid CPU identification number to notify.
+ * @param queue Message ring of the CPU.
+ *
+ */
+static void dorder_notify (const uint32_t cpuid, struct msg_queue *queue)
+{
+	if (atomic_test_and_set (&queue->notified) == 0)
+		dorder_assert (cpuid);
+}
+
+
 /** Send dorder interrupt
  *
  * Send dorder interrupt with a given message to the given
- * CPU.
+ * CPU. The message is put in the message ring of the target CPU,
+ * and only the first message since the CPU started handling its
+ * last interrupt actually sends an interrupt.
+ *
+ * If the ring is full, the sender waits for the target CPU to
+ * make room, which never happens on the target CPU itself with
+ * interrupts disabled. The ring is sized so that it is never
+ * full in practice.
  *
  * @param cpuid CPU identification number to send the interrupt
  *              to (range 0 - 31).
@@ -134,23 +267,52 @@ void dorder_receive (native_t msg)
  */
 void dorder_send (const uint32_t cpuid, native_t msg)
 {
-	/*
-	 * This simplified dorder driver actually only supports
-	 * a single CPU and a single message buffer.
-	 */
-	assert (cpuid == 0);
+	assert (cpuid < MAX_CPU);
+	
+	struct msg_queue *queue = &msg_queues [cpuid];
+	
+	if ((msg == DORDER_MSG_RESCHEDULE) || (msg == DORDER_MSG_CALL)) {
+		if (msg == DORDER_MSG_RESCHEDULE)
+			atomic_set (&queue->resched, 1);
+		else
+			atomic_set (&queue->call, 1);
+		
+		memory_barrier ();
+		dorder_notify (cpuid, queue);
+		return;
+	}
 	
 	/*
-	 * Busy wait if the target CPU message buffer is full.
+	 * Claim a free slot at the head of the ring.
 	 */
-	while (atomic_get (&msg_tail) == atomic_get (&msg_head) + 1);
+	struct msg_slot *slot;
+	unative_t head;
 	
-	/* Store the message to the buffer */
-	native_t msg_head_index =
-	    atomic_post_add (&msg_head, 1) % sizeof_array (msg_buffer);
-	msg_buffer [msg_head_index] = msg;
+	while (true) {
+		head = atomic_get (&queue->head);
+		slot = &queue->slots [head % MSG_BUF_SIZE];
+		
+		/* The difference is meaningful across the wrap around. */
+		unative_t seq = atomic_get (&slot->seq);
+		native_t diff = (native_t) (seq - head);
+		
+		if (diff == 0) {
+			if (atomic_cas (&queue->head, head, head + 1))
+				break;
+		} else if (diff < 0) {
+			/* The ring is full, wait for the consumer. */
+			dorder_notify (cpuid, queue);
+		}
+	}
 	
-	// TODO: Assert the dorder interrupt for the given CPU
+	/* Store the message and hand the slot over to the consumer. */
+	slot->msg = msg;
+	memory_barrier ();
+	atomic_set (&slot->seq, head + 1);
+	
+	/* Make sure the message is visible before the interrupt. */
+	memory_barrier ();
+	dorder_notify (cpuid, queue);
 }
 
 
@@ -161,28 +323,23 @@ void dorder_send (const uint32_t cpuid, native_t msg)
  */
 void dorder_wait (void)
 {
-	native_t signal;
+	ipl_t status = spinlock_lock_irqsave (&dorder_lock);
 	
-	do {
-		/* Non-zero signal means there is no pending signal */
-		signal = atomic_test_and_set (&dorder_signal);
-		
-		if (signal != 0) {
-			/*
-			 * If there is no signal, wait for the signal passively.
-			 */
-			
-			// TODO: Run this block with disabled interrupts
-			
-			// TODO: Put the current thread to sleep
-		}
-	} while (signal != 0);
+	/*
+	 * Non-zero signal means there is no pending signal,
+	 * wait for the signal passively then.
+	 */
+	while (atomic_test_and_set (&dorder_signal) != 0)
+		waitqueue_wait (&dorder_wait_queue, WAITER_EXCLUSIVE);
+	
+	spinlock_unlock_irqrestore (&dorder_lock, status);
 }
 
 
 /** Probe for a pending dorder signal
  *
- * Check the status of pending dorder signal.
+ * Check the status of pending dorder signal. A pending
+ * signal is consumed as if by dorder_wait().
  *
  * @return Zero if there is no pending dorder signal.
  * @return Non-zero if there is a pending dorder signal.
@@ -190,9 +347,8 @@ void dorder_wait (void)
  */
 int dorder_probe (void)
 {
-	// TODO: Replace the following line with actually reading
-	//       the signal flag
-	native_t signal = 1;
+	/* Non-zero signal means there is no pending signal */
+	native_t signal = atomic_test_and_set (&dorder_signal);
 	
 	return !signal;
 }
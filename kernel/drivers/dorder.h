@@ -16,6 +16,7 @@
 #define DORDER_H_
 
 #include <include/shared.h>
+#include <include/c.h>
 
 
 #define DORDER_ADDRESS           (ADDR_IN_KSEG1 (DEVICE_DORDER_ADDR))
@@ -27,8 +28,21 @@
  */
 #define DORDER_MSG_SIGNAL  0x0000CAFE
 
+/** Reschedule request message
+ *
+ */
+#define DORDER_MSG_RESCHEDULE  0x00005CED
+
+/** Cross-CPU call request message
+ *
+ */
+#define DORDER_MSG_CALL  0x0000CA11
+
 
 /** Get the ID of the current CPU
+ *
+ * The boot code caches the value of the dorder device in the
+ * Context register, which is much cheaper to read than the device.
  *
  * @return Identification number of current CPU
  *         (range 0 - 31).
@@ -36,7 +50,7 @@
  */
 static inline uint32_t cpuid (void)
 {
-	return (*(volatile uint32_t *) DORDER_ADDRESS);
+	return CP0_CONTEXT_PTEBASE (read_cp0_context ());
 }
 
 
@@ -65,6 +79,7 @@ static inline void dorder_deassert (const uint32_t cpuid)
 
 
 /* Externals are commented with implementation */
+extern void dorder_init (void);
 extern void dorder_handle (void);
 extern void dorder_send (const uint32_t cpuid, native_t msg);
 extern void dorder_receive (native_t msg);
@@ -0,0 +1,176 @@
+/**
+ * @file elevator.c
+ *
+ * Disk request scheduler.
+ *
+ * Queued requests are dispatched in the C-LOOK order, sweeping the
+ * disk in the direction of increasing block numbers and jumping back
+ * to the lowest queued block at the end of each sweep. A request which
+ * has waited past its deadline is dispatched first, so that a stream
+ * of requests for nearby blocks cannot starve the rest of the disk.
+ *
+ * The ddisk device transfers a single block per command, adjacent
+ * requests thus cannot be merged into one transfer. A read of a block
+ * which is already queued for reading is merged instead, one transfer
+ * then serves all the merged requests.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2017
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/list.h>
+#include <sched/sched.h>
+#include <time/time.h>
+
+#include <drivers/elevator.h>
+
+
+/** Initialize a disk request scheduler
+ *
+ * @param elv Scheduler to initialize.
+ *
+ */
+void elevator_init (struct elevator *elv)
+{
+	list_init (&elv->sorted);
+	list_init (&elv->fifo);
+	elv->position = 0;
+	
+	elv->stats.submitted = 0;
+	elv->stats.transfers = 0;
+	elv->stats.merged = 0;
+	elv->stats.expired = 0;
+	elv->stats.depth = 0;
+	elv->stats.max_depth = 0;
+	elv->stats.depth_sum = 0;
+}
+
+
+/** Check whether there is any queued request
+ *
+ * @param elv Scheduler to check.
+ *
+ * @return True if no request is queued.
+ *
+ */
+bool elevator_empty (struct elevator *elv)
+{
+	return list_empty (&elv->fifo);
+}
+
+
+/** Queue a disk request
+ *
+ * The request is merged into a queued read of the same block if it
+ * is a read too and no write of the block has been queued since.
+ *
+ * @param elv     Scheduler to queue the request in.
+ * @param request Request to queue.
+ *
+ * @return True if the request has been merged into another one.
+ *
+ */
+bool elevator_add (struct elevator *elv, struct disk_request *request)
+{
+	elv->stats.submitted++;
+	elv->stats.depth_sum += elv->stats.depth;
+	
+	list_init (&request->merged);
+	link_init (&request->fifo_link);
+	
+	/*
+	 * Find the place in the sorted list, requests for the
+	 * same block are kept in the order of arrival.
+	 */
+	struct disk_request *last = NULL;
+	link_t *link = elv->sorted.head.next;
+	
+	while (link != &elv->sorted.head) {
+		struct disk_request *queued =
+		    list_item (link, struct disk_request, link);
+		
+		if (queued->block > request->block)
+			break;
+		
+		if (queued->block == request->block)
+			last = queued;
+		
+		link = link->next;
+	}
+	
+	if ((last != NULL) && (last->op == DISK_READ) &&
+	    (request->op == DISK_READ)) {
+		list_append (&last->merged, &request->link);
+		elv->stats.merged++;
+		return true;
+	}
+	
+	list_insert_before (&request->link, link);
+	
+	request->deadline = jiffies_get () + usec_to_jiffies (
+	    (request->op == DISK_READ) ?
+	    ELEVATOR_READ_DEADLINE : ELEVATOR_WRITE_DEADLINE);
+	list_append (&elv->fifo, &request->fifo_link);
+	
+	elv->stats.depth++;
+	if (elv->stats.depth > elv->stats.max_depth)
+		elv->stats.max_depth = elv->stats.depth;
+	
+	return false;
+}
+
+
+/** Dequeue the next request to transfer
+ *
+ * @param elv Scheduler to dequeue the request from.
+ *
+ * @return The request to transfer or NULL if no request is queued.
+ *
+ */
+struct disk_request *elevator_next (struct elevator *elv)
+{
+	if (list_empty (&elv->fifo))
+		return NULL;
+	
+	/* Continue the sweep, start over past the highest block. */
+	struct disk_request *request = NULL;
+	
+	list_foreach (elv->sorted, struct disk_request, link, queued) {
+		if (queued->block >= elv->position) {
+			request = queued;
+			break;
+		}
+	}
+	
+	if (request == NULL) {
+		request = list_item (elv->sorted.head.next,
+		    struct disk_request, link);
+	}
+	
+	/* The oldest request takes precedence once expired. */
+	struct disk_request *oldest = list_item (elv->fifo.head.next,
+	    struct disk_request, fifo_link);
+	
+	if ((oldest != request) &&
+	    ((int) (jiffies_get () - oldest->deadline) >= 0)) {
+		request = oldest;
+		elv->stats.expired++;
+	}
+	
+	list_remove (&request->link);
+	list_remove (&request->fifo_link);
+	
+	elv->position = request->block;
+	elv->stats.depth--;
+	elv->stats.transfers++;
+	
+	return request;
+}
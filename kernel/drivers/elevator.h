@@ -0,0 +1,59 @@
+/**
+ * @file elevator.h
+ *
+ * Disk request scheduler.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2017
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef ELEVATOR_H_
+#define ELEVATOR_H_
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/list.h>
+#include <drivers/disk.h>
+
+
+/** Time to dispatch a read request in microseconds */
+#define ELEVATOR_READ_DEADLINE   50000
+
+/** Time to dispatch a write request in microseconds */
+#define ELEVATOR_WRITE_DEADLINE  500000
+
+
+/** Disk request scheduler
+ *
+ * The scheduler is protected by the lock of the disk driver.
+ *
+ */
+struct elevator {
+	/** Queued requests sorted by block */
+	list_t sorted;
+	
+	/** Queued requests in the order of arrival */
+	list_t fifo;
+	
+	/** Block of the last dispatched request */
+	size_t position;
+	
+	/** Statistics */
+	struct disk_stats stats;
+};
+
+
+/* Externals are commented with implementation */
+extern void elevator_init (struct elevator *elv);
+extern bool elevator_empty (struct elevator *elv);
+extern bool elevator_add (struct elevator *elv, struct disk_request *request);
+extern struct disk_request *elevator_next (struct elevator *elv);
+
+
+#endif
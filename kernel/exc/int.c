@@ -18,6 +18,8 @@
 #include <proc/thread.h>
 #include <sched/sched.h>
 #include <drivers/kbd.h>
+#include <drivers/dorder.h>
+#include <drivers/disk.h>
 
 #include <exc/int.h>
 
@@ -48,6 +50,22 @@ void interrupt (context_t *registers)
 		kbd_handle ();
 	}
 	
+	if (cause & CP0_CAUSE_IP5_MASK) {
+		/*
+		 * IP5 signals a completed
+		 * request of the disk device.
+		 */
+		disk_handle ();
+	}
+	
+	if (cause & CP0_CAUSE_IP6_MASK) {
+		/*
+		 * IP6 is an inter-processor interrupt
+		 * raised by the dorder device.
+		 */
+		dorder_handle ();
+	}
+	
 	if (cause & CP0_CAUSE_IP7_MASK) {
 		/*
 		 * IP7 is a timer interrupt.
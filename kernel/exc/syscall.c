@@ -19,7 +19,10 @@
 #include <proc/thread.h>
 #include <proc/process.h>
 #include <proc/sys_thread.h>
+#include <mm/vmm.h>
 #include <synch/sys_mutex.h>
+#include <synch/futex.h>
+#include <synch/lockstat.h>
 #include <drivers/kbd.h>
 
 #include <exc/syscall.h>
@@ -49,33 +52,161 @@ static unative_t sys_exit (int retval)
 }
 
 
+/** Handle the SYS_PUTC system call
+ *
+ * @param c Character to print.
+ *
+ * @return Number of characters printed.
+ *
+ */
 static unative_t sys_putc (char c)
 {
-	// TODO
+	return putc (c);
 }
 
 
+/** Handle the SYS_PUTSTR system call
+ *
+ * @param str  User space string to print.
+ * @param size Length of the string.
+ *
+ * @return Number of characters printed.
+ * @return EINVAL if the string is not mapped.
+ *
+ */
 static unative_t sys_putstr (const char *str, size_t size)
 {
-	// TODO:
+	if (!vma_check_user (str, size))
+		return EINVAL;
+	
+	for (size_t i = 0; i < size; i++)
+		putc (str[i]);
+	
+	return size;
 }
 
 
+/** Handle the SYS_GETC system call
+ *
+ * @return Character read from the keyboard.
+ *
+ */
 static unative_t sys_getc (void)
 {
-	// TODO
+	return getc ();
 }
 
 
+/** Handle the SYS_VMA_MAP system call
+ *
+ * @param from Storage for the starting address of the area.
+ * @param size Size of the area.
+ *
+ * @return EOK if the area was mapped, error code otherwise.
+ *
+ */
 static unative_t sys_vma_map (void **from, const size_t size)
 {
-	// TODO:
+	if (!vma_check_user (from, sizeof (void *)))
+		return EINVAL;
+	
+	return vma_map (from, size, VF_VA_AUTO | VF_AT_KUSEG);
 }
 
 
+/** Handle the SYS_VMA_UNMAP system call
+ *
+ * @param from Starting address of the area.
+ *
+ * @return EOK if the area was unmapped, error code otherwise.
+ *
+ */
 static unative_t sys_vma_unmap (void *from)
 {
-	// TODO
+	return vma_unmap (from);
+}
+
+
+/** Handle the SYS_THREAD_SET_AFFINITY system call
+ *
+ * Restrict the set of CPUs the calling thread
+ * is allowed to run on.
+ *
+ * @param affinity Set of CPUs, one bit per CPU.
+ *
+ * @return EOK if the affinity was set.
+ * @return EINVAL if the set does not contain any running CPU.
+ *
+ */
+static unative_t sys_thread_set_affinity (const cpumask_t affinity)
+{
+	return thread_set_affinity (thread_get_current (), affinity);
+}
+
+
+/** Handle the SYS_THREAD_NANOSLEEP system call
+ *
+ * Suspend the calling thread for the given number
+ * of nanoseconds using a high-resolution timer.
+ *
+ * @param nsec Number of nanoseconds to suspend the thread.
+ *
+ * @return Number of nanoseconds remaining to the timer expiration.
+ *
+ */
+static unative_t sys_thread_nanosleep (const unsigned int nsec)
+{
+	return thread_nanosleep (nsec);
+}
+
+
+/** Handle the SYS_FUTEX_WAIT system call
+ *
+ * Suspend the calling thread while a word in user
+ * memory contains the expected value.
+ *
+ * @param addr     User address of the futex word.
+ * @param expected The value the word is expected to contain.
+ *
+ * @return EOK if the thread has been woken up.
+ * @return EAGAIN if the word does not contain the expected value.
+ * @return EINVAL if the address is not valid.
+ *
+ */
+static unative_t sys_futex_wait (unative_t *addr, const unative_t expected)
+{
+	return futex_wait (addr, expected);
+}
+
+
+/** Handle the SYS_FUTEX_WAKE system call
+ *
+ * Wake up threads suspended on a word in user memory.
+ *
+ * @param addr  User address of the futex word.
+ * @param count Maximal number of threads to wake up.
+ *
+ * @return Number of threads woken up.
+ * @return EINVAL if the address is not valid.
+ *
+ */
+static unative_t sys_futex_wake (unative_t *addr, const unsigned int count)
+{
+	return futex_wake (addr, count);
+}
+
+
+/** Handle the SYS_LOCKSTAT_DUMP system call
+ *
+ * Print the lock contention statistics to the console.
+ *
+ * @return EOK.
+ *
+ */
+static unative_t sys_lockstat_dump (void)
+{
+	lockstat_dump ();
+	return EOK;
 }
 
 
@@ -97,7 +228,12 @@ static syscall_handler syscall_table[] = {
 	(syscall_handler) sys_mutex_init,
 	(syscall_handler) sys_mutex_lock,
 	(syscall_handler) sys_mutex_unlock,
-	(syscall_handler) sys_mutex_destroy
+	(syscall_handler) sys_mutex_destroy,
+	(syscall_handler) sys_thread_set_affinity,
+	(syscall_handler) sys_thread_nanosleep,
+	(syscall_handler) sys_futex_wait,
+	(syscall_handler) sys_futex_wake,
+	(syscall_handler) sys_lockstat_dump
 };
 
 
@@ -39,6 +39,11 @@ typedef enum {
 	SYS_MUTEX_LOCK,
 	SYS_MUTEX_UNLOCK,
 	SYS_MUTEX_DESTROY,
+	SYS_THREAD_SET_AFFINITY,
+	SYS_THREAD_NANOSLEEP,
+	SYS_FUTEX_WAIT,
+	SYS_FUTEX_WAKE,
+	SYS_LOCKSTAT_DUMP,
 	SYSCALL_COUNT
 } syscall_t;
 
@@ -283,22 +283,49 @@
 | SMP Support                                                               |
 \***************************************************************************/
 
+/*
+ * A macro is used to cache the number of the current CPU in the PTEBase
+ * field of the Context register of the System Control Coprocessor. This
+ * saves reading the dorder device whenever the number is needed. The
+ * macro has to be used once on each CPU before the SETUP_STATIC_AREA
+ * macro or the cpuid () function.
+ *
+ * The macro will clobber two registers (\temp0 and \temp1), \temp1 will
+ * hold the value read from the dorder device.
+ *
+ */
+
+/*
+ * SETUP_CPU_CONTEXT
+ */
+
+.macro SETUP_CPU_CONTEXT temp0 temp1
+	/* Read the dorder value. */
+	la \temp0, ADDR_IN_KSEG1 (DEVICE_DORDER_ADDR)
+	lw \temp1, (\temp0)
+	
+	/* Store it to the PTEBase field of the Context register. */
+	sll \temp0, \temp1, CP0_CONTEXT_PTEBASE_SHIFT
+	mtc0 \temp0, $context
+	nop
+.endm SETUP_CPU_CONTEXT
+
 /*
  * A macro is used to get the address to the top of the static kernel
  * area which is valid for the current CPU. The value (minus \displacement)
  * is then stored into register \ptr.
  *
- * First the value from dorder device is read (which is the CPU ID ranging
- * from 0 to 31). Then this value is multiplied (by bitwise shifting) by
- * the size of the static area for a single CPU. This offset is added
- * to the address of the beginning of the static area (minus any possible
- * displacement). Finally, because stacks grow to lower addresses in memory,
- * the top of the area is calculated by adding the size again.
+ * First the CPU ID ranging from 0 to 31 is read from the Context register,
+ * where it has been cached by the SETUP_CPU_CONTEXT macro. Then this value
+ * is multiplied (by bitwise shifting) by the size of the static area for
+ * a single CPU. This offset is added to the address of the beginning of
+ * the static area (minus any possible displacement). Finally, because
+ * stacks grow to lower addresses in memory, the top of the area is
+ * calculated by adding the size again.
  *
  * The macro will clobber two registers (\temp0 and \temp1) and store
  * the calculated pointer to register \ptr, which might be the same
- * as \temp1. If it is different, \temp1 will hold the value read from the
- * dorder device.
+ * as \temp1. If it is different, \temp1 will hold the CPU ID.
  *
  * The \displacement has to be a constant.
  *
@@ -309,9 +336,10 @@
  */
 
 .macro SETUP_STATIC_AREA temp0 temp1 ptr displacement
-	/* Read the dorder value. */
-	la \temp0, ADDR_IN_KSEG1 (DEVICE_DORDER_ADDR)
-	lw \temp1, (\temp0)
+	/* Read the CPU ID, the BadVPN2 field is shifted out. */
+	mfc0 \temp1, $context
+	nop
+	srl \temp1, \temp1, CP0_CONTEXT_PTEBASE_SHIFT
 	
 	/*
 	 * Calculate offset in the statically allocated
@@ -24,6 +24,8 @@
 \***************************************************************************/
 
 #define EOK          0       /* Everything's OK */
+#define EPERM        -1      /* Operation not permitted */
+#define EIO          -5      /* I/O error */
 #define EAGAIN       -11     /* Try again */
 #define ENOMEM       -12     /* Out of memory */
 #define EINVAL       -22     /* Invalid argument */
@@ -226,6 +228,7 @@ typedef struct {
 	})
 
 #define read_cp0_index()     read_cp0_register (0)
+#define read_cp0_context()   read_cp0_register (4)
 #define read_cp0_badvaddr()  read_cp0_register (8)
 #define read_cp0_count()     read_cp0_register (9)
 #define read_cp0_entryhi()   read_cp0_register (10)
@@ -252,6 +255,7 @@ typedef struct {
 #define write_cp0_index(val)     write_cp0_register (0, val)
 #define write_cp0_entrylo0(val)  write_cp0_register (2, val)
 #define write_cp0_entrylo1(val)  write_cp0_register (3, val)
+#define write_cp0_context(val)   write_cp0_register (4, val)
 #define write_cp0_pagemask(val)  write_cp0_register (5, val)
 #define write_cp0_wired(val)     write_cp0_register (6, val)
 #define write_cp0_count(val)     write_cp0_register (9, val)
@@ -346,6 +350,23 @@ static inline void enable_interrupts (void)
 }
 
 
+/** Wait for an interrupt
+ *
+ * Puts the processor into the standby mode until an interrupt
+ * request arrives, the simulator does not spend any time on
+ * simulating a waiting processor. The instruction is encoded
+ * directly since it is not known to the assembler for R4000.
+ *
+ */
+static inline void cpu_wait (void)
+{
+	asm volatile (
+		".insn\n"
+		".word 0x42000020\n"
+	);
+}
+
+
 /** Enable simulation tracing
  *
  * With tracing enabled, the simulator will print
@@ -402,7 +423,7 @@ static inline __attribute__((noreturn)) void msim_halt (void)
 	
 	/* This code should be unreachable since
 	   the simulator is already halted.
-	   
+	
 	   However, be extremely paranoid here
 	   and really make sure that the CPU
 	   won't execute any random code past
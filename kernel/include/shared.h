@@ -24,6 +24,13 @@
 #define MAX_CPU  32
 
 
+/*
+ * Size of a CPU cache line, data written frequently
+ * by different CPUs should be kept this far apart
+ */
+#define CACHE_LINE_SIZE  32
+
+
 /*
  * Minimal stack frame size according to MIPS o32 ABI
  */
@@ -79,12 +86,14 @@
 /*
  * Static Kernel Variables
  * In the interrupt and exception handling code, static variables are
- * used for simplicity.
+ * used for simplicity. The area of each CPU also holds the per-CPU
+ * variables, right after the saved registers, while the temporary
+ * stack grows down from its end.
  */
 
 #define KERNEL_STATIC_ADDR   0x400
-#define KERNEL_STATIC_SHIFT  10
-#define KERNEL_STATIC_SIZE   0x400
+#define KERNEL_STATIC_SHIFT  11
+#define KERNEL_STATIC_SIZE   0x800
 #define KERNEL_STATIC_TOTAL  (MAX_CPU * KERNEL_STATIC_SIZE)
 #define KERNEL_STATIC_AREA   (ADDR_IN_KSEG0 (KERNEL_STATIC_ADDR))
 
@@ -93,6 +102,9 @@
 #define STATIC_OFFSET_BADVA    8
 #define STATIC_OFFSET_ENTRYHI  12
 #define STATIC_OFFSET_STATUS   16
+#define STATIC_OFFSET_PERCPU   32
+
+#define STATIC_PERCPU_SIZE  0x200
 
 /*
  * Address of the dorder device.
@@ -273,6 +285,26 @@
 #define CP0_STATUS_CU3(R)   (((R) & CP0_STATUS_CU3_MASK) >> CP0_STATUS_CU3_SHIFT)
 #define CP0_STATUS_CU(R)    (((R) & CP0_STATUS_CU_MASK) >> CP0_STATUS_CU_SHIFT)
 
+/** Context Register (read-write)
+ *
+ * The processor fills the BadVPN2 field on TLB exceptions, the
+ * PTEBase field is left to the operating system. The kernel does
+ * not use the register for page tables, the boot code stores the
+ * number of the CPU in the PTEBase field instead.
+ *
+ */
+#define CP0_CONTEXT_RES1_MASK     0x0000000f
+#define CP0_CONTEXT_BADVPN2_MASK  0x007ffff0
+#define CP0_CONTEXT_PTEBASE_MASK  0xff800000
+
+#define CP0_CONTEXT_RES1_SHIFT     0
+#define CP0_CONTEXT_BADVPN2_SHIFT  4
+#define CP0_CONTEXT_PTEBASE_SHIFT  23
+
+#define CP0_CONTEXT_RES1(R)     (((R) & CP0_CONTEXT_RES1_MASK) >> CP0_CONTEXT_RES1_SHIFT)
+#define CP0_CONTEXT_BADVPN2(R)  (((R) & CP0_CONTEXT_BADVPN2_MASK) >> CP0_CONTEXT_BADVPN2_SHIFT)
+#define CP0_CONTEXT_PTEBASE(R)  (((R) & CP0_CONTEXT_PTEBASE_MASK) >> CP0_CONTEXT_PTEBASE_SHIFT)
+
 /** EntryHi Register (read-write)
  *
  * Used when setting a TLB entry. Contains the high bits
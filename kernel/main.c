@@ -16,36 +16,57 @@
 #include <include/c.h>
 
 #include <mm/malloc.h>
+#include <mm/percpu.h>
 #include <proc/thread.h>
 #include <sched/sched.h>
+#include <sched/smp.h>
 #include <mm/tlb.h>
 #include <mm/falloc.h>
 #include <mm/malloc.h>
 #include <lib/print.h>
 #include <drivers/dorder.h>
 #include <drivers/disk.h>
+#include <synch/futex.h>
+#include <synch/spinlock.h>
+#include <adt/atomic.h>
+#include <drivers/timer.h>
 #include <example.h>
 
 #include <main.h>
 
 
-/** Idle thread
+/** Boot state of a CPU
  *
- * This thread is being scheduled by the application
- * processors and does nothing (it only spins in
- * an infinite loop).
+ * Each CPU polls only its own flag, which lives on a separate
+ * cache line, so that the waiting application processors do
+ * not contend for a shared variable.
  *
- * Since Kalisto lacks the implementation of any
- * synchronization primitives, it is hard to do
- * any real job on the application processors.
- * Even the output to the dprinter device would
- * just create a mess.
+ */
+struct cpu_boot {
+	/** The CPU may initialize itself */
+	volatile bool go;
+} __attribute__((aligned (CACHE_LINE_SIZE)));
+
+
+/** Boot state of all CPUs */
+static struct cpu_boot cpu_boot[MAX_CPU];
+
+/** Serializes the boot messages of the application processors */
+static SPINLOCK_DECLARE (boot_lock);
+
+
+/** Idle thread
+ *
+ * Each CPU has an idle thread which is scheduled only when
+ * there is no other thread to run on the CPU. It waits for
+ * an interrupt and then reschedules, which also makes the
+ * scheduler look for threads to steal from the other CPUs.
  *
  */
 static void *idle (void *data)
 {
 	while (true)
-		thread_yield ();
+		sched_idle ();
 	
 	return NULL;
 }
@@ -63,6 +84,8 @@ static void *idle (void *data)
  */
 void bsp_start (void)
 {
+	unative_t start = timer_get ();
+	
 	/*
 	 * Say hello :-) We write a small message after each
 	 * initialization stage to make it easier to see
@@ -72,6 +95,14 @@ void bsp_start (void)
 	puts ("This is Kalisto " QUOTE_ME(KALISTO_VERSION) ",\n" \
 		"built by " QUOTE_ME(BUILT_BY) " at " __TIME__ " " __DATE__ ".\n");
 	
+	/*
+	 * Set up the per-CPU variables of all CPUs
+	 * before anything else uses them.
+	 */
+	puts ("cpu0: Per-CPU variables ... ");
+	percpu_init ();
+	puts ("OK\n");
+	
 	/*
 	 * Initialize TLB. We are running in an unmapped
 	 * segment, initializing TLB is therefore not
@@ -97,11 +128,21 @@ void bsp_start (void)
 	threads_init ();
 	puts ("OK\n");
 	
+	/* Interprocessor messages. */
+	puts ("cpu0: Interprocessor messages ... ");
+	dorder_init ();
+	puts ("OK\n");
+	
 	/* Scheduler. */
 	puts ("cpu0: Scheduler ... ");
 	scheduler_init ();
 	puts ("OK\n");
 	
+	/* Cross-CPU calls. */
+	puts ("cpu0: Cross-CPU calls ... ");
+	smp_init ();
+	puts ("OK\n");
+	
 	/* Timers. */
 	puts ("cpu0: Timers ... ");
 	int rc = timers_init ();
@@ -109,6 +150,11 @@ void bsp_start (void)
 		panic ("Unable to initialize timers.");
 	puts ("OK\n");
 	
+	/* Futexes. */
+	puts ("cpu0: Futexes ... ");
+	futex_init ();
+	puts ("OK\n");
+	
 	/* Disk. */
 	puts ("cpu0: Disk ... ");
 	disk_init ();
@@ -116,7 +162,7 @@ void bsp_start (void)
 	
 	/* Create an idle thread. */
 	thread_t idle_thread;
-	rc = thread_create (&idle_thread, idle, NULL, 0);
+	rc = thread_create (&idle_thread, idle, NULL, TF_IDLE);
 	if (rc != EOK)
 		panic ("Unable to create the idle thread.");
 	
@@ -129,15 +175,19 @@ void bsp_start (void)
 	if (rc != EOK)
 		panic ("Unable to create the main thread.");
 	
+	printk ("cpu0: Initialized in %u cycles.\n", timer_get () - start);
+	
 	/*
-	 * Allow the first AP to run. It is critical to
-	 * do this after finishing all memory
-	 * allocations since there is no synchronization
-	 * (locking) of the memory management.
+	 * Allow all the APs to initialize their local resources
+	 * in parallel. The global kernel structures have to be
+	 * initialized and visible by then.
 	 */
-	atomic_add (&cpu_ready, 1);
+	memory_barrier ();
 	
-	thread_switch (thread);
+	for (unsigned int cpu = 1; cpu < MAX_CPU; cpu++)
+		cpu_boot[cpu].go = true;
+	
+	schedule ();
 	
 	/*
 	 * The execution should never
@@ -152,26 +202,43 @@ void bsp_start (void)
  * This function is called by the assembler code shortly after bootstrap,
  * with disabled interrupts and temporary stack. The function waits until
  * the global kernel structures are initialized by bsp_start () and only
- * then switches to a standard thread.
+ * then switches to a standard thread. The APs do not wait for each other,
+ * all the shared structures they touch are protected by locks.
  *
  */
 void ap_start (void)
 {
+	unsigned int cpu = cpuid ();
+	
 	/* Wait until we are ready to run. */
-	while (atomic_get(&cpu_ready) < (native_t) cpuid());
+	while (!cpu_boot[cpu].go);
+	
+	memory_barrier ();
+	unative_t start = timer_get ();
 	
 	/* Initialize local CPU resources. */
 	tlb_init ();
 	scheduler_init ();
 	
+	if (timers_init () != EOK)
+		panic ("Unable to initialize timers.");
+	
 	/* Create an idle thread. */
 	thread_t idle_thread;
-	thread_create (&idle_thread, idle, NULL, 0);
+	if (thread_create (&idle_thread, idle, NULL, TF_IDLE) != EOK)
+		panic ("Unable to create the idle thread.");
 	
-	/* Allow the next AP to run. */
-	atomic_add (&cpu_ready, 1);
+	unative_t cycles = timer_get () - start;
 	
-	thread_switch (idle_thread);
+	spinlock_lock (&boot_lock);
+	printk ("cpu%u: Initialized in %u cycles.\n", cpu, cycles);
+	spinlock_unlock (&boot_lock);
+	
+	/*
+	 * Start with the idle thread, the load balancing
+	 * will bring in some work soon.
+	 */
+	schedule ();
 	
 	/*
 	 * The execution should never
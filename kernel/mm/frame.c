@@ -0,0 +1,69 @@
+/**
+ * @file frame.c
+ *
+ * Serialized access to the frame allocator.
+ *
+ * The precompiled frame allocator does no locking of its own. The
+ * kernel heap and the virtual memory maps allocate frames under
+ * different locks, all their calls are therefore serialized by
+ * a single global lock here.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <synch/spinlock.h>
+
+#include <mm/frame.h>
+
+
+/** Lock serializing the calls to the frame allocator */
+static SPINLOCK_DECLARE (frame_lock);
+
+
+/** Allocate physical memory frames
+ *
+ * @param phys  Place to store the physical address of the frames.
+ * @param cnt   Number of frames to allocate.
+ * @param flags Allocation flags, see frame_alloc().
+ *
+ * @return EOK if the frames were allocated.
+ * @return Error code of frame_alloc() otherwise.
+ *
+ */
+int frame_alloc_locked (uintptr_t *phys, const size_t cnt,
+    const vm_flags_t flags)
+{
+	ipl_t state = spinlock_lock_irqsave (&frame_lock);
+	int rc = frame_alloc (phys, cnt, flags);
+	spinlock_unlock_irqrestore (&frame_lock, state);
+	
+	return rc;
+}
+
+
+/** Free physical memory frames
+ *
+ * @param phys Physical address of the frames.
+ * @param cnt  Number of frames to free.
+ *
+ * @return EOK if the frames were freed.
+ * @return Error code of frame_free() otherwise.
+ *
+ */
+int frame_free_locked (const uintptr_t phys, const size_t cnt)
+{
+	ipl_t state = spinlock_lock_irqsave (&frame_lock);
+	int rc = frame_free (phys, cnt);
+	spinlock_unlock_irqrestore (&frame_lock, state);
+	
+	return rc;
+}
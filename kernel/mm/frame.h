@@ -0,0 +1,31 @@
+/**
+ * @file frame.h
+ *
+ * Serialized access to the frame allocator.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <mm/falloc.h>
+
+
+/* Externals are commented with implementation */
+extern int frame_alloc_locked (uintptr_t *phys, const size_t cnt,
+    const vm_flags_t flags);
+extern int frame_free_locked (const uintptr_t phys, const size_t cnt);
+
+
+#endif
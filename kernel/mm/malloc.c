@@ -26,7 +26,8 @@
 #include <include/c.h>
 
 #include <adt/list.h>
-#include <mm/falloc.h>
+#include <mm/frame.h>
+#include <synch/mcslock.h>
 #include <lib/debug.h>
 
 #include <mm/malloc.h>
@@ -113,6 +114,14 @@ typedef struct {
 /** List of heaps */
 static list_t heap_list;
 
+/** Lock protecting the heaps
+ *
+ * All processors allocate from the same heaps,
+ * a queue lock keeps the contention fair.
+ *
+ */
+static MCSLOCK_DECLARE (heap_lock);
+
 
 #ifdef NDEBUG
 
@@ -241,7 +250,7 @@ static void *malloc_heap (const size_t size)
 	 * memory area for the new heap.
 	 */
 	uintptr_t phys;
-	int rc = frame_alloc (&phys, frames, VF_VA_AUTO | VF_AT_KSEG0);
+	int rc = frame_alloc_locked (&phys, frames, VF_VA_AUTO | VF_AT_KSEG0);
 	if (rc != EOK)
 		return NULL;
 	
@@ -289,8 +298,9 @@ void *malloc (const size_t size)
 	 */
 	assert (size <= HEAP_BLOCK_SIZE_MAX);
 	
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
+	/* Lock the heaps, interrupt handlers allocate memory too. */
+	struct mcs_node node;
+	ipl_t state = mcslock_lock_irqsave (&heap_lock, &node);
 	
 	/*
 	 * We have to allocate a bit more to have room for
@@ -351,7 +361,7 @@ void *malloc (const size_t size)
 	if (result == NULL)
 		result = malloc_heap (size);
 	
-	conditionally_enable_interrupts (state);
+	mcslock_unlock_irqrestore (&heap_lock, &node, state);
 	
 	return result;
 }
@@ -364,8 +374,6 @@ void *malloc (const size_t size)
  * of memory condition in the kernel is difficult and we never
  * really need it in the example kernel.
  *
- * Warning: Memory management implementation is not SMP safe.
- *
  * @param size The size of the block to allocate.
  * @return The address of the block.
  *
@@ -384,8 +392,9 @@ void *safe_malloc (const size_t size)
  */
 void free (const void *addr)
 {
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
+	/* Lock the heaps, interrupt handlers free memory too. */
+	struct mcs_node node;
+	ipl_t state = mcslock_lock_irqsave (&heap_lock, &node);
 	
 	/* Calculate the position of the header. */
 	heap_block_head_t *head =
@@ -437,10 +446,10 @@ void free (const void *addr)
 		 * Free the physical frames backing the heap.
 		 */
 		uintptr_t phys = ADDR_FROM_KSEG0 ((uintptr_t) heap);
-		int rc = frame_free (phys, heap->frames);
+		int rc = frame_free_locked (phys, heap->frames);
 		if (rc != EOK)
 			panic ("Unable to release heap.");
 	}
 	
-	conditionally_enable_interrupts (state);
+	mcslock_unlock_irqrestore (&heap_lock, &node, state);
 }
@@ -0,0 +1,46 @@
+/**
+ * @file percpu.c
+ *
+ * Per-CPU variables.
+ *
+ * The per-CPU variables live in the static kernel area of each CPU,
+ * next to the registers saved by the exception handlers. This keeps
+ * the variables of different CPUs on different cache lines and the
+ * area of the current CPU is found without reading the dorder device.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2017
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/print.h>
+#include <lib/string.h>
+
+#include <mm/percpu.h>
+
+
+/** Initialize the per-CPU variables of all CPUs
+ *
+ * Copies the template of the per-CPU variables to the static kernel
+ * area of each CPU. Called by the bootstrap processor before any of
+ * the variables is used, the application processors only wait on
+ * their temporary stacks, which do not reach the per-CPU area.
+ *
+ */
+void percpu_init (void)
+{
+	size_t size = _percpu_end - _percpu_start;
+	
+	if (size > STATIC_PERCPU_SIZE)
+		panic ("Per-CPU variables do not fit into the static area.");
+	
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++)
+		memcpy ((void *) percpu_base (cpu), _percpu_start, size);
+}
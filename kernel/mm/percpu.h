@@ -0,0 +1,116 @@
+/**
+ * @file percpu.h
+ *
+ * Per-CPU variables.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2017
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef PERCPU_H_
+#define PERCPU_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+
+/** Template of the per-CPU variables
+ *
+ * The variables defined by DEFINE_PER_CPU are collected by the linker
+ * into a template, which is copied to the static kernel area of each
+ * CPU during the boot. The template itself is never used afterwards,
+ * the variables are accessed by per_cpu() and this_cpu() only.
+ *
+ */
+extern uint8_t _percpu_start[];
+extern uint8_t _percpu_end[];
+
+
+/** Define a per-CPU variable
+ *
+ * The initial value of the variable is zero.
+ *
+ * @param type Type of the variable.
+ * @param name Name of the variable.
+ *
+ */
+#define DEFINE_PER_CPU(type, name) \
+	__attribute__((section (".percpu"))) type per_cpu__##name
+
+/** Declare a per-CPU variable defined in another module
+ *
+ */
+#define DECLARE_PER_CPU(type, name) \
+	extern type per_cpu__##name
+
+
+/** Offset of a per-CPU variable in the per-CPU area */
+#define PERCPU_OFFSET(name) \
+	((uintptr_t) &per_cpu__##name - (uintptr_t) _percpu_start)
+
+
+/** Get the per-CPU area of a CPU
+ *
+ * @param cpu The CPU to get the area for.
+ *
+ * @return Address of the per-CPU area.
+ *
+ */
+static inline uintptr_t percpu_base (const unsigned int cpu)
+{
+	return KERNEL_STATIC_AREA + STATIC_OFFSET_PERCPU +
+	    (cpu << KERNEL_STATIC_SHIFT);
+}
+
+
+/** Get the per-CPU area of the current CPU
+ *
+ * The number of the CPU is cached in the Context register, shifting
+ * it right by less than the field position yields the offset of the
+ * static kernel area of the CPU directly.
+ *
+ * @return Address of the per-CPU area.
+ *
+ */
+static inline uintptr_t percpu_local_base (void)
+{
+	return KERNEL_STATIC_AREA + STATIC_OFFSET_PERCPU +
+	    ((read_cp0_context () & CP0_CONTEXT_PTEBASE_MASK) >>
+	    (CP0_CONTEXT_PTEBASE_SHIFT - KERNEL_STATIC_SHIFT));
+}
+
+
+/** Access a per-CPU variable of a CPU
+ *
+ * @param name Name of the variable.
+ * @param cpu  The CPU whose instance to access.
+ *
+ */
+#define per_cpu(name, cpu) \
+	(*(__typeof__ (per_cpu__##name) *) \
+	    (percpu_base (cpu) + PERCPU_OFFSET (name)))
+
+/** Access a per-CPU variable of the current CPU
+ *
+ * Unless interrupts are disabled, the thread may migrate
+ * to another CPU right after the access.
+ *
+ * @param name Name of the variable.
+ *
+ */
+#define this_cpu(name) \
+	(*(__typeof__ (per_cpu__##name) *) \
+	    (percpu_local_base () + PERCPU_OFFSET (name)))
+
+
+/* Externals are commented with implementation */
+extern void percpu_init (void);
+
+
+#endif /* PERCPU_H_ */
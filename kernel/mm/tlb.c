@@ -19,6 +19,7 @@
 #include <lib/debug.h>
 #include <mm/vmm.h>
 #include <proc/thread.h>
+#include <sched/smp.h>
 
 #include <mm/tlb.h>
 
@@ -224,30 +225,25 @@ static void tlb_store_random (size_t vpn, size_t pfn)
 }
 
 
-/** Flush a page from TLB.
+/** Flush a page of an address space from TLB.
  *
- * Remove any mapping of the given virtual page from TLB.
- * This operation is needed when a virtual memory mapping
- * for the given page is canceled in order to keep the TLB
- * consistent with the kernel view.
+ * Must be called with interrupts disabled.
  *
- * @param addr Virtual address be flushed from TLB.
+ * @param addr Virtual address to be flushed from TLB.
+ * @param asid Address space identifier of the mapping.
  *
  */
-void tlb_flush (uintptr_t addr)
+static void tlb_flush_entry (uintptr_t addr, asid_t asid)
 {
-	/* Disable interrupts while manipulating the TLB. */
-	ipl_t state = query_and_disable_interrupts ();
-	
 	/* Save the original EntryHi */
 	unative_t entryhi = read_cp0_entryhi ();
-	unative_t probe = entryhi;
 	
 	/*
 	 * Probe for the TLB entry matching the virtual
-	 * page number.
+	 * page number and the address space.
 	 */
-	probe &= ~CP0_ENTRYHI_VPN2_MASK;
+	unative_t probe = (asid << CP0_ENTRYHI_ASID_SHIFT) &
+	    CP0_ENTRYHI_ASID_MASK;
 	probe |= (addr >> PAGE_WIDTH >> 1) << CP0_ENTRYHI_VPN2_SHIFT;
 	
 	write_cp0_entryhi (probe);
@@ -267,11 +263,83 @@ void tlb_flush (uintptr_t addr)
 	
 	/* Restore the original EntryHi */
 	write_cp0_entryhi (entryhi);
+}
+
+
+/** Flush a page from TLB.
+ *
+ * Remove any mapping of the given virtual page from TLB.
+ * This operation is needed when a virtual memory mapping
+ * for the given page is canceled in order to keep the TLB
+ * consistent with the kernel view.
+ *
+ * @param addr Virtual address be flushed from TLB.
+ *
+ */
+void tlb_flush (uintptr_t addr)
+{
+	/* Disable interrupts while manipulating the TLB. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	tlb_flush_entry (addr, CP0_ENTRYHI_ASID (read_cp0_entryhi ()));
 	
 	conditionally_enable_interrupts (state);
 }
 
 
+/** TLB shootdown request
+ *
+ */
+struct tlb_shootdown {
+	/** Virtual address of the first page */
+	uintptr_t addr;
+	
+	/** Number of pages */
+	size_t count;
+	
+	/** Address space identifier of the mappings */
+	asid_t asid;
+};
+
+
+/** Flush the pages of a TLB shootdown on the current CPU
+ *
+ * Called with interrupts disabled.
+ *
+ */
+static void tlb_shootdown_func (void *data)
+{
+	struct tlb_shootdown *request = (struct tlb_shootdown *) data;
+	
+	for (size_t pos = 0; pos < request->count; pos++)
+		tlb_flush_entry (request->addr + (pos << PAGE_WIDTH),
+		    request->asid);
+}
+
+
+/** Flush pages of an address space from TLB on all CPUs
+ *
+ * Remove the mappings of the given virtual pages from the TLB
+ * of every online CPU and wait until all of them are done. The
+ * other CPUs might be running threads of the address space.
+ *
+ * @param addr  Virtual address of the first page.
+ * @param count Number of pages.
+ * @param asid  Address space identifier of the mappings.
+ *
+ */
+void tlb_shootdown (uintptr_t addr, size_t count, asid_t asid)
+{
+	struct tlb_shootdown request = {
+		.addr = addr,
+		.count = count,
+		.asid = asid
+	};
+	
+	smp_call_function_many (CPUMASK_ALL, tlb_shootdown_func, &request);
+}
+
+
 /** TLB Invalid Exception handler
  *
  * Handle the TLB Invalid Exception.
@@ -20,6 +20,7 @@
 extern void tlb_init (void);
 extern void tlb_invalid (context_t *registers);
 extern void tlb_flush (uintptr_t addr);
+extern void tlb_shootdown (uintptr_t addr, size_t count, asid_t asid);
 extern void wrapped_tlb_refill (context_t *registers);
 
 
@@ -20,6 +20,8 @@
 #include <proc/thread.h>
 #include <lib/string.h>
 #include <mm/tlb.h>
+#include <mm/frame.h>
+#include <synch/rcu.h>
 
 #include <mm/vmm.h>
 
@@ -60,6 +62,9 @@
 /** Primitive global counter for assinging new ASIDs */
 static asid_t last_asid = 0;
 
+/** Lock protecting the ASID counter */
+static SPINLOCK_DECLARE (asid_lock);
+
 
 /** Create a virtual memory area
  *
@@ -98,10 +103,9 @@ int vma_map (void **from, const size_t size, const vm_flags_t flags)
 	if (flag_kseg0) {
 		panic ("Not implemented");
 	} else {
-		/* Disable interrupts while accessing shared structures. */
-		ipl_t state = query_and_disable_interrupts ();
-		
+		/* The lock serializes the updates, the readers use RCU. */
 		struct vmm *vmm = thread_get_current ()->vmm;
+		ipl_t state = spinlock_lock_irqsave (&vmm->lock);
 		
 		if (flag_auto) {
 			// TODO:
@@ -120,7 +124,7 @@ int vma_map (void **from, const size_t size, const vm_flags_t flags)
 			}
 			
 			if (vpn == 0) {
-				conditionally_enable_interrupts (state);
+				spinlock_unlock_irqrestore (&vmm->lock, state);
 				return ENOMEM;
 			}
 			
@@ -128,7 +132,7 @@ int vma_map (void **from, const size_t size, const vm_flags_t flags)
 		}
 		
 		if (ALIGN_DOWN ((uintptr_t) *from, PAGE_SIZE) != (uintptr_t) *from) {
-			conditionally_enable_interrupts (state);
+			spinlock_unlock_irqrestore (&vmm->lock, state);
 			return EINVAL;
 		}
 		
@@ -137,26 +141,30 @@ int vma_map (void **from, const size_t size, const vm_flags_t flags)
 		 * area.
 		 */
 		for (unsigned int i = 0; i < VMAS; i++) {
-			if (!vmm->vma[i].valid) {
+			if ((!vmm->vma[i].valid) && (!vmm->vma[i].retired)) {
 				
 				// TODO:
 				// We can only satisfy the request with a continuous
 				// physical memory area. This is rather inefficient.
 				
 				uintptr_t phys;
-				rc = frame_alloc (&phys, count, VF_VA_AUTO | VF_AT_KSEG0);
+				rc = frame_alloc_locked (&phys, count,
+				    VF_VA_AUTO | VF_AT_KSEG0);
 				if (rc != EOK)
 					break;
 				
 				vmm->vma[i].vpn_base = ((uintptr_t) *from) >> PAGE_WIDTH;
 				vmm->vma[i].pfn_base = phys >> FRAME_WIDTH;
 				vmm->vma[i].count = count;
+				
+				/* Publish the slot to the readers. */
+				memory_barrier ();
 				vmm->vma[i].valid = true;
 				break;
 			}
 		}
 		
-		conditionally_enable_interrupts (state);
+		spinlock_unlock_irqrestore (&vmm->lock, state);
 	}
 	
 	return rc;
@@ -166,6 +174,8 @@ int vma_map (void **from, const size_t size, const vm_flags_t flags)
 /** Remove a virtual memory area
  *
  * Remove a virtual memory area previously created by vma_map().
+ * The frames of the area are freed after an RCU grace period,
+ * once no lookup can be using the area any longer.
  *
  * @param from  Starting virtual memory address of the virtual
  *              memory area.
@@ -181,35 +191,44 @@ int vma_unmap (const void *from)
 	
 	size_t vpn = ((uintptr_t) from) >> PAGE_WIDTH;
 	
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
-	
 	struct vmm *vmm = thread_get_current ()->vmm;
-	int rc = EINVAL;
+	ipl_t state = spinlock_lock_irqsave (&vmm->lock);
+	struct vma *vma = NULL;
 	
 	/*
 	 * Find the "slot" of the virtual memory area.
 	 */
 	for (unsigned int i = 0; i < VMAS; i++) {
 		if ((vmm->vma[i].valid) && (vmm->vma[i].vpn_base == vpn)) {
-			uintptr_t phys = vmm->vma[i].pfn_base << FRAME_WIDTH;
+			vma = &vmm->vma[i];
 			
-			rc = frame_free (phys, vmm->vma[i].count);
-			if (rc != EOK)
-				break;
-			
-			/*
-			 * Flush the pages from TLB.
-			 */
-			for (size_t pos = 0; pos < vmm->vma[i].count; pos++)
-				tlb_flush ((vpn + pos) << FRAME_WIDTH);
-			
-			vmm->vma[i].valid = false;
+			/* The slot is not reused until the frames are freed. */
+			vma->valid = false;
+			vma->retired = true;
 			break;
 		}
 	}
 	
-	conditionally_enable_interrupts (state);
+	spinlock_unlock_irqrestore (&vmm->lock, state);
+	
+	if (vma == NULL)
+		return EINVAL;
+	
+	/*
+	 * Flush the pages from TLB on all CPUs, which might be
+	 * running threads of the address space. The mapping is
+	 * no longer valid and cannot be loaded to TLB again.
+	 */
+	tlb_shootdown (vpn << PAGE_WIDTH, vma->count, vmm->asid);
+	
+	synchronize_rcu ();
+	
+	state = spinlock_lock_irqsave (&vmm->lock);
+	
+	int rc = frame_free_locked (vma->pfn_base << FRAME_WIDTH, vma->count);
+	vma->retired = false;
+	
+	spinlock_unlock_irqrestore (&vmm->lock, state);
 	return rc;
 }
 
@@ -231,10 +250,8 @@ int vma_check_user (const void *addr, const size_t size)
 	size_t vpn_start = ((uintptr_t) addr) >> PAGE_WIDTH;
 	size_t vpn_end = (((uintptr_t) addr) + size) >> PAGE_WIDTH;
 	
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
-	
 	struct vmm *vmm = thread_get_current ()->vmm;
+	ipl_t state = rcu_read_lock ();
 	int rc = false;
 	
 	for (unsigned int i = 0; i < VMAS; i++) {
@@ -251,7 +268,7 @@ int vma_check_user (const void *addr, const size_t size)
 	// TODO:
 	// Check that the memory area is actually in KUSEG
 	
-	conditionally_enable_interrupts (state);
+	rcu_read_unlock (state);
 	
 	return rc;
 }
@@ -274,9 +291,9 @@ int vmm_create (vmm_t *pvmm)
 		return ENOMEM;
 	
 	bzero (vmm, sizeof (struct vmm));
+	spinlock_init (&vmm->lock);
 	
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
+	ipl_t state = spinlock_lock_irqsave (&asid_lock);
 	
 	// TODO:
 	// This is really broken. The address space identifiers
@@ -286,7 +303,7 @@ int vmm_create (vmm_t *pvmm)
 	vmm->asid = last_asid;
 	last_asid++;
 	
-	conditionally_enable_interrupts (state);
+	spinlock_unlock_irqrestore (&asid_lock, state);
 	
 	(* pvmm) = vmm;
 	return EOK;
@@ -296,7 +313,8 @@ int vmm_create (vmm_t *pvmm)
 /** Translate virtual address to physical address
  *
  * Convert virtual address to physical address using the current virtual
- * memory map.
+ * memory map. The lookup does not take the lock of the map, it runs as
+ * an RCU read-side critical section.
  *
  * @param virt Virtual address to convert.
  * @param phys Storage for the converted physical address. No value
@@ -308,10 +326,8 @@ int vmm_create (vmm_t *pvmm)
  */
 int vmm_mapping_find (uintptr_t virt, uintptr_t *phys)
 {
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
-	
 	struct vmm *vmm = thread_get_current ()->vmm;
+	ipl_t state = rcu_read_lock ();
 	int rc = EINVAL;
 	uintptr_t vpn = virt >> PAGE_WIDTH;
 	
@@ -332,6 +348,6 @@ int vmm_mapping_find (uintptr_t virt, uintptr_t *phys)
 		}
 	}
 	
-	conditionally_enable_interrupts (state);
+	rcu_read_unlock (state);
 	return rc;
 }
@@ -18,6 +18,7 @@
 
 #include <include/c.h>
 #include <mm/falloc.h>
+#include <synch/spinlock.h>
 
 
 /** The size of a page.
@@ -46,6 +47,9 @@ struct vma {
 	uintptr_t pfn_base;
 	size_t count;
 	bool valid;
+	
+	/** Unmapped, but possibly still seen by RCU readers */
+	bool retired;
 };
 
 
@@ -53,6 +57,7 @@ struct vma {
  *
  */
 typedef struct vmm {
+	spinlock_t lock;
 	asid_t asid;
 	struct vma vma[VMAS];
 } *vmm_t;
@@ -0,0 +1,283 @@
+/**
+ * @file handle.c
+ *
+ * Per-process handle tables.
+ *
+ * A handle table maps the handles passed to user space to kernel
+ * objects. A handle is validated and translated in constant time,
+ * the table is indexed by the handle and the entry is checked for
+ * the generation and the type of the object. Free entries are kept
+ * on a free list, the table doubles when it runs out of them.
+ *
+ * Lookups run as RCU read-side critical sections and take no lock.
+ * An entry is filled in before its type is published, and its type
+ * is revoked before the generation changes, a lookup thus never sees
+ * an object with the wrong type or generation. An object which can
+ * be freed while used by a lookup is reference counted, the lookup
+ * takes a reference before it leaves the read-side critical section
+ * and the object is freed after a grace period.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/debug.h>
+#include <mm/malloc.h>
+#include <lib/string.h>
+#include <adt/atomic.h>
+
+#include <proc/handle.h>
+
+
+/** Initialize a handle table
+ *
+ * The entries are allocated with the first handle.
+ *
+ * @param table Handle table to initialize.
+ *
+ */
+void handle_table_init (struct handle_table *table)
+{
+	spinlock_init (&table->lock);
+	table->block = NULL;
+	table->size = 0;
+	table->free = 0;
+}
+
+
+/** Free a replaced block of handle table entries
+ *
+ * @param head Deferred free of the block.
+ *
+ */
+static void handle_block_free (struct rcu_head *head)
+{
+	free (list_container_of (head, struct handle_block, rcu));
+}
+
+
+/** Double the size of a handle table
+ *
+ * Must be called with the table locked.
+ *
+ * @param table Handle table to extend.
+ *
+ * @return EOK if the table was extended.
+ * @return ENOMEM if there is no memory or no more handle indices.
+ *
+ */
+static int handle_table_grow (struct handle_table *table)
+{
+	unsigned int size = (table->size == 0) ?
+	    HANDLE_TABLE_INITIAL : table->size * 2;
+	
+	if (size > HANDLE_INDEX_MASK + 1)
+		return ENOMEM;
+	
+	struct handle_block *block = (struct handle_block *)
+	    malloc (sizeof (struct handle_block) +
+	    size * sizeof (struct handle_entry));
+	if (block == NULL)
+		return ENOMEM;
+	
+	struct handle_block *old = table->block;
+	if (old != NULL) {
+		memcpy (block->entries, old->entries,
+		    table->size * sizeof (struct handle_entry));
+	}
+	
+	for (unsigned int i = table->size; i < size; i++) {
+		block->entries[i].object = NULL;
+		block->entries[i].type = HANDLE_FREE;
+		block->entries[i].generation = 1;
+		block->entries[i].next_free = i + 1;
+	}
+	
+	block->size = size;
+	
+	/* Publish the block only after it is filled in. */
+	memory_barrier ();
+	table->block = block;
+	
+	if (old != NULL)
+		call_rcu (&old->rcu, handle_block_free);
+	
+	/* The table only grows with no free entries left. */
+	table->free = table->size;
+	table->size = size;
+	
+	return EOK;
+}
+
+
+/** Find the entry of a handle
+ *
+ * Must be called with the table locked.
+ *
+ * @param table  Handle table to search.
+ * @param handle Handle to find.
+ * @param type   Expected type of the object.
+ *
+ * @return The entry of the handle.
+ * @return NULL if the handle is not valid.
+ *
+ */
+static struct handle_entry *handle_find (struct handle_table *table,
+    handle_t handle, handle_type_t type)
+{
+	unsigned int index = handle & HANDLE_INDEX_MASK;
+	unsigned int generation = handle >> HANDLE_INDEX_BITS;
+	
+	if (index >= table->size)
+		return NULL;
+	
+	struct handle_entry *entry = &table->block->entries[index];
+	if ((entry->type != type) || (entry->generation != generation))
+		return NULL;
+	
+	return entry;
+}
+
+
+/** Allocate a handle
+ *
+ * @param table  Handle table to allocate the handle in.
+ * @param type   Type of the object.
+ * @param object Object the handle refers to.
+ * @param handle Place to store the handle.
+ *
+ * @return EOK if the handle was allocated.
+ * @return ENOMEM if the table could not be extended.
+ *
+ */
+int handle_alloc (struct handle_table *table, handle_type_t type,
+    void *object, handle_t *handle)
+{
+	assert (type != HANDLE_FREE);
+	
+	ipl_t state = spinlock_lock_irqsave (&table->lock);
+	
+	if (table->free == table->size) {
+		int rc = handle_table_grow (table);
+		if (rc != EOK) {
+			spinlock_unlock_irqrestore (&table->lock, state);
+			return rc;
+		}
+	}
+	
+	unsigned int index = table->free;
+	struct handle_entry *entry = &table->block->entries[index];
+	
+	table->free = entry->next_free;
+	entry->object = object;
+	
+	/* Publish the entry only after it is filled in. */
+	memory_barrier ();
+	entry->type = type;
+	
+	(* handle) = (entry->generation << HANDLE_INDEX_BITS) | index;
+	
+	spinlock_unlock_irqrestore (&table->lock, state);
+	return EOK;
+}
+
+
+/** Translate a handle to an object
+ *
+ * The lookup does not take the lock of the table.
+ *
+ * @param table  Handle table to search.
+ * @param handle Handle to translate.
+ * @param type   Expected type of the object.
+ * @param ref    Function taking a reference to the object
+ *               or NULL if the object is never freed.
+ *
+ * @return The object the handle refers to.
+ * @return NULL if the handle is not valid.
+ *
+ */
+void *handle_get (struct handle_table *table, handle_t handle,
+    handle_type_t type, handle_ref_fn ref)
+{
+	unsigned int index = handle & HANDLE_INDEX_MASK;
+	unsigned int generation = handle >> HANDLE_INDEX_BITS;
+	void *object = NULL;
+	
+	ipl_t state = rcu_read_lock ();
+	
+	struct handle_block *block = table->block;
+	if ((block != NULL) && (index < block->size)) {
+		struct handle_entry *entry = &block->entries[index];
+		
+		if ((entry->type == type) &&
+		    (entry->generation == generation)) {
+			memory_barrier ();
+			object = entry->object;
+			memory_barrier ();
+			
+			/* The entry might have been reused meanwhile. */
+			if ((entry->type != type) ||
+			    (entry->generation != generation))
+				object = NULL;
+			
+			if ((object != NULL) && (ref != NULL) &&
+			    (!ref (object)))
+				object = NULL;
+		}
+	}
+	
+	rcu_read_unlock (state);
+	return object;
+}
+
+
+/** Free a handle
+ *
+ * The generation of the entry changes, so that the handle
+ * is not valid any longer even after the entry is reused.
+ *
+ * @param table  Handle table to free the handle in.
+ * @param handle Handle to free.
+ * @param type   Expected type of the object.
+ *
+ * @return The object the handle referred to.
+ * @return NULL if the handle is not valid.
+ *
+ */
+void *handle_free (struct handle_table *table, handle_t handle,
+    handle_type_t type)
+{
+	ipl_t state = spinlock_lock_irqsave (&table->lock);
+	
+	struct handle_entry *entry = handle_find (table, handle, type);
+	if (entry == NULL) {
+		spinlock_unlock_irqrestore (&table->lock, state);
+		return NULL;
+	}
+	
+	void *object = entry->object;
+	
+	/* Revoke the entry before it changes. */
+	entry->type = HANDLE_FREE;
+	memory_barrier ();
+	entry->object = NULL;
+	
+	/* Generation zero is skipped, no handle is ever zero. */
+	entry->generation = (entry->generation + 1) & HANDLE_GEN_MASK;
+	if (entry->generation == 0)
+		entry->generation = 1;
+	
+	entry->next_free = table->free;
+	table->free = handle & HANDLE_INDEX_MASK;
+	
+	spinlock_unlock_irqrestore (&table->lock, state);
+	return object;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file handle.h
+ *
+ * Per-process handle tables.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef HANDLE_H_
+#define HANDLE_H_
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <synch/spinlock.h>
+#include <synch/rcu.h>
+
+
+/** Handle layout
+ *
+ * The lower bits of a handle index the handle table, the upper
+ * bits hold the generation of the table entry. The generation
+ * changes whenever an entry is freed, a stale handle therefore
+ * does not refer to an object which reused the entry.
+ *
+ */
+#define HANDLE_INDEX_BITS  16
+#define HANDLE_INDEX_MASK  ((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GEN_MASK    ((1 << (32 - HANDLE_INDEX_BITS)) - 1)
+
+/** Initial number of handle table entries */
+#define HANDLE_TABLE_INITIAL  16
+
+
+/** Handle value */
+typedef unative_t handle_t;
+
+
+/** Take a reference to an object found by a lookup
+ *
+ * Called within the RCU read-side critical section of the lookup,
+ * returns false if the object is already going away.
+ *
+ */
+typedef bool (* handle_ref_fn) (void *object);
+
+
+/** Types of objects referred to by handles.
+ *
+ */
+typedef enum {
+	HANDLE_FREE = 0,
+	HANDLE_UMUTEX
+} handle_type_t;
+
+
+/** Handle table entry.
+ *
+ */
+struct handle_entry {
+	/** Object the entry refers to */
+	void *object;
+	
+	/** Type of the object, HANDLE_FREE for a free entry */
+	handle_type_t type;
+	
+	/** Generation of the entry */
+	unsigned int generation;
+	
+	/** Index of the next free entry */
+	unsigned int next_free;
+};
+
+
+/** Handle table entries.
+ *
+ * A block is replaced by a larger one when the table grows,
+ * the old block is freed after an RCU grace period.
+ *
+ */
+struct handle_block {
+	/** Deferred free of the block */
+	struct rcu_head rcu;
+	
+	/** Number of entries */
+	unsigned int size;
+	
+	/** Table entries */
+	struct handle_entry entries[];
+};
+
+
+/** Handle table.
+ *
+ * Lookups do not take the lock, they run as RCU
+ * read-side critical sections.
+ *
+ */
+struct handle_table {
+	/** Lock serializing the updates */
+	spinlock_t lock;
+	
+	/** Table entries, NULL before the first handle is allocated */
+	struct handle_block *volatile block;
+	
+	/** Number of entries */
+	unsigned int size;
+	
+	/** Index of the first free entry, size if there is none */
+	unsigned int free;
+};
+
+
+/* Externals are commented with implementation */
+extern void handle_table_init (struct handle_table *table);
+extern int handle_alloc (struct handle_table *table, handle_type_t type,
+    void *object, handle_t *handle);
+extern void *handle_get (struct handle_table *table, handle_t handle,
+    handle_type_t type, handle_ref_fn ref);
+extern void *handle_free (struct handle_table *table, handle_t handle,
+    handle_type_t type);
+
+
+#endif
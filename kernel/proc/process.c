@@ -146,7 +146,7 @@ int process_create (process_t *pprocess, void *image, size_t size)
 	process->image = image;
 	process->size = size;
 	list_init (&process->uthread_list);
-	list_init (&process->umutex_list);
+	handle_table_init (&process->handles);
 	
 	uthread->process = process;
 	uthread->entry = (void *) USER_CODE_START;
@@ -19,6 +19,7 @@
 #include <include/c.h>
 
 #include <adt/list.h>
+#include <proc/handle.h>
 
 
 /** User process entry point */
@@ -58,8 +59,8 @@ typedef struct process {
 	/** List of all owned user threads */
 	list_t uthread_list;
 	
-	/** list of all owned user mutexes */
-	list_t umutex_list;
+	/** Handles of the objects owned by the process */
+	struct handle_table handles;
 } *process_t;
 
 
@@ -20,13 +20,22 @@
 #include <sched/sched.h>
 #include <drivers/dorder.h>
 #include <time/time.h>
+#include <synch/mutex.h>
 #include <lib/print.h>
 
 #include <proc/thread.h>
 
 
-/** Currently running threads on each CPU */
-thread_t current_thread[MAX_CPU];
+/** Currently running thread on each CPU */
+DEFINE_PER_CPU (thread_t, current_thread);
+
+/*
+ * Fail the build if the wait queue link moves, see
+ * THREAD_WAIT_QUEUE_LINK_OFFSET.
+ */
+typedef char thread_wait_queue_link_check
+    [(__builtin_offsetof (struct thread, wait_queue_link) ==
+    THREAD_WAIT_QUEUE_LINK_OFFSET) ? 1 : -1];
 
 
 /** Initialize threads management
@@ -39,7 +48,7 @@ void threads_init (void)
 {
 	/* Initialize the state of current threads. */
 	for (unsigned int i = 0; i < MAX_CPU; i++)
-		current_thread[i] = NULL;
+		per_cpu (current_thread, i) = NULL;
 }
 
 
@@ -52,6 +61,13 @@ void threads_init (void)
  */
 static void thread_stub (thread_t thread)
 {
+	/*
+	 * The new thread is entered from schedule() with the run
+	 * queue locked and with disabled interrupts.
+	 */
+	sched_finish_switch ();
+	enable_interrupts ();
+	
 	void *retval = thread->entry_func (thread->entry_data);
 	thread_finish (retval);
 }
@@ -59,7 +75,9 @@ static void thread_stub (thread_t thread)
 
 /** Create a new thread
  *
- * Create a new thread and schedule it for execution.
+ * Create a new thread and schedule it for execution. A thread created
+ * with the TF_IDLE flag becomes the idle thread of the current CPU
+ * and is not put into the run queue.
  *
  * @param pthread Pointer to thread_t holder.
  * @param entry   Thread entry function.
@@ -94,7 +112,7 @@ int thread_create (thread_t *pthread, thread_fn entry, void *data,
 	 */
 	ipl_t state = query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	
 	if ((current == NULL) || ((flags & TF_NEW_VMM) == TF_NEW_VMM)) {
 		int rc = vmm_create (&thread->vmm);
@@ -134,16 +152,42 @@ int thread_create (thread_t *pthread, thread_fn entry, void *data,
 	 * contains the thread context structure, which is restored
 	 * on context switch. Of the entire structure, only the
 	 * starting address of the thread and some vital
-	 * processor registers are set.
+	 * processor registers are set. The thread starts with
+	 * disabled interrupts, see thread_stub().
 	 */
 	thread->stack_top = ((char *) thread->stack_data) +
 	    THREAD_STACK_SIZE - sizeof (context_t) - ABI_STACK_FRAME;
 	
 	thread->scheduled = 0;
+	thread->cpu = cpuid ();
+	
+	/*
+	 * The idle thread is bound to its CPU, other threads
+	 * inherit the affinity of their creator.
+	 */
+	if ((flags & TF_IDLE) == TF_IDLE)
+		thread->affinity = CPUMASK_CPU (thread->cpu);
+	else if (current != NULL)
+		thread->affinity = current->affinity;
+	else
+		thread->affinity = CPUMASK_ALL;
+	
+	/* Likewise for the priority. */
+	if ((flags & TF_IDLE) == TF_IDLE)
+		thread->base_priority = THREAD_PRIORITY_MIN;
+	else if (current != NULL)
+		thread->base_priority = current->base_priority;
+	else
+		thread->base_priority = THREAD_PRIORITY_DEFAULT;
+	
+	thread->priority = thread->base_priority;
 	thread->state = THREAD_READY;
+	spinlock_init (&thread->join_lock);
 	thread->joiner = NULL;
 	
 	link_init (&thread->wait_queue_link);
+	thread->blocked_on = NULL;
+	list_init (&thread->held_mutexes);
 	
 	/*
 	 * We use a pointer to the thread context
@@ -154,9 +198,12 @@ int thread_create (thread_t *pthread, thread_fn entry, void *data,
 	context->ra = (unative_t) thread_stub;
 	context->a0 = (unative_t) thread;
 	context->gp = ADDR_IN_KSEG0 (0);
-	context->status = CP0_STATUS_IE_MASK | CP0_STATUS_IM_MASK;
+	context->status = CP0_STATUS_IM_MASK;
 	
-	sched_insert (thread);
+	if ((flags & TF_IDLE) == TF_IDLE)
+		sched_set_idle (thread);
+	else
+		sched_insert (thread);
 	
 	(* pthread) = thread;
 	return EOK;
@@ -179,7 +226,7 @@ thread_t thread_get_current (void)
 {
 	/* Disable interrupts while accessing shared structures. */
 	ipl_t state = query_and_disable_interrupts ();
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	conditionally_enable_interrupts (state);
 	
 	return current;
@@ -195,7 +242,7 @@ void thread_suspend (void)
 {
 	ipl_t state = query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	current->state = THREAD_SLEEPING;
 	
 	sched_remove (current);
@@ -213,22 +260,73 @@ void thread_suspend (void)
  */
 int thread_wakeup (thread_t thread)
 {
-	ipl_t state = query_and_disable_interrupts ();
-	
-	if (thread->state == THREAD_SLEEPING) {
-		thread->state = THREAD_READY;
-		sched_insert (thread);
-	}
+	/*
+	 * The scheduler checks the thread state and picks
+	 * the run queue to put the thread in.
+	 */
+	sched_wakeup (thread);
+	return EOK;
+}
+
+
+/** Set the CPU affinity of a thread
+ *
+ * Restrict the set of CPUs the thread is allowed to run on.
+ * If the thread is not allowed to stay on its current CPU,
+ * it is migrated.
+ *
+ * @param thread   Thread to set the affinity for.
+ * @param affinity Set of CPUs the thread is allowed to run on.
+ *
+ * @return EOK if the affinity was set.
+ * @return EINVAL if the set does not contain any running CPU.
+ *
+ */
+int thread_set_affinity (thread_t thread, const cpumask_t affinity)
+{
+	return sched_set_affinity (thread, affinity);
+}
+
+
+/** Set the priority of a thread
+ *
+ * The thread keeps running with a higher priority inherited
+ * from the threads waiting for its mutexes, if there is one.
+ *
+ * @param thread   Thread to set the priority for.
+ * @param priority Priority between THREAD_PRIORITY_MIN
+ *                 and THREAD_PRIORITY_MAX.
+ *
+ * @return EOK if the priority was set.
+ * @return EINVAL if the priority is out of range.
+ *
+ */
+int thread_set_priority (thread_t thread, const unsigned int priority)
+{
+	if (priority > THREAD_PRIORITY_MAX)
+		return EINVAL;
 	
-	conditionally_enable_interrupts (state);
+	mutex_pi_set_priority (thread, priority);
 	return EOK;
 }
 
 
+/** Get the effective priority of a thread
+ *
+ * @param thread Thread to get the priority of.
+ *
+ * @return The priority the thread is scheduled with.
+ *
+ */
+unsigned int thread_get_priority (thread_t thread)
+{
+	return thread->priority;
+}
+
+
 /** Thread timeout handler
  *
- * Wake up the thread that called thread_sleep() or
- * thread_usleep().
+ * Wake up the thread that called thread_sleep().
  *
  */
 static void thread_timeout_handler (struct timer *timer, void *data)
@@ -252,17 +350,19 @@ unsigned int thread_sleep (const unsigned int sec)
 	
 	ipl_t state = query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	current->state = THREAD_SLEEPING;
 	
 	sched_remove (current);
 	
 	/*
 	 * Setup up a timer to wake us up. The timer will be deleted from
-	 * the list of timers when it expires and fires the handler.
+	 * the list of timers when it expires and fires the handler, which
+	 * is called directly from the timer interrupt handler.
 	 */
-	timer_init_jiffies (&current->timer, timeout, thread_timeout_handler,
-	    current);
+	timer_init_flags (&current->timer, timeout, thread_timeout_handler,
+	    current, TIMER_IRQSAFE);
+	timer_set_slack (&current->timer, timeout >> THREAD_SLEEP_SLACK_SHIFT);
 	timer_start (&current->timer);
 	
 	schedule ();
@@ -270,7 +370,7 @@ unsigned int thread_sleep (const unsigned int sec)
 	/*
 	 * After wakeup, determine the time remaining to timer expiration.
 	 */
-	unsigned int remains = current->timer.expires - jiffies;
+	unsigned int remains = current->timer.expires - jiffies_get ();
 	
 	/*
 	 * Destroy the timer. Waits for completion of the timer handler.
@@ -282,67 +382,107 @@ unsigned int thread_sleep (const unsigned int sec)
 }
 
 
-/** Suspend the current thread for given number of microseconds
+/** High-resolution thread timeout handler
  *
- * Suspend the currently executing thread for the given
- * number of microseconds.
+ * Wake up the thread that called thread_usleep() or
+ * thread_nanosleep().
  *
- * @param usec Number of microseconds to suspend the thread.
+ */
+static void thread_hrtimeout_handler (struct hrtimer *timer, void *data)
+{
+	thread_wakeup ((thread_t) data);
+}
+
+
+/** Suspend the current thread for given number of cycles
+ *
+ * The thread is woken up by a high-resolution timer, which
+ * expires at the exact cycle rather than at the next jiffy.
  *
- * @return Number of microseconds the thread was actually suspended.
+ * @param cycles Number of cycles to suspend the thread.
+ *
+ * @return Number of cycles remaining to the timer expiration.
  *
  */
-unsigned int thread_usleep (const unsigned int usec)
+static uint64_t thread_hrsleep (const uint64_t cycles)
 {
-	unsigned int timeout = usec_to_jiffies (usec);
-	
 	ipl_t state = query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	current->state = THREAD_SLEEPING;
 	
 	sched_remove (current);
 	
 	/*
-	 * Setup up a timer to wake us up. The timer will be deleted from
-	 * the list of timers when it expires and fires the handler.
+	 * Setup up a timer to wake us up. The timer will be removed from
+	 * the tree of timers when it expires and fires the handler.
 	 */
-	timer_init_jiffies (&current->timer, timeout, thread_timeout_handler,
-	    current);
-	timer_start (&current->timer);
+	uint64_t expires = cycles_get () + cycles;
+	hrtimer_init (&current->hrtimer, thread_hrtimeout_handler, current);
+	hrtimer_start (&current->hrtimer, expires);
 	
 	schedule ();
 	
 	/*
 	 * After wakeup, determine the time remaining to timer expiration.
 	 */
-	unsigned int remains = current->timer.expires - jiffies;
+	uint64_t now = cycles_get ();
+	uint64_t remains = (expires > now) ? expires - now : 0;
 	
 	/*
-	 * Destroy the timer. Waits for completion of the timer handler.
+	 * Cancel the timer. Waits for completion of the timer handler.
 	 */
-	timer_destroy (&current->timer);
+	hrtimer_cancel (&current->hrtimer);
 	
 	conditionally_enable_interrupts (state);
-	return jiffies_to_usec (remains);
+	return remains;
+}
+
+
+/** Suspend the current thread for given number of microseconds
+ *
+ * Suspend the currently executing thread for the given
+ * number of microseconds.
+ *
+ * @param usec Number of microseconds to suspend the thread.
+ *
+ * @return Number of microseconds remaining to the timer expiration.
+ *
+ */
+unsigned int thread_usleep (const unsigned int usec)
+{
+	return cycles_to_usec (thread_hrsleep (usec_to_cycles (usec)));
+}
+
+
+/** Suspend the current thread for given number of nanoseconds
+ *
+ * Suspend the currently executing thread for the given
+ * number of nanoseconds, rounded up to whole cycles.
+ *
+ * @param nsec Number of nanoseconds to suspend the thread.
+ *
+ * @return Number of nanoseconds remaining to the timer expiration.
+ *
+ */
+unsigned int thread_nanosleep (const unsigned int nsec)
+{
+	return cycles_to_nsec (thread_hrsleep (nsec_to_cycles (nsec)));
 }
 
 
 /** Verify that a thread can be joined
  *
  * Verify that the current thread can call join on a given thread.
- * Must be called with interrupts disabled so that the thread flags
- * and joiner attributes do not change.
+ * Must be called with interrupts disabled and the join lock of the
+ * thread held so that the joiner attribute does not change.
  *
- * @param thread Thread to check.
+ * @param thread  Thread to check.
+ * @param current The current thread.
  *
  */
-static bool thread_can_join (struct thread *thread)
+static bool thread_can_join (struct thread *thread, thread_t current)
 {
-	ipl_t state = query_and_disable_interrupts ();
-	thread_t current = current_thread[cpuid()];
-	conditionally_enable_interrupts (state);
-	
 	/*
 	 * Verify that the thread can be joined, which means that it
 	 * is not the current thread and it is not being already joined
@@ -371,7 +511,7 @@ void thread_set_process (struct process *process, struct uthread *uthread)
 {
 	ipl_t state = query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	current->process = process;
 	current->uthread = uthread;
 	
@@ -390,7 +530,7 @@ struct process *thread_get_process (void)
 {
 	ipl_t state = query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	struct process *process = current->process;
 	
 	conditionally_enable_interrupts (state);
@@ -410,7 +550,7 @@ struct uthread *thread_get_uthread (void)
 {
 	ipl_t state = query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	struct uthread *uthread = current->uthread;
 	
 	conditionally_enable_interrupts (state);
@@ -432,7 +572,9 @@ void thread_finish (void *retval)
 {
 	query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
+	
+	spinlock_lock (&current->join_lock);
 	
 	current->state = THREAD_ZOMBIE;
 	
@@ -441,15 +583,11 @@ void thread_finish (void *retval)
 	/* Store the return value */
 	current->retval = retval;
 	
-	/*
-	 * If there is a thread calling join on the exitting thread, wake
-	 * it up and let it know to clean up the mess.
-	 */
-	if (current->joiner != NULL)
-		thread_wakeup (current->joiner);
+	spinlock_unlock (&current->join_lock);
 	
 	/*
-	 * Give up the processor now.
+	 * Give up the processor now. The joining thread is woken
+	 * up only once we are off our stack, see thread_mark_dead().
 	 */
 	schedule ();
 	
@@ -458,6 +596,31 @@ void thread_finish (void *retval)
 }
 
 
+/** Mark a zombie thread dead
+ *
+ * Called by the scheduler once the context switch away from
+ * the finished thread has completed, so that the stack of the
+ * thread is no longer in use. Wake up any joining thread and
+ * let it know to clean up the mess.
+ *
+ * Must be called with interrupts disabled.
+ *
+ * @param thread Zombie thread which has been switched out.
+ *
+ */
+void thread_mark_dead (thread_t thread)
+{
+	spinlock_lock (&thread->join_lock);
+	
+	thread->state = THREAD_DEAD;
+	if (thread->joiner != NULL)
+		thread_wakeup (thread->joiner);
+	
+	/* The joiner may release the thread as soon as we unlock. */
+	spinlock_unlock (&thread->join_lock);
+}
+
+
 /** Clean up thread
  *
  * Clean up and release the thread control structure.
@@ -495,23 +658,37 @@ static void thread_destroy (thread_t thread)
 int thread_join (thread_t thread, void **thread_retval)
 {
 	ipl_t status = query_and_disable_interrupts ();
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
+	
+	spinlock_lock (&thread->join_lock);
 	
 	/*
 	 * Verify thread identity and that it can be joined.
 	 */
-	 if (!thread_can_join (thread))
+	if (!thread_can_join (thread, current)) {
+		spinlock_unlock (&thread->join_lock);
 		goto invalid;
+	}
+	
+	thread->joiner = current;
 	
 	/*
-	 * If the thread is not a zombie, wait for it to become one.
-	 * The only thing that can wake us up is the thread exitting.
+	 * If the thread is not dead, wait for it to become so. The
+	 * state is changed under the join lock before the lock is
+	 * dropped so that the wakeup from thread_mark_dead() cannot
+	 * come before we are sleeping.
 	 */
-	if (thread->state != THREAD_ZOMBIE) {
-		thread->joiner = current;
-		thread_suspend ();
+	while (thread->state != THREAD_DEAD) {
+		current->state = THREAD_SLEEPING;
+		sched_remove (current);
+		
+		spinlock_unlock (&thread->join_lock);
+		schedule ();
+		spinlock_lock (&thread->join_lock);
 	}
 	
+	spinlock_unlock (&thread->join_lock);
+	
 	if (thread_retval != NULL)
 		(* thread_retval) = thread->retval;
 	
@@ -548,12 +725,12 @@ void thread_switch (thread_t thread)
 	
 	ipl_t state = query_and_disable_interrupts ();
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = this_cpu (current_thread);
 	
 	if ((current != NULL) && (current->state == THREAD_RUNNING))
 		current->state = THREAD_READY;
 	
-	current_thread[cpuid()] = thread;
+	this_cpu (current_thread) = thread;
 	thread->state = THREAD_RUNNING;
 	
 	/*
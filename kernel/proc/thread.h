@@ -20,9 +20,12 @@
 #include <include/c.h>
 
 #include <adt/list.h>
+#include <synch/spinlock.h>
 #include <synch/sem.h>
 #include <time/timer.h>
+#include <time/hrtimer.h>
 #include <mm/vmm.h>
+#include <mm/percpu.h>
 
 
 /** Thread stack size
@@ -35,16 +38,63 @@
 #define THREAD_STACK_SIZE  4096
 
 
+/** Thread sleep slack
+ *
+ * A thread sleeping for a number of seconds tolerates a wake up
+ * delayed by the sleep time shifted right by the given number of
+ * bits, which lets the timers of the sleeping threads expire
+ * in batches.
+ *
+ */
+#define THREAD_SLEEP_SLACK_SHIFT  8
+
+
+/** Thread priorities
+ *
+ * A ready thread with a higher priority always runs before a thread
+ * with a lower priority, threads with the same priority share the
+ * processor in a round-robin fashion. A thread inherits the priority
+ * of its creator.
+ *
+ */
+#define THREAD_PRIORITY_MIN      0
+#define THREAD_PRIORITY_DEFAULT  16
+#define THREAD_PRIORITY_MAX      31
+
+
+/** Offset of the wait queue link in the thread structure
+ *
+ * The precompiled drivers/kbd.obj links the threads waiting for
+ * a key through the wait queue link at this offset, the space of
+ * the baseline timer is therefore kept reserved in front of it.
+ *
+ */
+#define THREAD_WAIT_QUEUE_LINK_OFFSET  72
+#define THREAD_RESERVED_SIZE           28
+
+
 /** Thread creation flags.
  *
  */
 typedef enum {
 	TF_NONE = 0,
-	TF_NEW_VMM = (1 << 0)
+	TF_NEW_VMM = (1 << 0),
+	TF_IDLE = (1 << 1)
 } thread_flags_t;
 
 
+/** Set of CPUs, one bit per CPU */
+typedef uint32_t cpumask_t;
+
+/** Set of all CPUs */
+#define CPUMASK_ALL  ((cpumask_t) 0xffffffff)
+
+/** Set containing a single CPU */
+#define CPUMASK_CPU(cpu)  (((cpumask_t) 1) << (cpu))
+
+
 /** Forward declarations */
+struct mutex;
 struct process;
 struct uthread;
 
@@ -60,7 +110,8 @@ typedef enum {
 	THREAD_READY,     /**< thread is ready to run, waiting in a queue */
 	THREAD_RUNNING,   /**< thread is currently running */
 	THREAD_SLEEPING,  /**< thread is sleeping, moved to sleep list */
-	THREAD_ZOMBIE     /**< thread has finished, waiting for reaping */
+	THREAD_ZOMBIE,    /**< thread has finished, still switching out */
+	THREAD_DEAD       /**< thread has switched out, waiting for reaping */
 } thread_state_t;
 
 
@@ -73,6 +124,11 @@ typedef enum {
  *
  */
 typedef struct thread {
+	/*
+	 * The members up to uthread keep the layout the precompiled
+	 * objects were built with, new members go after them.
+	 */
+	
 	/** A thread can be an item on a list */
 	link_t link;
 	
@@ -103,8 +159,8 @@ typedef struct thread {
 	/** Other thread sleeping in join */
 	struct thread *joiner;
 	
-	/** Timer for thread sleep */
-	struct timer timer;
+	/** Space of the timer, which has grown and moved below */
+	uint8_t reserved[THREAD_RESERVED_SIZE];
 	
 	/** Wait queue link */
 	link_t wait_queue_link;
@@ -117,11 +173,38 @@ typedef struct thread {
 	
 	/** User space thread */
 	struct uthread *uthread;
+	
+	/** Timer for thread sleep */
+	struct timer timer;
+	
+	/** High-resolution timer for short thread sleep */
+	struct hrtimer hrtimer;
+	
+	/** Lock protecting the joiner and the thread exit */
+	spinlock_t join_lock;
+	
+	/** CPU whose run queue the thread belongs to */
+	unsigned int cpu;
+	
+	/** CPUs the thread is allowed to run on */
+	cpumask_t affinity;
+	
+	/** Priority set for the thread */
+	unsigned int base_priority;
+	
+	/** Effective priority, possibly inherited from mutex waiters */
+	unsigned int priority;
+	
+	/** Mutex the thread is waiting for */
+	struct mutex *blocked_on;
+	
+	/** Owned mutexes which have waiting threads */
+	list_t held_mutexes;
 } *thread_t;
 
 
-/** Currently running threads on each CPU */
-extern thread_t current_thread[MAX_CPU];
+/** Currently running thread on each CPU */
+DECLARE_PER_CPU (thread_t, current_thread);
 
 
 /* Externals are commented with implementation */
@@ -131,6 +214,7 @@ extern int thread_create (thread_t *threadp, thread_fn entry, void *data,
 extern thread_t thread_get_current (void);
 extern unsigned int thread_sleep (const unsigned int sec);
 extern unsigned int thread_usleep (const unsigned int usec);
+extern unsigned int thread_nanosleep (const unsigned int nsec);
 extern void thread_yield (void);
 extern void thread_suspend (void);
 extern void thread_set_process (struct process *process,
@@ -138,7 +222,11 @@ extern void thread_set_process (struct process *process,
 extern struct process *thread_get_process (void);
 extern struct uthread *thread_get_uthread (void);
 extern void thread_finish (void *retval) __attribute__((noreturn));
+extern void thread_mark_dead (thread_t thread);
 extern int thread_wakeup (thread_t thread);
+extern int thread_set_affinity (thread_t thread, const cpumask_t affinity);
+extern int thread_set_priority (thread_t thread, const unsigned int priority);
+extern unsigned int thread_get_priority (thread_t thread);
 extern int thread_join (thread_t thread, void **thread_retval);
 extern void thread_switch (thread_t thread);
 
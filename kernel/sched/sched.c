@@ -1,7 +1,27 @@
 /**
  * @file sched.c
  *
- * Round-robin kernel thread scheduler.
+ * Priority round-robin kernel thread scheduler.
+ *
+ * Each CPU runs the ready thread with the highest priority from its
+ * run queue, threads with the same priority take turns. A thread which
+ * becomes ready with a priority higher than the running thread preempts
+ * it right away.
+ *
+ * Each CPU schedules the threads from its own run queue. Threads are
+ * migrated between the run queues by load balancing, which is done
+ * periodically from the scheduler timer and whenever a CPU is about
+ * to run out of work. Woken up threads are placed on the CPU they
+ * have last been running on, unless that CPU is significantly busier
+ * than the others. Threads never leave the set of CPUs given
+ * by their affinity.
+ *
+ * The scheduler timer does not tick periodically. Each CPU programs
+ * its timer for the end of the quantum of its current thread or for
+ * the expiration of its nearest high-resolution or kernel timer. An idle
+ * CPU thus only takes interrupts when there is something to do. The
+ * kernel time in jiffies and cycles is derived from the CP0 Count
+ * register.
  *
  * Kalisto
  *
@@ -17,34 +37,144 @@
 
 #include <adt/list.h>
 #include <proc/thread.h>
+#include <synch/spinlock.h>
+#include <synch/rcu.h>
 #include <drivers/dorder.h>
+#include <mm/percpu.h>
 #include <drivers/timer.h>
+#include <time/time.h>
 #include <time/timer.h>
+#include <time/hrtimer.h>
 
 #include <sched/sched.h>
 
-/** Synchronize the startup of CPUs */
-ATOMIC_DECLARE(cpu_ready, 0);
-
-/** Kernel jiffies */
-volatile unsigned int jiffies = 0;
+/** Value of the CP0 Count register at jiffy zero */
+static unative_t boot_ticks;
 
 /** Number of ticks a thread is allowed to run */
 #define THREAD_QUANTUM  4000
 
-/** List of schedulable threads for each CPU */
-static list_t runnable_list[MAX_CPU];
+/** Shortest delay of the scheduler timer interrupt in ticks
+    (so that the Compare register is never set in the past) */
+#define SCHED_MIN_DELAY  100
+
+/** Longest delay of the scheduler timer interrupt in ticks
+    (so that the wrap-around of the Count register is noticed) */
+#define SCHED_MAX_DELAY  (1 << 30)
+
+/** Number of scheduler timer interrupts between periodic load balancing */
+#define SCHED_BALANCE_INTERVAL  4
+
+/** Number of threads by which the last CPU of a woken up thread
+    may be busier than the least loaded CPU and still be chosen */
+#define SCHED_WAKE_IMBALANCE  1
+
+
+/** Run queue of a single CPU
+ *
+ */
+struct runqueue {
+	/** Lock protecting the run queue */
+	spinlock_t lock;
+	
+	/** List of schedulable threads (including the running one) */
+	list_t list;
+	
+	/** Number of threads on the list */
+	unsigned int nr_running;
+	
+	/** Idle thread of the CPU (never on the list) */
+	thread_t idle;
+	
+	/** Scheduler timer interrupts remaining until load balancing */
+	unsigned int balance_ticks;
+	
+	/** Outgoing thread to migrate once its context is saved */
+	thread_t migrating;
+	
+	/** Outgoing finished thread to mark dead once its context is saved */
+	thread_t zombie;
+	
+	/** The idle thread is waiting for an interrupt */
+	bool waiting;
+	
+	/** Timestamp when the idle thread was scheduled */
+	unative_t idle_since;
+	
+	/** Cycles spent in the idle thread */
+	uint64_t idle_cycles;
+	
+	/** Cycles spent waiting for an interrupt */
+	uint64_t wait_cycles;
+	
+	/** Number of passes through the idle loop */
+	unsigned int idle_loops;
+	
+	/** Value of the Count register at the last update of the clock */
+	unative_t clock_count;
+	
+	/** Cycles since jiffy zero at the last update of the clock */
+	uint64_t clock_cycles;
+	
+	/** Jiffies at the last update of the clock */
+	unsigned int clock_jiffies;
+	
+	/** Value of the Count register at the beginning of clock_jiffies */
+	unative_t clock_ticks;
+	
+	/** The CPU has been initialized and takes part in load balancing */
+	bool online;
+};
+
+
+/** Run queue of each CPU */
+static DEFINE_PER_CPU (struct runqueue, runqueue);
 
 
 /** Scheduler initialization
  *
- * Initializes the scheduler structures and configures the scheduler interrupt.
+ * Initializes the scheduler structures of the current CPU
+ * and configures the scheduler interrupt.
  *
  */
 void scheduler_init (void)
 {
-	/* Initialize the list of schedulable threads. */
-	list_init (&runnable_list[cpuid()]);
+	struct runqueue *rq = &this_cpu (runqueue);
+	
+	/*
+	 * The Count registers of all CPUs run in lock step, the
+	 * bootstrap processor thus defines the jiffy zero for all.
+	 */
+	if (cpuid () == 0)
+		boot_ticks = timer_get ();
+	
+	/* Initialize the run queue of the current CPU. */
+	spinlock_init (&rq->lock);
+	list_init (&rq->list);
+	rq->nr_running = 0;
+	rq->idle = NULL;
+	rq->balance_ticks = SCHED_BALANCE_INTERVAL;
+	rq->migrating = NULL;
+	rq->zombie = NULL;
+	rq->waiting = false;
+	rq->idle_since = 0;
+	rq->idle_cycles = 0;
+	rq->wait_cycles = 0;
+	rq->idle_loops = 0;
+	rq->clock_count = boot_ticks;
+	rq->clock_cycles = 0;
+	rq->clock_jiffies = 0;
+	rq->clock_ticks = boot_ticks;
+	
+	/*
+	 * The other CPUs may start using the run queue as soon
+	 * as the CPU is online, which can happen while they are
+	 * still initializing themselves.
+	 */
+	memory_barrier ();
+	rq->online = true;
+	
+	rcu_cpu_online (cpuid ());
 	
 	/*
 	 * Configure the scheduler interrupt. A cleaner way would be
@@ -54,58 +184,678 @@ void scheduler_init (void)
 }
 
 
+/** Update the clock of a CPU
+ *
+ * Moves the clock forward by the cycles and the whole jiffies
+ * elapsed since the last update. The clock has to be updated
+ * at least once per wrap-around of the Count register, which
+ * SCHED_MAX_DELAY guarantees.
+ *
+ * Must be called with disabled interrupts on the CPU
+ * owning the run queue.
+ *
+ * @param rq Run queue of the current CPU.
+ *
+ */
+static void sched_clock_update (struct runqueue *rq)
+{
+	unative_t now = timer_get ();
+	
+	rq->clock_cycles += now - rq->clock_count;
+	rq->clock_count = now;
+	
+	unative_t elapsed = (now - rq->clock_ticks) / JIFFY_CYCLES;
+	
+	rq->clock_jiffies += elapsed;
+	rq->clock_ticks += elapsed * JIFFY_CYCLES;
+}
+
+
+/** Get the kernel time
+ *
+ * @return Number of jiffies since the boot.
+ *
+ */
+unsigned int jiffies_get (void)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	struct runqueue *rq = &this_cpu (runqueue);
+	sched_clock_update (rq);
+	unsigned int jiffies = rq->clock_jiffies;
+	
+	conditionally_enable_interrupts (state);
+	return jiffies;
+}
+
+
+/** Get the precise kernel time
+ *
+ * The cycle counters of the CPUs run in lock step, the time
+ * can therefore be compared across CPUs.
+ *
+ * @return Number of cycles since the boot.
+ *
+ */
+uint64_t cycles_get (void)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	struct runqueue *rq = &this_cpu (runqueue);
+	sched_clock_update (rq);
+	uint64_t cycles = rq->clock_cycles;
+	
+	conditionally_enable_interrupts (state);
+	return cycles;
+}
+
+
+/** Program the scheduler timer of the current CPU
+ *
+ * The timer interrupt is requested at the end of the quantum
+ * of the given thread, unless it is the idle thread, which
+ * has no quantum, or when the nearest high-resolution timer
+ * or kernel timer of the CPU expires, whichever comes first.
+ *
+ * Must be called with disabled interrupts.
+ *
+ * @param rq     Run queue of the current CPU.
+ * @param cpu    Current CPU.
+ * @param thread Thread which is going to run on the CPU.
+ *
+ */
+static void sched_program_timer (struct runqueue *rq, unsigned int cpu,
+    thread_t thread)
+{
+	sched_clock_update (rq);
+	
+	unative_t now = rq->clock_count;
+	unative_t delay = SCHED_MAX_DELAY;
+	
+	if ((thread != NULL) && (thread != rq->idle)) {
+		unative_t used = now - thread->scheduled;
+		delay = (used < THREAD_QUANTUM) ? THREAD_QUANTUM - used : 0;
+	}
+	
+	uint64_t deadline;
+	if (hrtimers_next_expiry (&deadline)) {
+		if (deadline <= rq->clock_cycles)
+			delay = 0;
+		else if (deadline - rq->clock_cycles < delay)
+			delay = deadline - rq->clock_cycles;
+	}
+	
+	unsigned int expires;
+	if (timers_next_expiry (&expires)) {
+		/* A timer is run once the jiffies exceed its expiration. */
+		native_t jiffies = (native_t) (expires + 1 - rq->clock_jiffies);
+		unative_t timer_delay = 0;
+		
+		if (jiffies > SCHED_MAX_DELAY / JIFFY_CYCLES)
+			timer_delay = SCHED_MAX_DELAY;
+		else if (jiffies > 0)
+			timer_delay = rq->clock_ticks +
+			    ((unative_t) jiffies) * JIFFY_CYCLES - now;
+		
+		if (timer_delay < delay)
+			delay = timer_delay;
+	}
+	
+	if (delay < SCHED_MIN_DELAY)
+		delay = SCHED_MIN_DELAY;
+	
+	write_cp0_compare (now + delay);
+}
+
+
+/** Lock the run queue a thread belongs to
+ *
+ * The thread can be migrated to another run queue until the lock
+ * of its current run queue is acquired, hence the retry.
+ *
+ * Must be called with disabled interrupts.
+ *
+ * @param thread Thread whose run queue to lock.
+ *
+ * @return The locked run queue.
+ *
+ */
+static struct runqueue *runqueue_lock_thread (thread_t thread)
+{
+	while (true) {
+		struct runqueue *rq = &per_cpu (runqueue, thread->cpu);
+		spinlock_lock (&rq->lock);
+		
+		if (rq == &per_cpu (runqueue, thread->cpu))
+			return rq;
+		
+		spinlock_unlock (&rq->lock);
+	}
+}
+
+
+/** Check whether a thread may run on a CPU
+ *
+ * @param thread Thread to check.
+ * @param cpu    CPU to check.
+ *
+ * @return True if the CPU is online and in the thread affinity.
+ *
+ */
+static inline bool sched_cpu_allowed (thread_t thread, unsigned int cpu)
+{
+	return ((per_cpu (runqueue, cpu).online) &&
+	    ((thread->affinity & CPUMASK_CPU (cpu)) != 0));
+}
+
+
+/** Select a CPU for a thread which is becoming ready
+ *
+ * The last CPU of the thread is preferred because the thread data
+ * might still be in its cache. Another CPU is only chosen when the
+ * last CPU is not allowed or when it is busier than the least loaded
+ * allowed CPU by more than SCHED_WAKE_IMBALANCE threads. Among the
+ * least loaded CPUs, the local CPU is preferred because it is the
+ * one which has just touched the data the thread was waiting for.
+ *
+ * The load figures are read without locking, the result
+ * is therefore only a hint.
+ *
+ * @param thread Thread to place.
+ * @param cpu    Local CPU.
+ *
+ * @return The selected CPU.
+ *
+ */
+static unsigned int sched_select_cpu (thread_t thread, unsigned int cpu)
+{
+	unsigned int prev = thread->cpu;
+	unsigned int best = MAX_CPU;
+	unsigned int min_running = 0;
+	
+	if (sched_cpu_allowed (thread, cpu)) {
+		best = cpu;
+		min_running = per_cpu (runqueue, cpu).nr_running;
+	}
+	
+	for (unsigned int i = 0; i < MAX_CPU; i++) {
+		if ((i == cpu) || (!sched_cpu_allowed (thread, i)))
+			continue;
+		
+		if ((best == MAX_CPU) ||
+		    (per_cpu (runqueue, i).nr_running < min_running)) {
+			min_running = per_cpu (runqueue, i).nr_running;
+			best = i;
+		}
+	}
+	
+	/* The affinity always contains at least one online CPU. */
+	assert (best != MAX_CPU);
+	
+	if ((sched_cpu_allowed (thread, prev)) &&
+	    (per_cpu (runqueue, prev).nr_running <=
+	    min_running + SCHED_WAKE_IMBALANCE))
+		return prev;
+	
+	return best;
+}
+
+
+/** Wake up an idle CPU to take over some work
+ *
+ * Idle CPUs do not take timer interrupts and thus do not balance
+ * the load periodically. A CPU with more than one thread in its
+ * run queue therefore wakes up an idle CPU, which then steals
+ * some work while looking for a thread to schedule.
+ *
+ * @param cpu The busy CPU.
+ *
+ */
+static void sched_kick_idle (unsigned int cpu)
+{
+	for (unsigned int i = 0; i < MAX_CPU; i++) {
+		if ((i != cpu) && (per_cpu (runqueue, i).online) &&
+		    (per_cpu (runqueue, i).waiting)) {
+			dorder_send (i, DORDER_MSG_RESCHEDULE);
+			return;
+		}
+	}
+}
+
+
+/** Check whether a thread in a run queue should preempt a thread
+ *
+ * Must be called with the run queue locked.
+ *
+ * @param rq     Run queue to check.
+ * @param thread Thread currently running on the CPU of the run queue.
+ *
+ * @return True if the run queue holds a thread with a higher priority.
+ *
+ */
+static bool runqueue_preempts (struct runqueue *rq, thread_t thread)
+{
+	if ((thread == NULL) || (thread == rq->idle))
+		return (rq->nr_running > 0);
+	
+	list_foreach (rq->list, struct thread, link, other) {
+		if (other->priority > thread->priority)
+			return true;
+	}
+	
+	return false;
+}
+
+
+/** Take the next thread to run from a run queue
+ *
+ * The first thread with the highest priority is taken and moved
+ * to the end of the queue, which makes the threads with the same
+ * priority take turns.
+ *
+ * Must be called with the run queue locked.
+ *
+ * @param rq Run queue to take the thread from.
+ *
+ * @return The link of the thread or NULL if the queue is empty.
+ *
+ */
+static link_t *runqueue_pick (struct runqueue *rq)
+{
+	thread_t best = NULL;
+	
+	list_foreach (rq->list, struct thread, link, thread) {
+		if ((best == NULL) || (thread->priority > best->priority))
+			best = thread;
+	}
+	
+	if (best == NULL)
+		return NULL;
+	
+	list_remove (&best->link);
+	list_append (&rq->list, &best->link);
+	
+	return &best->link;
+}
+
+
+/** Make a CPU reschedule shortly
+ *
+ * A remote CPU is sent a reschedule message, the current CPU
+ * has its timer interrupt requested right away.
+ *
+ * @param cpu The CPU to reschedule.
+ *
+ */
+static void sched_resched (unsigned int cpu)
+{
+	if (cpu == cpuid ())
+		timer_setup (SCHED_MIN_DELAY);
+	else
+		dorder_send (cpu, DORDER_MSG_RESCHEDULE);
+}
+
+
+/** Notify a CPU about new work in its run queue
+ *
+ * A busy CPU picks the new thread when its current thread quantum
+ * expires, unless the new thread has a higher priority than the
+ * running thread. An idle CPU is sent a reschedule message so that
+ * the new thread does not have to wait for the next timer interrupt.
+ *
+ * @param cpu    The CPU whose run queue has been extended.
+ * @param thread The new thread.
+ *
+ */
+static void sched_kick (unsigned int cpu, thread_t thread)
+{
+	thread_t current = per_cpu (current_thread, cpu);
+	
+	if (current == per_cpu (runqueue, cpu).idle) {
+		if (cpu != cpuid ())
+			dorder_send (cpu, DORDER_MSG_RESCHEDULE);
+	} else if ((current != NULL) && (thread->priority > current->priority))
+		sched_resched (cpu);
+}
+
+
+/** Put a ready thread on the run queue of a CPU
+ *
+ * The thread must not be on any run queue. The thread is
+ * placed on the CPU chosen by sched_select_cpu().
+ *
+ * Must be called with disabled interrupts.
+ *
+ * @param thread Thread to place.
+ *
+ */
+static void sched_place (thread_t thread)
+{
+	unsigned int cpu = cpuid ();
+	
+	struct runqueue *rq = runqueue_lock_thread (thread);
+	unsigned int target = sched_select_cpu (thread, cpu);
+	
+	if (target != thread->cpu) {
+		thread->cpu = target;
+		spinlock_unlock (&rq->lock);
+		rq = runqueue_lock_thread (thread);
+	}
+	
+	list_append (&rq->list, &thread->link);
+	rq->nr_running++;
+	spinlock_unlock (&rq->lock);
+	
+	sched_kick (target, thread);
+}
+
+
+/** Register the idle thread of the current CPU
+ *
+ * The idle thread is not kept in the run queue, it is only
+ * scheduled when the CPU has nothing else to run.
+ *
+ * @param thread The idle thread.
+ *
+ */
+void sched_set_idle (thread_t thread)
+{
+	ipl_t state = query_and_disable_interrupts ();
+	
+	this_cpu (runqueue).idle = thread;
+	thread->cpu = cpuid ();
+	
+	conditionally_enable_interrupts (state);
+}
+
+
 /** Include thread in scheduling
  *
- * The thread is appended to the list of schedulable threads.
+ * The thread is appended to the run queue of the CPU
+ * it has last been running on.
  *
  */
 void sched_insert (thread_t thread)
 {
 	/* Disable interrupts while accessing shared structures. */
 	ipl_t state = query_and_disable_interrupts ();
-	list_append (&runnable_list[cpuid()], &thread->link);
+	
+	struct runqueue *rq = runqueue_lock_thread (thread);
+	list_append (&rq->list, &thread->link);
+	rq->nr_running++;
+	spinlock_unlock (&rq->lock);
+	
 	conditionally_enable_interrupts (state);
 }
 
 /** Exclude thread from scheduling
  *
- * The thread is removed from the list of schedulable threads.
+ * The thread is removed from its run queue.
  *
  */
 void sched_remove (thread_t thread)
 {
 	/* Disable interrupts while accessing shared structures. */
 	ipl_t state = query_and_disable_interrupts ();
-	list_remove (&thread->link);
+	
+	struct runqueue *rq = runqueue_lock_thread (thread);
+	if (link_connected (&thread->link)) {
+		list_remove (&thread->link);
+		rq->nr_running--;
+	}
+	spinlock_unlock (&rq->lock);
+	
 	conditionally_enable_interrupts (state);
 }
 
 
-/** Periodic scheduler timer handler
+/** Move threads between two locked run queues
+ *
+ * Only threads which are ready and allowed to run on the destination
+ * CPU are moved. The thread currently running on the source CPU stays
+ * where it is, even if it has already been woken up again before
+ * giving up the processor. The threads are
+ * taken from the head of the source queue, that is those which
+ * have been waiting for the processor for the longest time and
+ * are thus least likely to have their data in the source CPU cache.
+ *
+ * Must be called with disabled interrupts and both run queues locked.
+ *
+ * @param dst     Destination run queue.
+ * @param dst_cpu Destination CPU.
+ * @param src     Source run queue.
+ * @param count   Maximal number of threads to move.
+ *
+ * @return Number of threads moved.
+ *
+ */
+static unsigned int runqueue_pull (struct runqueue *dst, unsigned int dst_cpu,
+    struct runqueue *src, unsigned int count)
+{
+	unsigned int moved = 0;
+	link_t *link = src->list.head.next;
+	
+	while ((moved < count) && (link != &src->list.head)) {
+		thread_t thread = list_item (link, struct thread, link);
+		link = link->next;
+		
+		if ((thread->state != THREAD_READY) ||
+		    (thread == per_cpu (current_thread, thread->cpu)) ||
+		    ((thread->affinity & CPUMASK_CPU (dst_cpu)) == 0))
+			continue;
+		
+		list_remove (&thread->link);
+		src->nr_running--;
+		
+		thread->cpu = dst_cpu;
+		list_append (&dst->list, &thread->link);
+		dst->nr_running++;
+		
+		moved++;
+	}
+	
+	return moved;
+}
+
+
+/** Find the busiest CPU
+ *
+ * The load figures are read without locking, the result
+ * is therefore only a hint.
+ *
+ * @param cpu The CPU looking for work (excluded from the search).
+ *
+ * @return The online CPU with the most threads in its run queue.
+ * @return MAX_CPU if there is no other online CPU.
+ *
+ */
+static unsigned int sched_find_busiest (unsigned int cpu)
+{
+	unsigned int busiest = MAX_CPU;
+	unsigned int max_running = 0;
+	
+	for (unsigned int i = 0; i < MAX_CPU; i++) {
+		if ((i == cpu) || (!per_cpu (runqueue, i).online))
+			continue;
+		
+		if (per_cpu (runqueue, i).nr_running > max_running) {
+			max_running = per_cpu (runqueue, i).nr_running;
+			busiest = i;
+		}
+	}
+	
+	return busiest;
+}
+
+
+/** Steal a thread for a CPU which has run out of work
+ *
+ * Called from schedule() with the local run queue locked. The run queue
+ * of the busiest CPU is only try-locked, which avoids deadlocking with
+ * a CPU that might be doing the same in the opposite direction.
+ *
+ * @param rq  Local run queue (locked).
+ * @param cpu Local CPU.
+ *
+ * @return True if a thread has been stolen.
+ *
+ */
+static bool sched_steal (struct runqueue *rq, unsigned int cpu)
+{
+	unsigned int busiest = sched_find_busiest (cpu);
+	if (busiest == MAX_CPU)
+		return false;
+	
+	/* A single thread is most likely just running there. */
+	struct runqueue *src = &per_cpu (runqueue, busiest);
+	if (src->nr_running < 2)
+		return false;
+	
+	if (!spinlock_trylock (&src->lock))
+		return false;
+	
+	unsigned int moved = runqueue_pull (rq, cpu, src, 1);
+	spinlock_unlock (&src->lock);
+	
+	return (moved > 0);
+}
+
+
+/** Periodic load balancing
+ *
+ * Pull threads from the busiest CPU until the load of both CPUs
+ * is about the same. The two run queues are always locked in
+ * the order of CPU numbers to avoid deadlocks.
+ *
+ * Must be called with disabled interrupts.
+ *
+ * @param cpu The CPU to balance.
+ *
+ */
+static void sched_balance (unsigned int cpu)
+{
+	unsigned int busiest = sched_find_busiest (cpu);
+	if (busiest == MAX_CPU)
+		return;
+	
+	struct runqueue *rq = &per_cpu (runqueue, cpu);
+	struct runqueue *src = &per_cpu (runqueue, busiest);
+	
+	if (src->nr_running < rq->nr_running + 2)
+		return;
+	
+	if (cpu < busiest) {
+		spinlock_lock (&rq->lock);
+		spinlock_lock (&src->lock);
+	} else {
+		spinlock_lock (&src->lock);
+		spinlock_lock (&rq->lock);
+	}
+	
+	/* Re-check the imbalance now that the figures are stable. */
+	if (src->nr_running >= rq->nr_running + 2)
+		runqueue_pull (rq, cpu, src,
+		    (src->nr_running - rq->nr_running) / 2);
+	
+	spinlock_unlock (&src->lock);
+	spinlock_unlock (&rq->lock);
+}
+
+
+/** Scheduler timer handler
  *
  * The function is called from an interrupt handler.
  *
  */
 void sched_timer (void)
 {
-	jiffies++;
+	unsigned int cpu = cpuid ();
+	struct runqueue *rq = &per_cpu (runqueue, cpu);
+	
+	/* Each CPU runs the timers started on it. */
+	sched_clock_update (rq);
+	hrtimers_run ();
 	timers_run ();
-	timer_setup (THREAD_QUANTUM);
+	
+	rq->balance_ticks--;
+	if (rq->balance_ticks == 0) {
+		rq->balance_ticks = SCHED_BALANCE_INTERVAL;
+		sched_balance (cpu);
+		
+		if (rq->nr_running > 1)
+			sched_kick_idle (cpu);
+	}
 	
 	/*
 	 * Reschedule if the current thread has been running
-	 * for longer than the thread quantum.
+	 * for longer than the thread quantum or if a thread
+	 * with a higher priority is ready, which includes
+	 * the balancing bringing work to an idle CPU.
+	 * An idle thread waiting for an interrupt reschedules
+	 * by itself once the interrupt is handled.
 	 */
 	
-	thread_t current = current_thread[cpuid()];
+	thread_t current = per_cpu (current_thread, cpu);
 	unative_t timestamp = timer_get ();
 	
-	if (timestamp - current->scheduled >= THREAD_QUANTUM)
+	/* Writing the Compare register acknowledges the interrupt. */
+	sched_program_timer (rq, cpu, current);
+	
+	if (rq->waiting)
+		return;
+	
+	spinlock_lock (&rq->lock);
+	bool preempt = runqueue_preempts (rq, current);
+	spinlock_unlock (&rq->lock);
+	
+	if ((timestamp - current->scheduled >= THREAD_QUANTUM) || (preempt))
 		schedule ();
 }
 
 
+/** Finish a context switch
+ *
+ * The run queue lock is held across the context switch in schedule()
+ * so that no other CPU can pick the outgoing thread before its context
+ * is saved. The lock is released by the incoming thread, either
+ * on return from thread_switch() in schedule() or at the very
+ * beginning of a new thread. The incoming thread might have
+ * been migrated, hence the lock of the current CPU is released.
+ *
+ * An outgoing thread which is no longer allowed to run on the
+ * current CPU is only placed on another run queue here, when
+ * its context has been saved. Likewise, a finished thread is
+ * only marked dead and thus ready for reaping here.
+ *
+ */
+void sched_finish_switch (void)
+{
+	struct runqueue *rq = &this_cpu (runqueue);
+	
+	thread_t migrating = rq->migrating;
+	rq->migrating = NULL;
+	
+	thread_t zombie = rq->zombie;
+	rq->zombie = NULL;
+	
+	spinlock_unlock (&rq->lock);
+	
+	if (migrating != NULL)
+		sched_place (migrating);
+	
+	if (zombie != NULL)
+		thread_mark_dead (zombie);
+}
+
+
 /** Schedule the next thread to run
+ *
+ * Take the thread with the highest priority from the run queue
+ * of the current CPU. If the queue is empty, try to steal a thread
+ * from the busiest CPU first and fall back to the idle thread
+ * of the CPU.
  *
  */
 void schedule (void)
@@ -113,13 +863,347 @@ void schedule (void)
 	/* Disable interrupts while accessing shared structures. */
 	ipl_t state = query_and_disable_interrupts ();
 	
-	/* Just take the first thread on the list of schedulable threads. */
-	link_t *link = list_rotate (&runnable_list[cpuid()]);
-	if (link != NULL) {
-		thread_t next_thread = list_item (link, struct thread, link);
-		next_thread->scheduled = timer_get ();
+	/* Switching threads is a quiescent state. */
+	rcu_quiescent_state ();
+	
+	unsigned int cpu = cpuid ();
+	struct runqueue *rq = &per_cpu (runqueue, cpu);
+	
+	spinlock_lock (&rq->lock);
+	
+	/*
+	 * The current thread leaves the run queue if its affinity
+	 * has changed, see sched_finish_switch().
+	 */
+	thread_t current = per_cpu (current_thread, cpu);
+	if ((current != NULL) && (link_connected (&current->link)) &&
+	    ((current->affinity & CPUMASK_CPU (cpu)) == 0)) {
+		list_remove (&current->link);
+		rq->nr_running--;
+		rq->migrating = current;
+	}
+	
+	link_t *link = runqueue_pick (rq);
+	if ((link == NULL) && (sched_steal (rq, cpu)))
+		link = runqueue_pick (rq);
+	
+	thread_t next_thread = rq->idle;
+	if (link != NULL)
+		next_thread = list_item (link, struct thread, link);
+	
+	assert (next_thread != NULL);
+	
+	if (next_thread != current) {
+		unative_t timestamp = timer_get ();
+		
+		/* Account the time spent in the idle thread. */
+		if (current == rq->idle)
+			rq->idle_cycles += timestamp - rq->idle_since;
+		else if (next_thread == rq->idle)
+			rq->idle_since = timestamp;
+		
+		/* A finished thread is reaped once switched out. */
+		if ((current != NULL) && (current->state == THREAD_ZOMBIE))
+			rq->zombie = current;
+		
+		next_thread->scheduled = timestamp;
+		sched_program_timer (rq, cpu, next_thread);
 		thread_switch (next_thread);
+	} else {
+		/* With no other thread to run, start a new quantum. */
+		unative_t timestamp = timer_get ();
+		if (timestamp - current->scheduled >= THREAD_QUANTUM)
+			current->scheduled = timestamp;
+		
+		sched_program_timer (rq, cpu, current);
+	}
+	
+	sched_finish_switch ();
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Wake up a sleeping thread
+ *
+ * The thread is placed on a CPU chosen by sched_select_cpu(). A thread
+ * which is still finishing its way to the processor on its last CPU
+ * stays there, because it must not run elsewhere before its context
+ * is saved.
+ *
+ * @param thread Thread to wake up.
+ *
+ */
+void sched_wakeup (thread_t thread)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	struct runqueue *rq = runqueue_lock_thread (thread);
+	
+	if (thread->state != THREAD_SLEEPING) {
+		spinlock_unlock (&rq->lock);
+		conditionally_enable_interrupts (state);
+		return;
+	}
+	
+	thread->state = THREAD_READY;
+	
+	if (thread == per_cpu (current_thread, thread->cpu)) {
+		list_append (&rq->list, &thread->link);
+		rq->nr_running++;
+		spinlock_unlock (&rq->lock);
+	} else {
+		/*
+		 * Nobody else touches the thread until it is on a run
+		 * queue again, since it is neither sleeping nor queued.
+		 */
+		spinlock_unlock (&rq->lock);
+		sched_place (thread);
+	}
+	
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Set the CPU affinity of a thread
+ *
+ * A ready thread which is not allowed to stay on its CPU is moved
+ * right away. A running thread is moved when it gives up the
+ * processor, a remote CPU is asked to reschedule for that purpose.
+ * A sleeping thread is placed according to the new affinity
+ * when it is woken up.
+ *
+ * @param thread   Thread to set the affinity for.
+ * @param affinity Set of CPUs the thread is allowed to run on.
+ *
+ * @return EOK if the affinity was set.
+ * @return EINVAL if the set does not contain any online CPU.
+ *
+ */
+int sched_set_affinity (thread_t thread, const cpumask_t affinity)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	bool online = false;
+	for (unsigned int i = 0; i < MAX_CPU; i++) {
+		if ((affinity & CPUMASK_CPU (i)) != 0)
+			online = online || per_cpu (runqueue, i).online;
+	}
+	
+	if ((!online) || (thread == per_cpu (runqueue, thread->cpu).idle)) {
+		conditionally_enable_interrupts (state);
+		return EINVAL;
+	}
+	
+	struct runqueue *rq = runqueue_lock_thread (thread);
+	unsigned int cpu = thread->cpu;
+	
+	thread->affinity = affinity;
+	
+	if ((affinity & CPUMASK_CPU (cpu)) != 0) {
+		spinlock_unlock (&rq->lock);
+		conditionally_enable_interrupts (state);
+		return EOK;
+	}
+	
+	if (thread == per_cpu (current_thread, cpu)) {
+		/* The thread migrates itself in schedule(). */
+		spinlock_unlock (&rq->lock);
+		
+		if (cpu == cpuid ())
+			schedule ();
+		else
+			dorder_send (cpu, DORDER_MSG_RESCHEDULE);
+	} else if (link_connected (&thread->link)) {
+		list_remove (&thread->link);
+		rq->nr_running--;
+		spinlock_unlock (&rq->lock);
+		
+		sched_place (thread);
+	} else
+		spinlock_unlock (&rq->lock);
+	
+	conditionally_enable_interrupts (state);
+	return EOK;
+}
+
+
+/** Set the effective priority of a thread
+ *
+ * The change is effective right away, the CPU of the thread
+ * is asked to reschedule if it should run a different thread
+ * as a result.
+ *
+ * @param thread   Thread to set the priority for.
+ * @param priority The new effective priority.
+ *
+ */
+void sched_set_priority (thread_t thread, unsigned int priority)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	struct runqueue *rq = runqueue_lock_thread (thread);
+	unsigned int cpu = thread->cpu;
+	
+	thread->priority = priority;
+	bool preempt = runqueue_preempts (rq, per_cpu (current_thread, cpu));
+	
+	spinlock_unlock (&rq->lock);
+	
+	if (preempt)
+		sched_resched (cpu);
+	
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Handle a reschedule request from another CPU
+ *
+ * The function is called from an interrupt handler when
+ * another CPU has put a thread on the local run queue,
+ * changed the affinity or the priority of a local thread
+ * or started a timer expiring on the local CPU.
+ *
+ */
+void sched_ipi (void)
+{
+	unsigned int cpu = cpuid ();
+	struct runqueue *rq = &per_cpu (runqueue, cpu);
+	thread_t current = per_cpu (current_thread, cpu);
+	
+	/*
+	 * A waiting idle thread reschedules by itself. The message
+	 * might have arrived just before the wait instruction though,
+	 * the timer is therefore set to wake the CPU up shortly.
+	 */
+	if (rq->waiting) {
+		timer_setup (SCHED_MIN_DELAY);
+		return;
 	}
 	
+	spinlock_lock (&rq->lock);
+	bool preempt = runqueue_preempts (rq, current);
+	spinlock_unlock (&rq->lock);
+	
+	if ((preempt) || ((current->affinity & CPUMASK_CPU (cpu)) == 0))
+		schedule ();
+	else
+		sched_program_timer (rq, cpu, current);
+}
+
+
+/** Notify the scheduler about a newly started timer
+ *
+ * The CPU running the timer might have its timer interrupt
+ * programmed past the expiration of the new timer. The timer
+ * of the CPU is therefore programmed again.
+ *
+ * @param cpu CPU running the timer.
+ *
+ */
+void sched_timers_changed (unsigned int cpu)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	if (cpu == cpuid ())
+		sched_program_timer (&per_cpu (runqueue, cpu), cpu,
+		    per_cpu (current_thread, cpu));
+	else
+		dorder_send (cpu, DORDER_MSG_RESCHEDULE);
+	
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Idle the current CPU
+ *
+ * Called repeatedly by the idle thread. If the run queue
+ * of the current CPU is empty, the CPU waits for an interrupt,
+ * which is either the scheduler timer interrupt or a reschedule
+ * message from a CPU that has put a thread on the run queue.
+ *
+ * The run queue is checked with disabled interrupts, but the
+ * interrupts have to be enabled before the wait instruction.
+ * A reschedule message arriving in between is handled before
+ * the wait, sched_ipi() then makes sure that the timer wakes
+ * the CPU up shortly.
+ *
+ * With SCHED_IDLE_SPIN defined, the CPU does not wait and
+ * the idle thread keeps yielding the processor instead.
+ *
+ */
+void sched_idle (void)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	struct runqueue *rq = &this_cpu (runqueue);
+	rq->idle_loops++;
+
+#ifndef SCHED_IDLE_SPIN
+	if ((rq->nr_running == 0) && (rcu_idle_enter ())) {
+		unative_t start = timer_get ();
+		rq->waiting = true;
+		
+		enable_interrupts ();
+		cpu_wait ();
+		disable_interrupts ();
+		
+		rq->waiting = false;
+		rq->wait_cycles += timer_get () - start;
+		rcu_idle_exit ();
+	}
+#endif
+	
 	conditionally_enable_interrupts (state);
+	
+	/* Run whatever work is available now. */
+	schedule ();
+}
+
+
+/** Get the set of online CPUs
+ *
+ * @return Set of the CPUs which have initialized their scheduler.
+ *
+ */
+cpumask_t sched_online_cpus (void)
+{
+	cpumask_t cpus = 0;
+	
+	for (unsigned int i = 0; i < MAX_CPU; i++) {
+		if (per_cpu (runqueue, i).online)
+			cpus |= CPUMASK_CPU (i);
+	}
+	
+	return cpus;
+}
+
+
+/** Get the idle time statistics of a CPU
+ *
+ * The idle time of the current idle period is
+ * not included until the idle thread is switched out.
+ *
+ * @param cpu   CPU to get the statistics for.
+ * @param stats Storage for the statistics.
+ *
+ * @return True if the CPU is online.
+ *
+ */
+bool sched_get_idle_stats (unsigned int cpu, struct sched_idle_stats *stats)
+{
+	struct runqueue *rq = &per_cpu (runqueue, cpu);
+	
+	ipl_t state = spinlock_lock_irqsave (&rq->lock);
+	stats->idle_cycles = rq->idle_cycles;
+	stats->wait_cycles = rq->wait_cycles;
+	stats->idle_loops = rq->idle_loops;
+	bool online = rq->online;
+	spinlock_unlock_irqrestore (&rq->lock, state);
+	
+	return online;
 }
@@ -20,16 +20,39 @@
 #include <proc/thread.h>
 
 
-/* Externals are commented with implementation */
-ATOMIC_EXTERN(cpu_ready);
-
-extern volatile unsigned int jiffies;
+/** Idle time statistics of a CPU
+ *
+ */
+struct sched_idle_stats {
+	/** Cycles spent in the idle thread */
+	uint64_t idle_cycles;
+	
+	/** Cycles of the idle time spent waiting for an interrupt */
+	uint64_t wait_cycles;
+	
+	/** Number of passes through the idle loop */
+	unsigned int idle_loops;
+};
 
 
+/* Externals are commented with implementation */
 extern void scheduler_init (void);
+extern unsigned int jiffies_get (void);
+extern uint64_t cycles_get (void);
+extern void sched_set_idle (thread_t thread);
 extern void sched_insert (thread_t thread);
 extern void sched_remove (thread_t thread);
+extern void sched_wakeup (thread_t thread);
+extern int sched_set_affinity (thread_t thread, const cpumask_t affinity);
+extern void sched_set_priority (thread_t thread, unsigned int priority);
 extern void sched_timer (void);
+extern void sched_finish_switch (void);
+extern void sched_ipi (void);
+extern void sched_timers_changed (unsigned int cpu);
+extern void sched_idle (void);
+extern cpumask_t sched_online_cpus (void);
+extern bool sched_get_idle_stats (unsigned int cpu,
+    struct sched_idle_stats *stats);
 extern void schedule (void);
 
 
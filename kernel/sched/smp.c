@@ -0,0 +1,244 @@
+/**
+ * @file smp.c
+ *
+ * Cross-CPU function calls.
+ *
+ * A function is run on other CPUs by putting a request in the call
+ * queue of each target CPU and sending it a dorder call message. The
+ * call messages are coalesced like reschedule requests, a single
+ * interrupt runs all the requests queued at the CPU in the meantime.
+ *
+ * The caller either waits for the call to complete on all the target
+ * CPUs, or goes on and checks for completion later. A CPU waiting for
+ * a call runs the requests queued at itself meanwhile, so that two
+ * CPUs calling each other with interrupts disabled do not deadlock.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2017
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/debug.h>
+#include <sched/sched.h>
+#include <synch/spinlock.h>
+#include <drivers/dorder.h>
+#include <mm/percpu.h>
+
+#include <sched/smp.h>
+
+
+/** Call queue of a single CPU
+ *
+ */
+struct smp_queue {
+	/** Lock protecting the queue */
+	spinlock_t lock;
+	
+	/** Queued call entries */
+	list_t calls;
+};
+
+
+/** Call queue of each CPU
+ *
+ */
+static DEFINE_PER_CPU (struct smp_queue, smp_queue);
+
+
+/** Initialize the cross-CPU calls
+ *
+ * Called once by the bootstrap processor.
+ *
+ */
+void smp_init (void)
+{
+	for (unsigned int i = 0; i < MAX_CPU; i++) {
+		spinlock_init (&per_cpu (smp_queue, i).lock);
+		list_init (&per_cpu (smp_queue, i).calls);
+	}
+}
+
+
+/** Run a call and report its completion
+ *
+ * The caller might reuse the call as soon as it completes,
+ * the call is not touched afterwards.
+ *
+ * @param call Call to run.
+ *
+ */
+static void smp_call_run (struct smp_call *call)
+{
+	call->func (call->data);
+	
+	/* Make the effects visible before the completion. */
+	memory_barrier ();
+	atomic_sub (&call->pending, 1);
+}
+
+
+/** Run the calls queued at the current CPU
+ *
+ * Called from the dorder interrupt handler, or by a CPU waiting
+ * for a call to complete, always with interrupts disabled.
+ *
+ */
+void smp_call_ipi (void)
+{
+	struct smp_queue *queue = &this_cpu (smp_queue);
+	link_t *link;
+	
+	spinlock_lock (&queue->lock);
+	
+	while ((link = list_pop (&queue->calls)) != NULL) {
+		struct smp_call_entry *entry =
+		    list_item (link, struct smp_call_entry, link);
+		
+		spinlock_unlock (&queue->lock);
+		smp_call_run (entry->call);
+		spinlock_lock (&queue->lock);
+	}
+	
+	spinlock_unlock (&queue->lock);
+}
+
+
+/** Run a function on a set of CPUs without waiting
+ *
+ * The function runs on the online CPUs in the set. If the set
+ * contains the current CPU, the function runs on it right away.
+ *
+ * @param call Call control structure, kept alive by the caller
+ *             until the call completes.
+ * @param cpus Set of CPUs to run the function on.
+ * @param func Function to run.
+ * @param data Function argument.
+ *
+ */
+void smp_call_async (struct smp_call *call, const cpumask_t cpus,
+    smp_call_fn func, void *data)
+{
+	assert (call != NULL);
+	assert (func != NULL);
+	
+	cpumask_t targets = cpus & sched_online_cpus ();
+	
+	call->func = func;
+	call->data = data;
+	
+	native_t count = 0;
+	for (unsigned int i = 0; i < MAX_CPU; i++) {
+		if (targets & CPUMASK_CPU (i))
+			count++;
+	}
+	
+	atomic_set (&call->pending, count);
+	
+	/*
+	 * Stay on the current CPU while sending
+	 * the requests to the other CPUs.
+	 */
+	ipl_t state = query_and_disable_interrupts ();
+	unsigned int local = cpuid ();
+	
+	for (unsigned int i = 0; i < MAX_CPU; i++) {
+		if ((i == local) || (!(targets & CPUMASK_CPU (i))))
+			continue;
+		
+		struct smp_queue *queue = &per_cpu (smp_queue, i);
+		struct smp_call_entry *entry = &call->entries[i];
+		
+		link_init (&entry->link);
+		entry->call = call;
+		
+		spinlock_lock (&queue->lock);
+		list_append (&queue->calls, &entry->link);
+		spinlock_unlock (&queue->lock);
+		
+		dorder_send (i, DORDER_MSG_CALL);
+	}
+	
+	if (targets & CPUMASK_CPU (local))
+		smp_call_run (call);
+	
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Check whether a call has completed
+ *
+ * @param call Call to check.
+ *
+ * @return True if the call has completed on all the target CPUs.
+ *
+ */
+bool smp_call_done (struct smp_call *call)
+{
+	assert (call != NULL);
+	
+	return (atomic_get (&call->pending) == 0);
+}
+
+
+/** Wait for a call to complete
+ *
+ * Busy wait until the call completes on all the target CPUs,
+ * running the calls queued at the current CPU meanwhile.
+ *
+ * @param call Call to wait for.
+ *
+ */
+void smp_call_wait (struct smp_call *call)
+{
+	assert (call != NULL);
+	
+	while (!smp_call_done (call)) {
+		ipl_t state = query_and_disable_interrupts ();
+		smp_call_ipi ();
+		conditionally_enable_interrupts (state);
+	}
+	
+	/* See the effects of the call. */
+	memory_barrier ();
+}
+
+
+/** Run a function on a CPU and wait for it to complete
+ *
+ * @param cpu  CPU to run the function on.
+ * @param func Function to run.
+ * @param data Function argument.
+ *
+ */
+void smp_call_function_single (const unsigned int cpu,
+    smp_call_fn func, void *data)
+{
+	assert (cpu < MAX_CPU);
+	
+	smp_call_function_many (CPUMASK_CPU (cpu), func, data);
+}
+
+
+/** Run a function on a set of CPUs and wait for it to complete
+ *
+ * @param cpus Set of CPUs to run the function on.
+ * @param func Function to run.
+ * @param data Function argument.
+ *
+ */
+void smp_call_function_many (const cpumask_t cpus,
+    smp_call_fn func, void *data)
+{
+	struct smp_call call;
+	
+	smp_call_async (&call, cpus, func, data);
+	smp_call_wait (&call);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file smp.h
+ *
+ * Cross-CPU function calls.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2017
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef SMP_H_
+#define SMP_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/atomic.h>
+#include <adt/list.h>
+#include <proc/thread.h>
+
+
+/** Cross-CPU call function.
+ *
+ * Runs in the interrupt handler of the target CPU,
+ * with interrupts disabled.
+ *
+ */
+typedef void (* smp_call_fn) (void *data);
+
+
+struct smp_call;
+
+
+/** Cross-CPU call request queued at a single CPU.
+ *
+ */
+struct smp_call_entry {
+	/** Link in the call queue of the CPU */
+	link_t link;
+	
+	/** The call to run */
+	struct smp_call *call;
+};
+
+
+/** Cross-CPU call control structure.
+ *
+ * The structure must stay alive until the call completes on
+ * all the target CPUs, see smp_call_done() and smp_call_wait().
+ *
+ */
+struct smp_call {
+	/** Function to call */
+	smp_call_fn func;
+	
+	/** Function argument */
+	void *data;
+	
+	/** Number of CPUs which have not completed the call yet */
+	atomic_t pending;
+	
+	/** Queue entries for the target CPUs */
+	struct smp_call_entry entries[MAX_CPU];
+};
+
+
+/* Externals are commented with implementation */
+extern void smp_init (void);
+extern void smp_call_ipi (void);
+extern void smp_call_async (struct smp_call *call, const cpumask_t cpus,
+    smp_call_fn func, void *data);
+extern bool smp_call_done (struct smp_call *call);
+extern void smp_call_wait (struct smp_call *call);
+extern void smp_call_function_single (const unsigned int cpu,
+    smp_call_fn func, void *data);
+extern void smp_call_function_many (const cpumask_t cpus,
+    smp_call_fn func, void *data);
+
+
+#endif /* SMP_H_ */
@@ -0,0 +1,237 @@
+/**
+ * @file brlock.c
+ *
+ * Big-reader lock.
+ *
+ * A read/write lock for data which is read much more often than
+ * written. A reader only increments the counter of the CPU it runs
+ * on, readers on different CPUs therefore never touch the same cache
+ * line. A writer announces itself first, which diverts the readers
+ * to a slow path, and then waits until the sum of the counters over
+ * all CPUs drops to zero.
+ *
+ * A reader may leave on a CPU other than the one it entered on, only
+ * the sum of the counters is meaningful.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2016
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/debug.h>
+#include <sched/sched.h>
+#include <drivers/dorder.h>
+
+#include <synch/brlock.h>
+
+
+/** Initialize a big-reader lock
+ *
+ * @param brl Big-reader lock to initialize.
+ *
+ */
+void brlock_init (struct brlock *brl)
+{
+	assert (brl != NULL);
+	
+	for (unsigned int i = 0; i < MAX_CPU; i++)
+		atomic_set (&brl->cpus[i].readers, 0);
+	
+	brl->writer = false;
+	mutex_init (&brl->write_mutex);
+	spinlock_init (&brl->lock);
+	waitqueue_init (&brl->drain_wait_queue, &brl->lock, WAITQUEUE_FIFO);
+	waitqueue_init (&brl->read_wait_queue, &brl->lock, WAITQUEUE_FIFO);
+}
+
+
+/** Count the readers of a big-reader lock
+ *
+ * @param brl Big-reader lock.
+ *
+ * @return Number of readers in the critical section.
+ *
+ */
+static native_t brlock_readers (struct brlock *brl)
+{
+	native_t readers = 0;
+	
+	for (unsigned int i = 0; i < MAX_CPU; i++)
+		readers += atomic_get (&brl->cpus[i].readers);
+	
+	return readers;
+}
+
+
+/** Clean up a big-reader lock
+ *
+ * If the lock is held then trigger a kernel panic.
+ *
+ * @param brl Big-reader lock to clean up.
+ *
+ */
+void brlock_destroy (struct brlock *brl)
+{
+	assert (brl != NULL);
+	
+	if ((brl->writer) || (brlock_readers (brl) != 0))
+		panic ("Attempt to destroy a big-reader lock in use\n");
+	
+	mutex_destroy (&brl->write_mutex);
+}
+
+
+/** Leave the critical section as a reader
+ *
+ * Wake up the writer waiting for the readers to leave
+ * if the current thread was the last reader.
+ *
+ * Must be called with interrupts disabled.
+ *
+ * @param brl Big-reader lock to leave.
+ *
+ */
+static void brlock_read_leave (struct brlock *brl)
+{
+	atomic_sub (&brl->cpus[cpuid ()].readers, 1);
+	memory_barrier ();
+	
+	if (!brl->writer)
+		return;
+	
+	spinlock_lock (&brl->lock);
+	
+	if ((!waitqueue_empty (&brl->drain_wait_queue)) &&
+	    (brlock_readers (brl) == 0))
+		waitqueue_wake_one (&brl->drain_wait_queue);
+	
+	spinlock_unlock (&brl->lock);
+}
+
+
+/** Acquire a reader's lock
+ *
+ * Multiple readers can be in the critical section at once.
+ * If there is a writer holding or waiting for the lock, the
+ * reader is blocked until the writer leaves.
+ *
+ * @param brl Big-reader lock to acquire for a reader.
+ *
+ */
+void brlock_read_lock (struct brlock *brl)
+{
+	assert (brl != NULL);
+	
+	ipl_t state = query_and_disable_interrupts ();
+	
+	/*
+	 * Fast path. The barrier orders the increment before
+	 * the check of the writer flag, the writer orders them
+	 * the other way round, at least one of the two threads
+	 * therefore sees the other one.
+	 */
+	atomic_add (&brl->cpus[cpuid ()].readers, 1);
+	memory_barrier ();
+	
+	if (!brl->writer) {
+		conditionally_enable_interrupts (state);
+		return;
+	}
+	
+	/* Back off and wait for the writer to leave. */
+	brlock_read_leave (brl);
+	
+	spinlock_lock (&brl->lock);
+	
+	while (brl->writer)
+		waitqueue_wait (&brl->read_wait_queue, WAITER_SHARED);
+	
+	/* A writer waits for this lock before it starts draining. */
+	atomic_add (&brl->cpus[cpuid ()].readers, 1);
+	
+	spinlock_unlock (&brl->lock);
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Release a reader's lock
+ *
+ * If there is a writer waiting for the readers to leave
+ * and this is the last reader, the writer is woken up.
+ *
+ * @param brl Big-reader lock to release.
+ *
+ */
+void brlock_read_unlock (struct brlock *brl)
+{
+	assert (brl != NULL);
+	
+	ipl_t state = query_and_disable_interrupts ();
+	brlock_read_leave (brl);
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Acquire a writer's lock
+ *
+ * Writers are serialized with a mutex. The writer diverts
+ * new readers to the slow path and then waits until all the
+ * readers in the critical section leave.
+ *
+ * @param brl Big-reader lock to acquire for a writer.
+ *
+ */
+void brlock_write_lock (struct brlock *brl)
+{
+	assert (brl != NULL);
+	
+	mutex_lock (&brl->write_mutex);
+	
+	ipl_t state = spinlock_lock_irqsave (&brl->lock);
+	
+	brl->writer = true;
+	memory_barrier ();
+	
+	while (brlock_readers (brl) != 0)
+		waitqueue_wait (&brl->drain_wait_queue, WAITER_EXCLUSIVE);
+	
+	spinlock_unlock_irqrestore (&brl->lock, state);
+}
+
+
+/** Release a writer's lock
+ *
+ * Wake up all the readers which have been waiting
+ * for the writer to leave.
+ *
+ * @param brl Big-reader lock to release.
+ *
+ */
+void brlock_write_unlock (struct brlock *brl)
+{
+	assert (brl != NULL);
+	
+	if (brl->write_mutex.owner != thread_get_current ())
+		panic ("Attempt to unlock a big-reader lock not locked "
+		    "for writing\n");
+	
+	ipl_t state = spinlock_lock_irqsave (&brl->lock);
+	
+	/* Let the readers see the updates of the writer. */
+	memory_barrier ();
+	brl->writer = false;
+	
+	waitqueue_wake_all (&brl->read_wait_queue);
+	
+	spinlock_unlock_irqrestore (&brl->lock, state);
+	
+	mutex_unlock (&brl->write_mutex);
+}
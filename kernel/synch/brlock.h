@@ -0,0 +1,77 @@
+/**
+ * @file brlock.h
+ *
+ * Big-reader lock.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2016
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef BRLOCK_H_
+#define BRLOCK_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <proc/thread.h>
+#include <adt/atomic.h>
+#include <synch/spinlock.h>
+#include <synch/waitqueue.h>
+#include <synch/mutex.h>
+
+
+/** Per-CPU reader counter of a big-reader lock.
+ *
+ * Padded to a cache line, so that readers on different
+ * CPUs do not write to the same cache line.
+ *
+ */
+struct brlock_cpu {
+	/** Readers entered on the CPU minus readers left on the CPU */
+	atomic_t readers;
+	
+	/** Padding */
+	uint8_t pad[CACHE_LINE_SIZE - sizeof (atomic_t)];
+};
+
+
+/** Big-reader lock control structure.
+ *
+ */
+struct brlock {
+	/** Per-CPU reader counters */
+	struct brlock_cpu cpus[MAX_CPU];
+	
+	/** A writer holds the lock or waits for the readers to leave */
+	volatile bool writer;
+	
+	/** Mutex serializing the writers */
+	struct mutex write_mutex;
+	
+	/** Lock protecting the slow paths */
+	spinlock_t lock;
+	
+	/** Writer waiting for the readers to leave */
+	waitqueue_t drain_wait_queue;
+	
+	/** Readers waiting for the writer to leave */
+	waitqueue_t read_wait_queue;
+};
+
+
+/* Externals are commented with implementation */
+extern void brlock_init (struct brlock *brl);
+extern void brlock_destroy (struct brlock *brl);
+extern void brlock_read_lock (struct brlock *brl);
+extern void brlock_read_unlock (struct brlock *brl);
+extern void brlock_write_lock (struct brlock *brl);
+extern void brlock_write_unlock (struct brlock *brl);
+
+
+#endif /* BRLOCK_H_ */
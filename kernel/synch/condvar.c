@@ -3,6 +3,17 @@
  *
  * Condition variables.
  *
+ * A signalled thread does not wake up only to find the mutex
+ * owned by the signalling thread and go to sleep again. Instead,
+ * it is moved directly to the wait queue of the mutex (wait
+ * morphing) and the mutex is handed over to it when released.
+ * A broadcast therefore wakes up the waiting threads one at
+ * a time as the mutex is passed along.
+ *
+ * Every wait is accounted as a contended acquisition in the lock
+ * statistics, with the time from going to sleep until the mutex
+ * is acquired again as the wait time. There is no hold time.
+ *
  * Kalisto
  *
  * Copyright (c) 2001-2016
@@ -22,17 +33,25 @@
 #include <synch/condvar.h>
 
 
-/** Initialize a condition variable
+/** Initialize a condition variable of a lock class
  *
  * Initialize a condition variable. There are obviously
  * no waiting threads.
  *
- * @param cvar Condition variable to initialize.
+ * @param cvar  Condition variable to initialize.
+ * @param class Lock class of the condition variable.
  *
  */
-void condvar_init (struct condvar *cvar)
+void condvar_init_class (struct condvar *cvar, struct lock_class *class)
 {
-	// TODO
+	assert (cvar != NULL);
+	assert (class != NULL);
+	
+	spinlock_init (&cvar->lock);
+	waitqueue_init (&cvar->wait_queue, &cvar->lock, WAITQUEUE_FIFO);
+	
+	lockstat_register (class);
+	cvar->class = class;
 }
 
 
@@ -46,7 +65,12 @@ void condvar_init (struct condvar *cvar)
  */
 void condvar_destroy (struct condvar *cvar)
 {
-	// TODO
+	assert (cvar != NULL);
+	
+	if (!waitqueue_empty (&cvar->wait_queue)) {
+		panic ("Request to destroy a condition variable "
+		    "with waiting threads.");
+	}
 }
 
 
@@ -56,14 +80,36 @@ void condvar_destroy (struct condvar *cvar)
  * variable. This function contains the shared functionality
  * of condvar_signal() and condvar_broadcast().
  *
- * This must be called with disabled interrupts.
+ * If the mutex of the thread is owned, the thread is requeued
+ * onto the wait queue of the mutex and is woken up by
+ * mutex_unlock() as the new owner of the mutex.
+ *
+ * This must be called with the condition variable locked.
  *
  * @param cvar Condition variable whose thread to wake up.
  *
+ * @return False if there was no thread to wake up.
+ *
  */
-static void condvar_wakeup (struct condvar *cvar)
+static bool condvar_wakeup (struct condvar *cvar)
 {
-	// TODO
+	struct waiter *waiter = waitqueue_first (&cvar->wait_queue);
+	if (waiter == NULL)
+		return false;
+	
+	/*
+	 * The waiter might return as soon as it is woken up,
+	 * do not touch it afterwards.
+	 */
+	thread_t thread = waiter->thread;
+	struct mutex *mtx = (struct mutex *) waiter->data;
+	
+	waitqueue_remove (&cvar->wait_queue, waiter);
+	
+	if (!mutex_requeue (mtx, thread))
+		thread_wakeup (thread);
+	
+	return true;
 }
 
 
@@ -77,8 +123,11 @@ static void condvar_wakeup (struct condvar *cvar)
  */
 void condvar_signal (struct condvar *cvar)
 {
-	// TODO
-	(void) condvar_wakeup;
+	assert (cvar != NULL);
+	
+	ipl_t state = spinlock_lock_irqsave (&cvar->lock);
+	condvar_wakeup (cvar);
+	spinlock_unlock_irqrestore (&cvar->lock, state);
 }
 
 
@@ -92,7 +141,68 @@ void condvar_signal (struct condvar *cvar)
  */
 void condvar_broadcast (struct condvar *cvar)
 {
-	// TODO
+	assert (cvar != NULL);
+	
+	ipl_t state = spinlock_lock_irqsave (&cvar->lock);
+	while (condvar_wakeup (cvar));
+	spinlock_unlock_irqrestore (&cvar->lock, state);
+}
+
+
+/** Wait on a condition variable with a timeout
+ *
+ * The shared functionality of condvar_wait() and
+ * condvar_timedwait().
+ *
+ * @param cvar Condition variable to wait on.
+ * @param mtx  Mutex to unlock atomically.
+ * @param usec Timeout in microseconds, or WAITQUEUE_FOREVER.
+ *
+ * @return EOK if signalled, ETIMEDOUT if the timeout expired.
+ *
+ */
+static int condvar_sleep (struct condvar *cvar, struct mutex *mtx,
+    const unsigned int usec)
+{
+	assert (cvar != NULL);
+	assert (mtx != NULL);
+	
+	thread_t current = thread_get_current ();
+	assert (mtx->owner == current);
+	
+	struct waiter waiter;
+	waiter_init (&waiter, WAITER_EXCLUSIVE, (native_t) mtx);
+	
+	unative_t start = lockstat_timestamp ();
+	
+	/*
+	 * No signal gets in between unlocking the mutex and
+	 * going to sleep while the condition variable is locked.
+	 */
+	ipl_t state = spinlock_lock_irqsave (&cvar->lock);
+	mutex_unlock (mtx);
+	
+	int rc = waitqueue_sleep (&cvar->wait_queue, &waiter, usec);
+	spinlock_unlock (&cvar->lock);
+	
+	/*
+	 * A requeued thread is only woken up by mutex_unlock(),
+	 * after the ownership of the mutex has been handed over.
+	 */
+	if (mtx->owner == current) {
+		mtx->acquired = lockstat_timestamp ();
+		conditionally_enable_interrupts (state);
+	} else {
+		conditionally_enable_interrupts (state);
+		mutex_lock (mtx);
+	}
+	
+	if (start != 0) {
+		lockstat_acquired (cvar->class, true, start,
+		    lockstat_timestamp ());
+	}
+	
+	return rc;
 }
 
 
@@ -106,7 +216,29 @@ void condvar_broadcast (struct condvar *cvar)
  * @param mtx  Mutex to unlock atomically.
  *
  */
-void condvar_wait(struct condvar *cvar, struct mutex *mtx)
+void condvar_wait (struct condvar *cvar, struct mutex *mtx)
+{
+	condvar_sleep (cvar, mtx, WAITQUEUE_FOREVER);
+}
+
+
+/** Wait on a condition variable with a timeout
+ *
+ * Relinquish the mutex and wait for a signal on the condition
+ * variable for at most the given number of microseconds. The
+ * mutex is acquired again after we are woken up, even if the
+ * timeout expired.
+ *
+ * @param cvar Condition variable to wait on.
+ * @param mtx  Mutex to unlock atomically.
+ * @param usec Timeout in microseconds.
+ *
+ * @return EOK if the condition variable was signalled,
+ *         ETIMEDOUT if the timeout expired.
+ *
+ */
+int condvar_timedwait (struct condvar *cvar, struct mutex *mtx,
+    const unsigned int usec)
 {
-	// TODO
+	return condvar_sleep (cvar, mtx, usec);
 }
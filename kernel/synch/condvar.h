@@ -21,32 +21,55 @@
 
 #include <proc/thread.h>
 #include <adt/list.h>
+#include <synch/spinlock.h>
+#include <synch/waitqueue.h>
 #include <synch/mutex.h>
+#include <synch/lockstat.h>
 
 
 /** Condition variable control structure.
  *
  */
 struct condvar {
-	/** Number of waiting threads */
-	unsigned int num_waiting;
+	/** Lock protecting the condition variable */
+	spinlock_t lock;
 	
 	/** Condition variable wait queue.
 	 *
-	 * Consists of a linked list of threads
-	 * waiting at the condition variable. The queue
-	 * links threads via their wait_queue_item member.
+	 * The data member of each waiter points
+	 * to the mutex the thread is to acquire.
 	 */
-	list_t wait_queue;
+	waitqueue_t wait_queue;
+	
+	/** Lock class for the lock statistics */
+	struct lock_class *class;
 };
 
 
+/** Initialize a condition variable
+ *
+ * The initialization site defines the lock class
+ * of the condition variable.
+ *
+ * @param cvar Condition variable to initialize.
+ *
+ */
+#define condvar_init(cvar) \
+	do { \
+		LOCK_CLASS_DECLARE (__class, cvar); \
+		condvar_init_class ((cvar), &__class); \
+	} while (0)
+
+
 /* Externals are commented with implementation */
-extern void condvar_init (struct condvar *cvar);
+extern void condvar_init_class (struct condvar *cvar,
+    struct lock_class *class);
 extern void condvar_destroy (struct condvar *cvar);
 extern void condvar_signal (struct condvar *cvar);
 extern void condvar_broadcast (struct condvar *cvar);
 extern void condvar_wait (struct condvar *cvar, struct mutex *mtx);
+extern int condvar_timedwait (struct condvar *cvar, struct mutex *mtx,
+    const unsigned int usec);
 
 
 #endif /* CONDVAR_H_ */
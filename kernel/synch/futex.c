@@ -0,0 +1,184 @@
+/**
+ * @file futex.c
+ *
+ * Fast user space mutex support.
+ *
+ * A futex is a word in user memory which user space manipulates
+ * with atomic instructions on its own. The kernel only provides
+ * the waiting, a thread can sleep on the address of the word while
+ * it contains a given value and another thread can wake up the
+ * threads sleeping on the address. The kernel keeps no state for
+ * a futex without waiting threads.
+ *
+ * The waiting threads are kept in a hash table keyed on the address
+ * space and the address of the word. Checking the value of the word
+ * and going to sleep is atomic with respect to waking up, because
+ * both happen with the lock of the hash bucket held.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/debug.h>
+#include <mm/vmm.h>
+#include <sched/sched.h>
+
+#include <synch/futex.h>
+
+
+/** Futex hash bucket.
+ *
+ */
+struct futex_bucket {
+	/** Lock protecting the bucket */
+	spinlock_t lock;
+	
+	/** Threads waiting on the futexes of the bucket */
+	list_t waiters;
+};
+
+
+/** Futex hash table */
+static struct futex_bucket futex_table[FUTEX_BUCKETS];
+
+
+/** Initialize the futex hash table
+ *
+ */
+void futex_init (void)
+{
+	for (unsigned int i = 0; i < FUTEX_BUCKETS; i++) {
+		spinlock_init (&futex_table[i].lock);
+		list_init (&futex_table[i].waiters);
+	}
+}
+
+
+/** Find the hash bucket of a futex
+ *
+ * @param vmm  Address space of the futex word.
+ * @param addr User address of the futex word.
+ *
+ * @return The hash bucket.
+ *
+ */
+static struct futex_bucket *futex_bucket (struct vmm *vmm, unative_t *addr)
+{
+	unative_t key = (((unative_t) addr) >> 2) ^ (((unative_t) vmm) >> 4);
+	
+	return &futex_table[key & (FUTEX_BUCKETS - 1)];
+}
+
+
+/** Check a futex address
+ *
+ * @param addr User address of the futex word.
+ *
+ * @return True if the address is aligned and mapped.
+ *
+ */
+static bool futex_check (unative_t *addr)
+{
+	if ((((unative_t) addr) & (sizeof (unative_t) - 1)) != 0)
+		return false;
+	
+	return vma_check_user (addr, sizeof (unative_t));
+}
+
+
+/** Wait on a futex
+ *
+ * Put the current thread to sleep if the futex word contains
+ * the expected value. The thread sleeps until another thread
+ * calls futex_wake() on the same address.
+ *
+ * @param addr     User address of the futex word.
+ * @param expected The value the word is expected to contain.
+ *
+ * @return EOK if the thread has been woken up.
+ * @return EAGAIN if the word does not contain the expected value.
+ * @return EINVAL if the address is not valid.
+ *
+ */
+int futex_wait (unative_t *addr, const unative_t expected)
+{
+	if (!futex_check (addr))
+		return EINVAL;
+	
+	thread_t current = thread_get_current ();
+	struct futex_waiter waiter;
+	
+	waiter.thread = current;
+	waiter.vmm = current->vmm;
+	waiter.addr = addr;
+	
+	struct futex_bucket *bucket = futex_bucket (waiter.vmm, addr);
+	ipl_t state = spinlock_lock_irqsave (&bucket->lock);
+	
+	if (*((volatile unative_t *) addr) != expected) {
+		spinlock_unlock_irqrestore (&bucket->lock, state);
+		return EAGAIN;
+	}
+	
+	list_append (&bucket->waiters, &waiter.link);
+	
+	current->state = THREAD_SLEEPING;
+	sched_remove (current);
+	
+	spinlock_unlock (&bucket->lock);
+	schedule ();
+	
+	assert (!link_connected (&waiter.link));
+	conditionally_enable_interrupts (state);
+	
+	return EOK;
+}
+
+
+/** Wake up threads waiting on a futex
+ *
+ * @param addr  User address of the futex word.
+ * @param count Maximal number of threads to wake up.
+ *
+ * @return Number of threads woken up.
+ * @return EINVAL if the address is not valid.
+ *
+ */
+int futex_wake (unative_t *addr, const unsigned int count)
+{
+	if (!futex_check (addr))
+		return EINVAL;
+	
+	struct vmm *vmm = thread_get_current ()->vmm;
+	struct futex_bucket *bucket = futex_bucket (vmm, addr);
+	int woken = 0;
+	
+	ipl_t state = spinlock_lock_irqsave (&bucket->lock);
+	
+	link_t *link = bucket->waiters.head.next;
+	while ((link != &bucket->waiters.head) &&
+	    ((unsigned int) woken < count)) {
+		struct futex_waiter *waiter =
+		    list_item (link, struct futex_waiter, link);
+		link = link->next;
+		
+		if ((waiter->vmm == vmm) && (waiter->addr == addr)) {
+			list_remove (&waiter->link);
+			thread_wakeup (waiter->thread);
+			woken++;
+		}
+	}
+	
+	spinlock_unlock_irqrestore (&bucket->lock, state);
+	
+	return woken;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file futex.h
+ *
+ * Fast user space mutex support.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef FUTEX_H_
+#define FUTEX_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <proc/thread.h>
+#include <adt/list.h>
+#include <synch/spinlock.h>
+
+
+/** Number of futex hash buckets
+ *
+ * Must be a power of two.
+ *
+ */
+#define FUTEX_BUCKETS  64
+
+
+/** Thread waiting on a futex.
+ *
+ * The structure lives on the stack of the waiting thread.
+ *
+ */
+struct futex_waiter {
+	/** Link in the list of waiters of a hash bucket */
+	link_t link;
+	
+	/** The waiting thread */
+	thread_t thread;
+	
+	/** Address space of the futex word */
+	struct vmm *vmm;
+	
+	/** User address of the futex word */
+	unative_t *addr;
+};
+
+
+/* Externals are commented with implementation */
+extern void futex_init (void);
+extern int futex_wait (unative_t *addr, const unative_t expected);
+extern int futex_wake (unative_t *addr, const unsigned int count);
+
+
+#endif /* FUTEX_H_ */
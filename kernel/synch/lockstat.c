@@ -0,0 +1,200 @@
+/**
+ * @file lockstat.c
+ *
+ * Lock contention statistics.
+ *
+ * The sleeping locks report every acquisition and release to the
+ * class of the lock, recording whether the acquisition had to wait
+ * and how long the lock was waited for and held, in CP0 Count cycles.
+ * The collection is switched on and off at run time, a disabled
+ * collection costs a single test of a global flag per operation.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2016
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/print.h>
+
+#include <synch/lockstat.h>
+
+
+/** Statistics collection switch */
+volatile bool lockstat_enabled = false;
+
+/** Lock protecting the list of classes */
+static SPINLOCK_DECLARE (lockstat_lock);
+
+/** Registered lock classes */
+static LIST_DECLARE (lockstat_classes);
+
+
+/** Register a lock class
+ *
+ * Registering an already registered class does nothing.
+ *
+ * @param class The lock class to register.
+ *
+ */
+void lockstat_register (struct lock_class *class)
+{
+	ipl_t state = spinlock_lock_irqsave (&lockstat_lock);
+	
+	if (class->link.next == NULL)
+		list_append (&lockstat_classes, &class->link);
+	
+	spinlock_unlock_irqrestore (&lockstat_lock, state);
+}
+
+
+/** Account a lock acquisition
+ *
+ * @param class     Class of the lock.
+ * @param contended The acquisition had to wait for the lock.
+ * @param start     Timestamp of the acquisition attempt.
+ * @param acquired  Timestamp of the acquisition.
+ *
+ */
+void lockstat_acquired (struct lock_class *class, bool contended,
+    unative_t start, unative_t acquired)
+{
+	if ((class == NULL) || (start == 0) || (acquired == 0))
+		return;
+	
+	unative_t wait = acquired - start;
+	ipl_t state = spinlock_lock_irqsave (&class->lock);
+	
+	class->acquisitions++;
+	
+	if (contended) {
+		class->contentions++;
+		class->wait_cycles += wait;
+		if (wait > class->wait_max)
+			class->wait_max = wait;
+	}
+	
+	spinlock_unlock_irqrestore (&class->lock, state);
+}
+
+
+/** Account a lock release
+ *
+ * @param class    Class of the lock.
+ * @param acquired Timestamp of the acquisition.
+ *
+ */
+void lockstat_released (struct lock_class *class, unative_t acquired)
+{
+	unative_t now = lockstat_timestamp ();
+	if ((class == NULL) || (acquired == 0) || (now == 0))
+		return;
+	
+	unative_t hold = now - acquired;
+	ipl_t state = spinlock_lock_irqsave (&class->lock);
+	
+	class->hold_cycles += hold;
+	if (hold > class->hold_max)
+		class->hold_max = hold;
+	
+	spinlock_unlock_irqrestore (&class->lock, state);
+}
+
+
+/** Switch the statistics collection on or off
+ *
+ * @param enable Collect the statistics.
+ *
+ */
+void lockstat_enable (bool enable)
+{
+	lockstat_enabled = enable;
+}
+
+
+/** Clear the statistics of all classes
+ *
+ */
+void lockstat_reset (void)
+{
+	ipl_t state = spinlock_lock_irqsave (&lockstat_lock);
+	
+	list_foreach (lockstat_classes, struct lock_class, link, class) {
+		spinlock_lock (&class->lock);
+		
+		class->acquisitions = 0;
+		class->contentions = 0;
+		class->wait_cycles = 0;
+		class->wait_max = 0;
+		class->hold_cycles = 0;
+		class->hold_max = 0;
+		
+		spinlock_unlock (&class->lock);
+	}
+	
+	spinlock_unlock_irqrestore (&lockstat_lock, state);
+}
+
+
+/** Compute an average without a 64-bit division
+ *
+ * @param total Sum of the values.
+ * @param count Number of the values.
+ *
+ * @return Approximate average of the values.
+ *
+ */
+static unative_t lockstat_average (uint64_t total, unsigned int count)
+{
+	while ((total >> 32) != 0) {
+		total >>= 1;
+		count >>= 1;
+	}
+	
+	if (count == 0)
+		return 0;
+	
+	return ((unative_t) total) / count;
+}
+
+
+/** Print the statistics of all classes
+ *
+ * Classes whose locks have never been acquired are skipped.
+ * The times are in CP0 Count cycles.
+ *
+ */
+void lockstat_dump (void)
+{
+	printk ("Lock statistics (%s):\n",
+	    lockstat_enabled ? "enabled" : "disabled");
+	
+	ipl_t state = spinlock_lock_irqsave (&lockstat_lock);
+	
+	list_foreach (lockstat_classes, struct lock_class, link, class) {
+		spinlock_lock (&class->lock);
+		struct lock_class copy = *class;
+		spinlock_unlock (&class->lock);
+		
+		if (copy.acquisitions == 0)
+			continue;
+		
+		printk ("  %s (%s:%u): %u acquired, %u waited, "
+		    "wait avg %u max %u, hold avg %u max %u\n",
+		    copy.name, copy.file, copy.line,
+		    copy.acquisitions, copy.contentions,
+		    lockstat_average (copy.wait_cycles, copy.contentions),
+		    copy.wait_max,
+		    lockstat_average (copy.hold_cycles, copy.acquisitions),
+		    copy.hold_max);
+	}
+	
+	spinlock_unlock_irqrestore (&lockstat_lock, state);
+}
@@ -0,0 +1,122 @@
+/**
+ * @file lockstat.h
+ *
+ * Lock contention statistics.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2016
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef LOCKSTAT_H_
+#define LOCKSTAT_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/list.h>
+#include <synch/spinlock.h>
+#include <drivers/timer.h>
+
+
+/** Lock class.
+ *
+ * All the locks initialized at the same place in the source code
+ * form a class, the statistics are collected per class. Classes
+ * are declared statically by the *_init() macros of the locks and
+ * registered when the first lock of the class is initialized.
+ *
+ */
+struct lock_class {
+	/** Link in the list of registered classes */
+	link_t link;
+	
+	/** The lock expression passed to the initialization */
+	const char *name;
+	
+	/** Source file of the initialization */
+	const char *file;
+	
+	/** Source line of the initialization */
+	unsigned int line;
+	
+	/** Lock protecting the statistics */
+	spinlock_t lock;
+	
+	/** Number of acquisitions */
+	unsigned int acquisitions;
+	
+	/** Number of acquisitions which had to wait */
+	unsigned int contentions;
+	
+	/** Total and maximal wait time of the contended acquisitions */
+	uint64_t wait_cycles;
+	unative_t wait_max;
+	
+	/** Total and maximal hold time */
+	uint64_t hold_cycles;
+	unative_t hold_max;
+};
+
+
+/** Static lock class initializer
+ *
+ * @param expr The lock expression passed to the initialization.
+ *
+ */
+#define LOCK_CLASS_INITIALIZER(expr) \
+	{ \
+		.link = { NULL, NULL }, \
+		.name = expr, \
+		.file = __FILE__, \
+		.line = __LINE__, \
+		.lock = SPINLOCK_INITIALIZER \
+	}
+
+
+/** Declare the lock class of an initialization site
+ *
+ * @param class Name of the class variable to declare.
+ * @param lock  The lock expression passed to the initialization.
+ *
+ */
+#define LOCK_CLASS_DECLARE(class, lock) \
+	static struct lock_class class = LOCK_CLASS_INITIALIZER (#lock)
+
+
+/** Statistics collection switch */
+extern volatile bool lockstat_enabled;
+
+
+/** Take a timestamp for the statistics
+ *
+ * @return The current CP0 Count value.
+ * @return Zero if the statistics are not being collected.
+ *
+ */
+static inline unative_t lockstat_timestamp (void)
+{
+	if (!lockstat_enabled)
+		return 0;
+	
+	unative_t now = timer_get ();
+	return (now != 0) ? now : 1;
+}
+
+
+/* Externals are commented with implementation */
+extern void lockstat_register (struct lock_class *class);
+extern void lockstat_acquired (struct lock_class *class, bool contended,
+    unative_t start, unative_t acquired);
+extern void lockstat_released (struct lock_class *class, unative_t acquired);
+extern void lockstat_enable (bool enable);
+extern void lockstat_reset (void);
+extern void lockstat_dump (void);
+
+
+#endif /* LOCKSTAT_H_ */
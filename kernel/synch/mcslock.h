@@ -0,0 +1,159 @@
+/**
+ * @file mcslock.h
+ *
+ * MCS queue locks.
+ *
+ * Busy-waiting locks for critical sections that are contended
+ * by many processors. Each waiting processor spins on a flag in
+ * its own queue node rather than on the lock itself, the release
+ * of the lock thus only disturbs the cache of the next waiter.
+ * The queue node is supplied by the caller, typically on the
+ * stack, and must stay valid until the lock is released.
+ *
+ * Like spinlocks, MCS locks do not disable interrupts,
+ * use the irqsave variants where necessary.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2016
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef MCSLOCK_H_
+#define MCSLOCK_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/atomic.h>
+
+
+/** Queue node of a processor holding or waiting for an MCS lock
+ *
+ */
+struct mcs_node {
+	/** The next waiting processor */
+	struct mcs_node *volatile next;
+	
+	/** The processor keeps waiting while set */
+	volatile bool locked;
+};
+
+
+/** MCS lock control structure
+ *
+ */
+typedef struct {
+	/** The last node in the queue, NULL if the lock is free */
+	atomic_t tail;
+} mcslock_t;
+
+
+/** Static MCS lock initializer */
+#define MCSLOCK_INITIALIZER  { .tail = { 0 } }
+
+/** Macro for more elegant declaration of global MCS locks */
+#define MCSLOCK_DECLARE(name)  mcslock_t name = MCSLOCK_INITIALIZER
+
+
+/** Initialize an MCS lock
+ *
+ * @param lock The lock to initialize.
+ *
+ */
+static inline void mcslock_init (mcslock_t *lock)
+{
+	atomic_set (&lock->tail, 0);
+}
+
+
+/** Acquire an MCS lock
+ *
+ * Append the node to the queue and spin on it until
+ * the previous holder of the lock hands the lock over.
+ *
+ * @param lock The lock to acquire.
+ * @param node Queue node of the caller.
+ *
+ */
+static inline void mcslock_lock (mcslock_t *lock, struct mcs_node *node)
+{
+	node->next = NULL;
+	node->locked = true;
+	
+	struct mcs_node *prev =
+	    (struct mcs_node *) atomic_swap (&lock->tail, (native_t) node);
+	
+	if (prev != NULL) {
+		prev->next = node;
+		while (node->locked);
+	}
+	
+	/* Do not let the critical section run ahead of the lock. */
+	memory_barrier ();
+}
+
+
+/** Release an MCS lock
+ *
+ * Hand the lock over to the next node in the queue. If there
+ * is none, the lock is released, unless a processor is just
+ * appending its node, which is then waited for.
+ *
+ * @param lock The lock to release.
+ * @param node Queue node used to acquire the lock.
+ *
+ */
+static inline void mcslock_unlock (mcslock_t *lock, struct mcs_node *node)
+{
+	/* Publish the critical section before releasing the lock. */
+	memory_barrier ();
+	
+	if (node->next == NULL) {
+		if (atomic_cas (&lock->tail, (native_t) node, 0))
+			return;
+		
+		while (node->next == NULL);
+	}
+	
+	node->next->locked = false;
+}
+
+
+/** Disable interrupts and acquire an MCS lock
+ *
+ * @param lock The lock to acquire.
+ * @param node Queue node of the caller.
+ *
+ * @return The previous interrupt state for mcslock_unlock_irqrestore().
+ *
+ */
+static inline ipl_t mcslock_lock_irqsave (mcslock_t *lock,
+    struct mcs_node *node)
+{
+	ipl_t state = query_and_disable_interrupts ();
+	mcslock_lock (lock, node);
+	return state;
+}
+
+
+/** Release an MCS lock and restore interrupts
+ *
+ * @param lock  The lock to release.
+ * @param node  Queue node used to acquire the lock.
+ * @param state The interrupt state returned by mcslock_lock_irqsave().
+ *
+ */
+static inline void mcslock_unlock_irqrestore (mcslock_t *lock,
+    struct mcs_node *node, ipl_t state)
+{
+	mcslock_unlock (lock, node);
+	conditionally_enable_interrupts (state);
+}
+
+
+#endif /* MCSLOCK_H_ */
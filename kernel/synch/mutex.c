@@ -3,6 +3,20 @@
  *
  * Mutexes.
  *
+ * A thread which finds the mutex owned by a thread running on
+ * another CPU spins for a while, expecting the owner to release
+ * the mutex soon, which spares the two context switches of going
+ * to sleep and being woken up. A thread which finds the owner
+ * sleeping or preempted, or which spins for too long, goes to
+ * sleep in the wait queue of the mutex. The mutex is handed over
+ * directly to the sleeping thread with the highest priority on unlock.
+ *
+ * The owner of a mutex inherits the priority of the threads waiting
+ * for it. When the owner itself waits for another mutex, the priority
+ * propagates along the chain of owners, so that a thread with a high
+ * priority never waits for a thread preempted by a thread with
+ * a medium priority.
+ *
  * Kalisto
  *
  * Copyright (c) 2001-2015
@@ -17,24 +31,53 @@
 #include <include/c.h>
 
 #include <lib/debug.h>
+#include <sched/sched.h>
+#include <drivers/dorder.h>
+#include <drivers/timer.h>
 
 #include <synch/mutex.h>
 
 
-/** Initialize a mutex
+/** Lock protecting the priority inheritance state
+ *
+ * Protects the blocked_on and held_mutexes members of all threads
+ * and the held_link member of all mutexes. Ownership changes of
+ * mutexes with waiting threads also happen with the lock held.
+ * The lock nests inside mutex locks and outside run queue locks.
+ *
+ */
+static SPINLOCK_DECLARE (mutex_pi_lock);
+
+
+/** Initialize a mutex of a lock class
  *
  * Initialize a mutex to the unlocked state.
+ * The mutex is adaptive by default.
  *
- * @param mtx Mutex to initialize.
+ * @param mtx   Mutex to initialize.
+ * @param class Lock class of the mutex.
  *
  */
-void mutex_init (struct mutex *mtx)
+void mutex_init_class (struct mutex *mtx, struct lock_class *class)
 {
 	assert (mtx != NULL);
+	assert (class != NULL);
 	
+	spinlock_init (&mtx->lock);
 	mtx->owner = NULL;
+	mtx->adaptive = true;
 	mtx->num_waiting = 0;
-	plist_init (&mtx->wait_queue);
+	list_init (&mtx->wait_queue);
+	link_init (&mtx->held_link);
+	
+	mtx->stats.locked = 0;
+	mtx->stats.contended = 0;
+	mtx->stats.spun = 0;
+	mtx->stats.slept = 0;
+	
+	lockstat_register (class);
+	mtx->class = class;
+	mtx->acquired = 0;
 }
 
 
@@ -56,11 +99,192 @@ void mutex_destroy (struct mutex *mtx)
 }
 
 
+/** Enable or disable spinning on a mutex
+ *
+ * A mutex which is not adaptive puts the locking thread
+ * to sleep whenever the mutex is owned.
+ *
+ * @param mtx      Mutex to configure.
+ * @param adaptive Spin while the owner is running on another CPU.
+ *
+ */
+void mutex_set_adaptive (struct mutex *mtx, bool adaptive)
+{
+	assert (mtx != NULL);
+	
+	mtx->adaptive = adaptive;
+}
+
+
+/** Get the contention statistics of a mutex
+ *
+ * @param mtx   Mutex to get the statistics for.
+ * @param stats Storage for the statistics.
+ *
+ */
+void mutex_get_stats (struct mutex *mtx, struct mutex_stats *stats)
+{
+	assert (mtx != NULL);
+	
+	ipl_t state = spinlock_lock_irqsave (&mtx->lock);
+	*stats = mtx->stats;
+	spinlock_unlock_irqrestore (&mtx->lock, state);
+}
+
+
+/** Check whether a thread is running on another CPU
+ *
+ * The thread is not locked, the result is only a hint.
+ *
+ * @param thread Thread to check.
+ *
+ * @return True if the thread is running on a CPU other
+ *         than the current one.
+ *
+ */
+static bool mutex_owner_running (thread_t thread)
+{
+	unsigned int cpu = thread->cpu;
+	
+	return ((cpu < MAX_CPU) && (cpu != cpuid ()) &&
+	    (per_cpu (current_thread, cpu) == thread));
+}
+
+
+/** Spin while a mutex is owned by a running thread
+ *
+ * @param mtx   Mutex to spin on.
+ * @param owner The owner of the mutex when it was found owned.
+ *
+ * @return True if the mutex has been released meanwhile.
+ *
+ */
+static bool mutex_spin (struct mutex *mtx, thread_t owner)
+{
+	unative_t start = timer_get ();
+	
+	while (mtx->owner == owner) {
+		if ((!mutex_owner_running (owner)) ||
+		    (timer_get () - start >= MUTEX_SPIN_TICKS))
+			return false;
+	}
+	
+	return true;
+}
+
+
+/** Compute the effective priority of a thread
+ *
+ * Must be called with mutex_pi_lock held.
+ *
+ * @param thread Thread to compute the priority for.
+ *
+ * @return The maximum of the base priority of the thread and
+ *         the priorities of the threads waiting for its mutexes.
+ *
+ */
+static unsigned int mutex_pi_compute (thread_t thread)
+{
+	unsigned int priority = thread->base_priority;
+	
+	list_foreach (thread->held_mutexes, struct mutex, held_link, mtx) {
+		list_foreach (mtx->wait_queue, struct thread, wait_queue_link,
+		    waiter) {
+			if (waiter->priority > priority)
+				priority = waiter->priority;
+		}
+	}
+	
+	return priority;
+}
+
+
+/** Propagate a priority change along a chain of mutex owners
+ *
+ * Recompute the effective priority of a thread. If it changes and
+ * the thread waits for a mutex, the owner of that mutex is updated
+ * as well, and so on.
+ *
+ * Must be called with mutex_pi_lock held.
+ *
+ * @param thread Thread whose priority might have changed.
+ *
+ */
+static void mutex_pi_adjust (thread_t thread)
+{
+	while (thread != NULL) {
+		unsigned int priority = mutex_pi_compute (thread);
+		if (priority == thread->priority)
+			break;
+		
+		sched_set_priority (thread, priority);
+		
+		if (thread->blocked_on != NULL)
+			thread = thread->blocked_on->owner;
+		else
+			thread = NULL;
+	}
+}
+
+
+/** Take the waiting thread with the highest priority
+ *
+ * Must be called with the mutex and mutex_pi_lock held.
+ *
+ * @param mtx Mutex with at least one waiting thread.
+ *
+ * @return The first waiting thread among those with
+ *         the highest priority.
+ *
+ */
+static thread_t mutex_pi_pick (struct mutex *mtx)
+{
+	thread_t best = NULL;
+	
+	list_foreach (mtx->wait_queue, struct thread, wait_queue_link,
+	    waiter) {
+		if ((best == NULL) || (waiter->priority > best->priority))
+			best = waiter;
+	}
+	
+	assert (best != NULL);
+	
+	list_remove (&best->wait_queue_link);
+	best->blocked_on = NULL;
+	
+	return best;
+}
+
+
+/** Set the base priority of a thread
+ *
+ * The effective priority of the thread does not drop below
+ * the priorities inherited from the threads waiting for its
+ * mutexes. The change propagates to the owner of the mutex
+ * the thread is waiting for.
+ *
+ * @param thread   Thread to set the priority for.
+ * @param priority The new base priority.
+ *
+ */
+void mutex_pi_set_priority (thread_t thread, unsigned int priority)
+{
+	ipl_t state = spinlock_lock_irqsave (&mutex_pi_lock);
+	
+	thread->base_priority = priority;
+	mutex_pi_adjust (thread);
+	
+	spinlock_unlock_irqrestore (&mutex_pi_lock, state);
+}
+
+
 /** Lock a mutex.
  *
- * Attempt to lock a mutex. If the mutex is already owned by
- * a thread, the current thread is put to sleep until the original
- * owner releases the mutex and wakes it up.
+ * Attempt to lock a mutex. If the mutex is already owned by a thread
+ * running on another CPU, spin until the owner releases the mutex.
+ * Otherwise the current thread is put to sleep until the original
+ * owner releases the mutex and wakes it up. The owner inherits
+ * the priority of the current thread meanwhile.
  *
  * @param mtx Mutex to lock.
  *
@@ -69,73 +293,227 @@ void mutex_lock (struct mutex *mtx)
 {
 	assert (mtx != NULL);
 	
-	// TODO: Make sure the rest of the function is
-	//       executing atomically (on a single CPU).
+	thread_t current = thread_get_current ();
+	unative_t start = lockstat_timestamp ();
+	bool contended = false;
+	bool spun = false;
 	
-	if (mtx->owner) {
+	ipl_t state = spinlock_lock_irqsave (&mtx->lock);
+	mtx->stats.locked++;
+	
+	while (mtx->owner != NULL) {
+		if (!contended) {
+			mtx->stats.contended++;
+			contended = true;
+		}
+		
+		thread_t owner = mtx->owner;
+		assert (owner != current);
 		
-		// TODO: Someone is already holding the mutex.
-		//       Add current thread to the wait queue and
-		//       put it to sleep.
+		/*
+		 * Spin once per lock attempt, only with interrupts enabled
+		 * so that the CPU can still be preempted meanwhile.
+		 */
+		if ((mtx->adaptive) && (!spun) && (state) &&
+		    (mutex_owner_running (owner))) {
+			spinlock_unlock_irqrestore (&mtx->lock, state);
+			spun = mutex_spin (mtx, owner);
+			state = spinlock_lock_irqsave (&mtx->lock);
+			
+			if (spun)
+				continue;
+			
+			spun = true;
+			if (mtx->owner == NULL)
+				break;
+		}
 		
+		/*
+		 * Go to sleep. The mutex is handed over to the
+		 * current thread by mutex_unlock() before it is
+		 * woken up.
+		 */
+		spinlock_lock (&mutex_pi_lock);
+		
+		list_append (&mtx->wait_queue, &current->wait_queue_link);
 		mtx->num_waiting++;
-	} else {
-		mtx->owner = thread_get_current ();
+		mtx->stats.slept++;
+		
+		current->blocked_on = mtx;
+		if (!link_connected (&mtx->held_link))
+			list_append (&owner->held_mutexes, &mtx->held_link);
+		
+		mutex_pi_adjust (owner);
+		spinlock_unlock (&mutex_pi_lock);
+		
+		current->state = THREAD_SLEEPING;
+		sched_remove (current);
+		
+		spinlock_unlock (&mtx->lock);
+		schedule ();
+		
+		assert (mtx->owner == current);
+		
+		mtx->acquired = lockstat_timestamp ();
+		if (start != 0) {
+			lockstat_acquired (mtx->class, true, start,
+			    mtx->acquired);
+		}
+		
+		conditionally_enable_interrupts (state);
+		return;
 	}
+	
+	if ((contended) && (spun))
+		mtx->stats.spun++;
+	
+	mtx->owner = current;
+	
+	mtx->acquired = lockstat_timestamp ();
+	if (start != 0)
+		lockstat_acquired (mtx->class, contended, start, mtx->acquired);
+	
+	spinlock_unlock_irqrestore (&mtx->lock, state);
 }
 
 
-/** Unlock a mutex.
+/** Requeue a sleeping thread onto the wait queue of a mutex
  *
- * Unlock the mutex owned by the current thread. If there is
- * a thread waiting for the mutex, then pass the ownership
- * to that thread and wake it up.
+ * Used by condition variables to move a signalled thread directly
+ * to the wait queue of the mutex it is going to lock, instead of
+ * waking it up only to find the mutex owned by the signalling
+ * thread. The mutex is handed over to the thread by mutex_unlock().
  *
- * If the mutex is being unlocked by a different thread than
- * the owner then trigger a kernel panic.
+ * The thread must be sleeping and must not own the mutex.
+ *
+ * @param mtx    Mutex to requeue the thread onto.
+ * @param thread Thread to requeue.
+ *
+ * @return True if the thread has been requeued, false if the mutex
+ *         is not owned and the thread should be woken up instead.
+ *
+ */
+bool mutex_requeue (struct mutex *mtx, thread_t thread)
+{
+	assert (mtx != NULL);
+	assert (thread != NULL);
+	
+	ipl_t state = spinlock_lock_irqsave (&mtx->lock);
+	
+	thread_t owner = mtx->owner;
+	if ((owner == NULL) || (owner == thread)) {
+		spinlock_unlock_irqrestore (&mtx->lock, state);
+		return false;
+	}
+	
+	mtx->stats.locked++;
+	mtx->stats.contended++;
+	mtx->stats.slept++;
+	
+	spinlock_lock (&mutex_pi_lock);
+	
+	list_append (&mtx->wait_queue, &thread->wait_queue_link);
+	mtx->num_waiting++;
+	
+	thread->blocked_on = mtx;
+	if (!link_connected (&mtx->held_link))
+		list_append (&owner->held_mutexes, &mtx->held_link);
+	
+	mutex_pi_adjust (owner);
+	spinlock_unlock (&mutex_pi_lock);
+	
+	spinlock_unlock_irqrestore (&mtx->lock, state);
+	return true;
+}
+
+
+/** Unlock a mutex, checking the owner.
+ *
+ * Unlock the mutex owned by the current thread. If there are
+ * threads waiting for the mutex, then pass the ownership to the
+ * one with the highest priority and wake it up. The current
+ * thread gives up the priority inherited through the mutex.
+ *
+ * The owner is checked with the mutex locked, which makes
+ * the function suitable for unlocking on behalf of user space.
  *
  * @param mtx Mutex to unlock.
  *
+ * @return EOK if the mutex was unlocked or was not locked.
+ * @return EPERM if the mutex is owned by another thread.
+ *
  */
-void mutex_unlock (struct mutex *mtx)
+int mutex_unlock_checked (struct mutex *mtx)
 {
 	assert (mtx != NULL);
 	
-	// TODO: Make sure the rest of the function is
-	//       executing atomically (on a single CPU)
+	ipl_t state = spinlock_lock_irqsave (&mtx->lock);
 	
 	if (mtx->owner) {
+		if (mtx->owner != thread_get_current ()) {
+			spinlock_unlock_irqrestore (&mtx->lock, state);
+			return EPERM;
+		}
 		
-		// TODO: Make sure to check that the thread that
-		//       is locking this mutex is the owner of this
-		//       mutex.
+		if (mtx->acquired != 0) {
+			lockstat_released (mtx->class, mtx->acquired);
+			mtx->acquired = 0;
+		}
 		
-		if (! plist_empty (&mtx->wait_queue)) {
+		if (!list_empty (&mtx->wait_queue)) {
 			assert (mtx->num_waiting > 0);
 			
 			/*
-			 * Remove the first list entry from the wait queue.
+			 * Pass the mutex ownership to the waiting thread
+			 * with the highest priority, together with the
+			 * priorities of the remaining waiters.
 			 */
+			spinlock_lock (&mutex_pi_lock);
 			
-			struct plist *item = plist_pop (&mtx->wait_queue);
-			thread_t thread = plist_item (item, struct thread, wait_queue_link);
+			thread_t current = mtx->owner;
+			thread_t thread = mutex_pi_pick (mtx);
 			
-			// TODO: Remove the following line
-			(void) thread;
+			mtx->num_waiting--;
+			mtx->owner = thread;
 			
-			// TODO: Pass mutex ownership to the waiting thread
-			//       and wake up the sleeper.
+			list_remove (&mtx->held_link);
+			if (!list_empty (&mtx->wait_queue)) {
+				list_append (&thread->held_mutexes,
+				    &mtx->held_link);
+			}
 			
-			mtx->num_waiting--;
-		} else {
-			// TODO: Handle the case when nobody is waiting
-			//       on the mutex.
-		}
-		
+			mutex_pi_adjust (thread);
+			mutex_pi_adjust (current);
+			
+			spinlock_unlock (&mutex_pi_lock);
+			thread_wakeup (thread);
+		} else
+			mtx->owner = NULL;
 	} else {
 		/*
 		 * Unlocking a mutex that is not locked.
 		 * Ignoring.
 		 */
 	}
+	
+	spinlock_unlock_irqrestore (&mtx->lock, state);
+	return EOK;
+}
+
+
+/** Unlock a mutex.
+ *
+ * Unlock the mutex owned by the current thread, see
+ * mutex_unlock_checked().
+ *
+ * If the mutex is being unlocked by a different thread than
+ * the owner then trigger a kernel panic.
+ *
+ * @param mtx Mutex to unlock.
+ *
+ */
+void mutex_unlock (struct mutex *mtx)
+{
+	if (mutex_unlock_checked (mtx) != EOK)
+		panic ("Unlocking a mutex owned by another thread.");
 }
@@ -21,14 +21,50 @@
 
 #include <proc/thread.h>
 #include <adt/list.h>
+#include <synch/spinlock.h>
+#include <synch/lockstat.h>
+
+
+/** Maximal time in ticks a thread spins on a mutex
+ *
+ * A thread spins only while the owner of the mutex is running on
+ * another CPU. The limit is in the order of the cost of putting
+ * the thread to sleep and waking it up again.
+ *
+ */
+#define MUTEX_SPIN_TICKS  2000
+
+
+/** Mutex contention statistics.
+ *
+ */
+struct mutex_stats {
+	/** Number of times the mutex was locked */
+	unsigned int locked;
+	
+	/** Number of times the mutex was found owned */
+	unsigned int contended;
+	
+	/** Number of contended locks acquired by spinning */
+	unsigned int spun;
+	
+	/** Number of contended locks acquired after sleeping */
+	unsigned int slept;
+};
 
 
 /** Mutex control structure.
  *
  */
 struct mutex {
+	/** Lock protecting the mutex */
+	spinlock_t lock;
+	
 	/** Current owner of the mutex */
-	thread_t owner;
+	thread_t volatile owner;
+	
+	/** Spin while the owner is running on another CPU */
+	bool adaptive;
 	
 	/** Number of waiting threads */
 	unsigned int num_waiting;
@@ -37,17 +73,52 @@ struct mutex {
 	 *
 	 * Consists of a linked list of threads
 	 * waiting at the mutex. The queue links
-	 * threads via their wait_queue_item member.
+	 * threads via their wait_queue_link member.
 	 */
 	list_t wait_queue;
+	
+	/** Link in the list of mutexes held by the owner
+	 *
+	 * The mutex is only linked while it has waiting threads,
+	 * the owner inherits the priorities of these threads.
+	 */
+	link_t held_link;
+	
+	/** Contention statistics */
+	struct mutex_stats stats;
+	
+	/** Lock class for the lock statistics */
+	struct lock_class *class;
+	
+	/** Acquisition timestamp for the lock statistics */
+	unative_t acquired;
 };
 
 
+/** Initialize a mutex
+ *
+ * The initialization site defines the lock class of the mutex.
+ *
+ * @param mtx Mutex to initialize.
+ *
+ */
+#define mutex_init(mtx) \
+	do { \
+		LOCK_CLASS_DECLARE (__class, mtx); \
+		mutex_init_class ((mtx), &__class); \
+	} while (0)
+
+
 /* Externals are commented with implementation */
-extern void mutex_init (struct mutex *mtx);
+extern void mutex_init_class (struct mutex *mtx, struct lock_class *class);
 extern void mutex_destroy (struct mutex *mtx);
+extern void mutex_set_adaptive (struct mutex *mtx, bool adaptive);
+extern void mutex_get_stats (struct mutex *mtx, struct mutex_stats *stats);
 extern void mutex_lock (struct mutex *mtx);
+extern int mutex_unlock_checked (struct mutex *mtx);
 extern void mutex_unlock (struct mutex *mtx);
+extern bool mutex_requeue (struct mutex *mtx, thread_t thread);
+extern void mutex_pi_set_priority (thread_t thread, unsigned int priority);
 
 
 #endif /* MUTEX_H_ */
@@ -0,0 +1,329 @@
+/**
+ * @file rcu.c
+ *
+ * Read-copy-update.
+ *
+ * Readers of data protected by RCU do not take any lock, they only
+ * keep their CPU from switching threads. Writers publish new versions
+ * of the data and free the old versions only after a grace period,
+ * which ends once every CPU passed through a quiescent state, that is
+ * a point where it cannot be inside a read-side critical section.
+ *
+ * The implementation is quiescent-state-based. A CPU reports a
+ * quiescent state whenever it switches threads and whenever its idle
+ * loop runs. A CPU waiting for an interrupt in the idle loop is not
+ * waited for at all. Deferred callbacks are run by the CPU reporting
+ * a quiescent state after their grace period has completed.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2016
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/debug.h>
+#include <proc/thread.h>
+#include <sched/sched.h>
+#include <drivers/dorder.h>
+#include <synch/spinlock.h>
+
+#include <synch/rcu.h>
+
+
+/** Lock protecting the grace period state */
+static SPINLOCK_DECLARE (rcu_lock);
+
+/** Deferred callbacks, ordered by their grace periods */
+static LIST_DECLARE (rcu_callbacks);
+
+/** Number of the last grace period started */
+static unsigned int rcu_started = 0;
+
+/** Number of the last grace period completed */
+static unsigned int rcu_completed = 0;
+
+/** CPUs taking part in grace periods */
+static cpumask_t rcu_online = 0;
+
+/** CPUs waiting for an interrupt in the idle loop */
+static cpumask_t rcu_idle = 0;
+
+/** CPUs yet to report a quiescent state in the current grace period */
+static volatile cpumask_t rcu_pending = 0;
+
+/** Some deferred callbacks might be ready to run */
+static volatile bool rcu_ready = false;
+
+
+/** Thread waiting in synchronize_rcu().
+ *
+ */
+struct rcu_sync {
+	/** Deferred callback */
+	struct rcu_head head;
+	
+	/** Waiting thread */
+	thread_t thread;
+	
+	/** The grace period has completed */
+	bool done;
+};
+
+
+/** Check whether a grace period has completed
+ *
+ * Must be called with rcu_lock held.
+ *
+ * @param gp Number of the grace period.
+ *
+ * @return True if the grace period has completed.
+ *
+ */
+static inline bool rcu_gp_completed (unsigned int gp)
+{
+	return ((native_t) (rcu_completed - gp) >= 0);
+}
+
+
+/** Move the grace periods forward
+ *
+ * Complete the current grace period if all CPUs have reported
+ * their quiescent states and start a new one if a deferred
+ * callback is waiting for it.
+ *
+ * Must be called with rcu_lock held.
+ *
+ */
+static void rcu_advance (void)
+{
+	while (true) {
+		if (rcu_started != rcu_completed) {
+			if (rcu_pending != 0)
+				return;
+			
+			rcu_completed = rcu_started;
+			if (!list_empty (&rcu_callbacks))
+				rcu_ready = true;
+		}
+		
+		if (list_empty (&rcu_callbacks))
+			return;
+		
+		/* The last callback waits for the latest grace period. */
+		struct rcu_head *last = list_item (rcu_callbacks.head.prev,
+		    struct rcu_head, link);
+		if (rcu_gp_completed (last->gp))
+			return;
+		
+		rcu_started++;
+		rcu_pending = rcu_online & ~rcu_idle;
+	}
+}
+
+
+/** Report a quiescent state of a CPU
+ *
+ * Must be called with rcu_lock held.
+ *
+ * @param cpu The CPU reporting the quiescent state.
+ *
+ */
+static void rcu_report (unsigned int cpu)
+{
+	rcu_pending &= ~CPUMASK_CPU (cpu);
+	rcu_advance ();
+}
+
+
+/** Let a CPU take part in grace periods
+ *
+ * @param cpu The CPU coming online.
+ *
+ */
+void rcu_cpu_online (unsigned int cpu)
+{
+	ipl_t state = spinlock_lock_irqsave (&rcu_lock);
+	rcu_online |= CPUMASK_CPU (cpu);
+	spinlock_unlock_irqrestore (&rcu_lock, state);
+}
+
+
+/** Report a quiescent state of the current CPU
+ *
+ * Called by the scheduler when switching threads and from the
+ * idle loop. Runs the deferred callbacks whose grace periods have
+ * completed. The callbacks run with interrupts disabled and must
+ * not sleep.
+ *
+ * Must not be called inside a read-side critical section.
+ *
+ */
+void rcu_quiescent_state (void)
+{
+	unsigned int cpu = cpuid ();
+	
+	/* Fast path, nothing to report and nothing to run. */
+	if (((rcu_pending & CPUMASK_CPU (cpu)) == 0) && (!rcu_ready))
+		return;
+	
+	list_t ready;
+	list_init (&ready);
+	
+	ipl_t state = query_and_disable_interrupts ();
+	spinlock_lock (&rcu_lock);
+	
+	rcu_report (cpu);
+	
+	while (!list_empty (&rcu_callbacks)) {
+		struct rcu_head *head = list_item (rcu_callbacks.head.next,
+		    struct rcu_head, link);
+		if (!rcu_gp_completed (head->gp))
+			break;
+		
+		list_remove (&head->link);
+		list_append (&ready, &head->link);
+	}
+	
+	rcu_ready = false;
+	spinlock_unlock (&rcu_lock);
+	
+	link_t *link;
+	while ((link = list_pop (&ready)) != NULL) {
+		struct rcu_head *head = list_item (link, struct rcu_head, link);
+		head->func (head);
+	}
+	
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Enter the idle state on the current CPU
+ *
+ * A CPU in the idle state is not waited for by grace periods.
+ * The state must be left with rcu_idle_exit() before entering
+ * a read-side critical section, interrupt handlers running
+ * in the idle state must therefore not use RCU.
+ *
+ * Must be called with interrupts disabled.
+ *
+ * @return True if the idle state was entered.
+ * @return False if there are deferred callbacks to run,
+ *         the CPU should call rcu_quiescent_state() instead
+ *         of going idle.
+ *
+ */
+bool rcu_idle_enter (void)
+{
+	unsigned int cpu = cpuid ();
+	
+	spinlock_lock (&rcu_lock);
+	
+	rcu_idle |= CPUMASK_CPU (cpu);
+	rcu_report (cpu);
+	
+	bool idle = !rcu_ready;
+	if (!idle)
+		rcu_idle &= ~CPUMASK_CPU (cpu);
+	
+	spinlock_unlock (&rcu_lock);
+	
+	return idle;
+}
+
+
+/** Leave the idle state on the current CPU
+ *
+ * Must be called with interrupts disabled.
+ *
+ */
+void rcu_idle_exit (void)
+{
+	spinlock_lock (&rcu_lock);
+	rcu_idle &= ~CPUMASK_CPU (cpuid ());
+	spinlock_unlock (&rcu_lock);
+}
+
+
+/** Defer a callback until after a grace period
+ *
+ * The callback is called once all the read-side critical
+ * sections running at the time of the call have finished.
+ *
+ * @param head Deferred callback control structure.
+ * @param func Callback function.
+ *
+ */
+void call_rcu (struct rcu_head *head, rcu_callback_t func)
+{
+	assert (head != NULL);
+	
+	head->func = func;
+	
+	ipl_t state = spinlock_lock_irqsave (&rcu_lock);
+	
+	/*
+	 * A grace period in progress might have started before
+	 * the current readers, the next one has to complete.
+	 */
+	head->gp = rcu_started + 1;
+	list_append (&rcu_callbacks, &head->link);
+	rcu_advance ();
+	
+	spinlock_unlock_irqrestore (&rcu_lock, state);
+}
+
+
+/** Wake up a thread waiting in synchronize_rcu()
+ *
+ * @param head Deferred callback of the waiting thread.
+ *
+ */
+static void rcu_sync_wakeup (struct rcu_head *head)
+{
+	struct rcu_sync *sync = list_container_of (head, struct rcu_sync, head);
+	
+	spinlock_lock (&rcu_lock);
+	sync->done = true;
+	thread_wakeup (sync->thread);
+	spinlock_unlock (&rcu_lock);
+}
+
+
+/** Wait for a grace period
+ *
+ * Suspend the current thread until all the read-side critical
+ * sections running at the time of the call have finished.
+ *
+ * Must not be called inside a read-side critical section.
+ *
+ */
+void synchronize_rcu (void)
+{
+	thread_t current = thread_get_current ();
+	struct rcu_sync sync;
+	
+	sync.thread = current;
+	sync.done = false;
+	
+	call_rcu (&sync.head, rcu_sync_wakeup);
+	
+	ipl_t state = spinlock_lock_irqsave (&rcu_lock);
+	
+	while (!sync.done) {
+		current->state = THREAD_SLEEPING;
+		sched_remove (current);
+		
+		spinlock_unlock (&rcu_lock);
+		schedule ();
+		spinlock_lock (&rcu_lock);
+	}
+	
+	spinlock_unlock_irqrestore (&rcu_lock, state);
+}
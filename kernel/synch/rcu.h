@@ -0,0 +1,85 @@
+/**
+ * @file rcu.h
+ *
+ * Read-copy-update.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2016
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef RCU_H_
+#define RCU_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/list.h>
+
+
+/** Forward declaration */
+struct rcu_head;
+
+
+/** Deferred callback, called after a grace period */
+typedef void (* rcu_callback_t) (struct rcu_head *head);
+
+
+/** Deferred callback control structure.
+ *
+ * Usually embedded in the structure freed by the callback.
+ *
+ */
+struct rcu_head {
+	/** Link in the list of pending callbacks */
+	link_t link;
+	
+	/** Callback function */
+	rcu_callback_t func;
+	
+	/** Grace period which has to complete before the callback */
+	unsigned int gp;
+};
+
+
+/** Enter a read-side critical section
+ *
+ * The thread must not be switched out inside the section,
+ * interrupts are therefore disabled. This is cheap and
+ * does not write to any shared data.
+ *
+ * @return The previous interrupt state.
+ *
+ */
+static inline ipl_t rcu_read_lock (void)
+{
+	return query_and_disable_interrupts ();
+}
+
+
+/** Leave a read-side critical section
+ *
+ * @param state The interrupt state returned by rcu_read_lock().
+ *
+ */
+static inline void rcu_read_unlock (ipl_t state)
+{
+	conditionally_enable_interrupts (state);
+}
+
+
+/* Externals are commented with implementation */
+extern void rcu_cpu_online (unsigned int cpu);
+extern void rcu_quiescent_state (void);
+extern bool rcu_idle_enter (void);
+extern void rcu_idle_exit (void);
+extern void call_rcu (struct rcu_head *head, rcu_callback_t func);
+extern void synchronize_rcu (void);
+
+
+#endif /* RCU_H_ */
@@ -21,21 +21,20 @@
 #include <synch/rmutex.h>
 
 
-/** Initialize a recursive mutex
+/** Initialize a recursive mutex of a lock class
  *
  * Initialize a recursive mutex to the unlocked state.
  *
- * @param mtx Recursive mutex to initialize.
+ * @param mtx   Recursive mutex to initialize.
+ * @param class Lock class of the recursive mutex.
  *
  */
-void rmutex_init (struct rmutex *mtx)
+void rmutex_init_class (struct rmutex *mtx, struct lock_class *class)
 {
 	assert (mtx != NULL);
 	
-	mtx->owner = NULL;
+	mutex_init_class (&mtx->mutex, class);
 	mtx->num_locked = 0;
-	mtx->num_waiting = 0;
-	list_init (&mtx->wait_queue);
 }
 
 
@@ -51,7 +50,7 @@ void rmutex_destroy (struct rmutex *mtx)
 {
 	assert (mtx != NULL);
 	
-	if (mtx->owner) {
+	if (mtx->mutex.owner) {
 		panic ("Request to destroy a locked recursive mutex.");
 	}
 }
@@ -74,25 +73,17 @@ void rmutex_lock (struct rmutex *mtx)
 {
 	assert (mtx != NULL);
 	
-	// TODO: Make sure the rest of the function is
-	//       executing atomically (on a single CPU).
-	
-	if (mtx->owner) {
-		thread_t thread = thread_get_current ();
-		
-		if (mtx->owner == thread) {
-			// TODO: Someone is already holding the mutex.
-			//       Handle the case when it is the same thread.
-		} else {
-			// TODO: Someone is already holding the mutex.
-			//       Add current thread to the wait queue and
-			//       put it to sleep.
-			mtx->num_waiting++;
-		}
-	} else {
-		mtx->owner = thread_get_current ();
-		mtx->num_locked = 1;
+	/*
+	 * Only the current thread can make itself the owner,
+	 * the check does not need the mutex lock.
+	 */
+	if (mtx->mutex.owner == thread_get_current ()) {
+		mtx->num_locked++;
+		return;
 	}
+	
+	mutex_lock (&mtx->mutex);
+	mtx->num_locked = 1;
 }
 
 
@@ -113,43 +104,16 @@ void rmutex_unlock (struct rmutex *mtx)
 {
 	assert (mtx != NULL);
 	
-	// TODO: Make sure the rest of the function is
-	//       executing atomically (on a single CPU)
-	
-	if (mtx->owner) {
-		assert (mtx->num_locked > 0);
+	if (mtx->mutex.owner) {
+		if (mtx->mutex.owner != thread_get_current ())
+			panic ("Unlocking a recursive mutex owned by "
+			    "another thread.");
 		
-		// TODO: Make sure to check that the thread that
-		//       is locking this mutex is the owner of this
-		//       mutex.
+		assert (mtx->num_locked > 0);
 		
 		mtx->num_locked--;
-		
-		if (mtx->num_locked == 0) {
-			link_t *link = list_pop (&mtx->wait_queue);
-			if (link != NULL) {
-				assert (mtx->num_waiting > 0);
-				
-				/*
-				 * Remove the first list entry from the wait queue.
-				 */
-				
-				thread_t thread = list_item (link, struct thread, wait_queue_link);
-				
-				// TODO: Remove the following line
-				(void) thread;
-				
-				// TODO: Pass mutex ownership to the waiting thread
-				//       and wake up the sleeper. Make sure to set
-				//       the correct value of mtx->num_locked.
-				
-				mtx->num_waiting--;
-			} else {
-				// TODO: Handle the case when nobody is waiting
-				//       on the mutex.
-			}
-		}
-		
+		if (mtx->num_locked == 0)
+			mutex_unlock (&mtx->mutex);
 	} else {
 		/*
 		 * Unlocking a mutex that is not locked.
@@ -20,34 +20,40 @@
 #include <include/c.h>
 
 #include <proc/thread.h>
-#include <adt/list.h>
+#include <synch/mutex.h>
 
 
 /** Recursive mutex control structure.
+ *
+ * The recursive mutex is built on top of a mutex, which provides
+ * the waiting and the priority inheritance.
  *
  */
 struct rmutex {
-	/** Current owner of the recursive mutex */
-	thread_t owner;
+	/** Underlying mutex */
+	struct mutex mutex;
 	
-	/** Lock count */
+	/** Lock count, only accessed by the owner */
 	unsigned int num_locked;
-	
-	/** Number of waiting threads */
-	unsigned int num_waiting;
-	
-	/** Mutex wait queue.
-	 *
-	 * Consists of a linked list of threads
-	 * waiting at the mutex. The queue links
-	 * threads via their wait_queue_item member.
-	 */
-	list_t wait_queue;
 };
 
 
+/** Initialize a recursive mutex
+ *
+ * The initialization site defines the lock class of the mutex.
+ *
+ * @param mtx Recursive mutex to initialize.
+ *
+ */
+#define rmutex_init(mtx) \
+	do { \
+		LOCK_CLASS_DECLARE (__class, mtx); \
+		rmutex_init_class ((mtx), &__class); \
+	} while (0)
+
+
 /* Externals are commented with implementation */
-extern void rmutex_init (struct rmutex *mtx);
+extern void rmutex_init_class (struct rmutex *mtx, struct lock_class *class);
 extern void rmutex_destroy (struct rmutex *mtx);
 extern void rmutex_lock (struct rmutex *mtx);
 extern void rmutex_unlock (struct rmutex *mtx);
@@ -21,23 +21,30 @@
 #include <synch/rwlock.h>
 
 
-/** Initialize a read/write lock
+/** Initialize a read/write lock of a lock class
  *
  * Initialize a read/write lock. There are obviously
  * no waiting readers or writers.
  *
- * @param rwl Read/write lock to initialize.
+ * @param rwl   Read/write lock to initialize.
+ * @param class Lock class of the read/write lock.
  *
  */
-void rwlock_init (struct rwlock *rwl)
+void rwlock_init_class (struct rwlock *rwl, struct lock_class *class)
 {
 	assert (rwl != NULL);
+	assert (class != NULL);
 	
-	// TODO: Initialize the control structure members
-	//       to sane initial values.
+	spinlock_init (&rwl->lock);
+	rwl->state = RWLOCK_UNLOCKED;
+	rwl->num_readers = 0;
+	
+	waitqueue_init (&rwl->read_wait_queue, &rwl->lock, WAITQUEUE_FIFO);
+	waitqueue_init (&rwl->write_wait_queue, &rwl->lock, WAITQUEUE_FIFO);
 	
-	list_init (&rwl->read_wait_queue);
-	list_init (&rwl->write_wait_queue);
+	lockstat_register (class);
+	rwl->class = class;
+	rwl->acquired = 0;
 }
 
 
@@ -57,29 +64,9 @@ void rwlock_destroy (struct rwlock *rwl)
 	if (rwl->state != RWLOCK_UNLOCKED) {
 		panic ("Attempt to destroy a read/write lock in use\n");
 	}
-}
-
-
-/** Wake up a waiting thread from a wait queue
- *
- * Wake up a single thread from the given wait queue and
- * decreate the variable indicating the number of waiting
- * threads.
- *
- * The purpose of this function is to avoid code repetition.
- *
- * This must be called with disabled interrupts.
- *
- * @param wait_queue  Pointer to a wait queue containing sleeping
- *                    threads.
- * @param num_waiting Pointer to a variable containing the number
- *                    of sleeping threads.
- *
- */
-static void rwlock_wakeup (list_t *wait_queue, unsigned int *num_waiting)
-{
-	// TODO: If the wait queue is not empty, then wake up the first
-	//       thread in the wait queue and decrement num_waiting
+	
+	waitqueue_destroy (&rwl->read_wait_queue);
+	waitqueue_destroy (&rwl->write_wait_queue);
 }
 
 
@@ -97,18 +84,23 @@ void rwlock_write_lock (struct rwlock *rwl)
 {
 	assert (rwl != NULL);
 	
-	// TODO: Execute the rest of the function with disabled interrupts
+	unative_t start = lockstat_timestamp ();
+	bool contended = false;
+	
+	ipl_t state = spinlock_lock_irqsave (&rwl->lock);
 	
 	while (rwl->state != RWLOCK_UNLOCKED) {
-		thread_t thread = thread_get_current ();
-		
-		list_append (&rwl->write_wait_queue, &thread->wait_queue_link);
-		rwl->num_write_waiting++;
-		
-		thread_suspend ();
+		waitqueue_wait (&rwl->write_wait_queue, WAITER_EXCLUSIVE);
+		contended = true;
 	}
 	
 	rwl->state = RWLOCK_LOCKED_WRITE;
+	
+	rwl->acquired = lockstat_timestamp ();
+	if (start != 0)
+		lockstat_acquired (rwl->class, contended, start, rwl->acquired);
+	
+	spinlock_unlock_irqrestore (&rwl->lock, state);
 }
 
 
@@ -125,18 +117,27 @@ void rwlock_write_unlock (struct rwlock *rwl)
 {
 	assert (rwl != NULL);
 	
-	// TODO: Execute the rest of the function with disabled interrupts
+	ipl_t state = spinlock_lock_irqsave (&rwl->lock);
 	
 	if (rwl->state != RWLOCK_LOCKED_WRITE) {
 		panic ("Attempt to unlock a read/write lock not locked for writing\n");
 	}
 	
+	if (rwl->acquired != 0) {
+		lockstat_released (rwl->class, rwl->acquired);
+		rwl->acquired = 0;
+	}
+	
 	rwl->state = RWLOCK_UNLOCKED;
 	
-	// TODO: First, wake up any waiting writer to avoid writer
-	//       starvation.
+	/*
+	 * First, wake up a waiting writer to avoid writer
+	 * starvation, then all the waiting readers.
+	 */
+	waitqueue_wake_one (&rwl->write_wait_queue);
+	waitqueue_wake_all (&rwl->read_wait_queue);
 	
-	// TODO: Wake up all waiting readers.
+	spinlock_unlock_irqrestore (&rwl->lock, state);
 }
 
 
@@ -152,10 +153,33 @@ void rwlock_write_unlock (struct rwlock *rwl)
  */
 void rwlock_read_lock (struct rwlock *rwl)
 {
-	// TODO: Execute the rest of the function with disabled interrupts.
-	//
-	//       Suspend the current thread while the lock is being owned
-	//       exclusively by a writer. Otherwise let the reader in.
+	assert (rwl != NULL);
+	
+	unative_t start = lockstat_timestamp ();
+	bool contended = false;
+	
+	ipl_t state = spinlock_lock_irqsave (&rwl->lock);
+	
+	while (rwl->state == RWLOCK_LOCKED_WRITE) {
+		waitqueue_wait (&rwl->read_wait_queue, WAITER_SHARED);
+		contended = true;
+	}
+	
+	/*
+	 * The hold time of the readers is measured from
+	 * the first reader entering to the last one leaving.
+	 */
+	unative_t now = lockstat_timestamp ();
+	if (rwl->num_readers == 0)
+		rwl->acquired = now;
+	
+	rwl->state = RWLOCK_LOCKED_READ;
+	rwl->num_readers++;
+	
+	if (start != 0)
+		lockstat_acquired (rwl->class, contended, start, now);
+	
+	spinlock_unlock_irqrestore (&rwl->lock, state);
 }
 
 
@@ -173,7 +197,7 @@ void rwlock_read_unlock (struct rwlock *rwl)
 {
 	assert (rwl != NULL);
 	
-	// TODO: Execute the rest of the function with disabled interrupts
+	ipl_t state = spinlock_lock_irqsave (&rwl->lock);
 	
 	if (rwl->state != RWLOCK_LOCKED_READ) {
 		panic ("Attempt to unlock a read/write lock not locked for reading\n");
@@ -188,7 +212,14 @@ void rwlock_read_unlock (struct rwlock *rwl)
 	 * no more readers.
 	 */
 	if (rwl->num_readers == 0) {
+		if (rwl->acquired != 0) {
+			lockstat_released (rwl->class, rwl->acquired);
+			rwl->acquired = 0;
+		}
+		
 		rwl->state = RWLOCK_UNLOCKED;
-		rwlock_wakeup (&rwl->write_wait_queue, &rwl->num_write_waiting);
+		waitqueue_wake_one (&rwl->write_wait_queue);
 	}
+	
+	spinlock_unlock_irqrestore (&rwl->lock, state);
 }
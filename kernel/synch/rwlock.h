@@ -20,7 +20,9 @@
 #include <include/c.h>
 
 #include <proc/thread.h>
-#include <adt/list.h>
+#include <synch/spinlock.h>
+#include <synch/waitqueue.h>
+#include <synch/lockstat.h>
 
 
 /** Read/write lock state.
@@ -49,6 +51,11 @@ enum rwlock_state {
  *
  */
 struct rwlock {
+	/** Lock protecting the read/write lock
+	 *
+	 */
+	spinlock_t lock;
+	
 	/** Current locked state of the read/write lock
 	 *
 	 */
@@ -59,30 +66,45 @@ struct rwlock {
 	 */
 	unsigned int num_readers;
 	
-	/** Number of readers waiting to acquire the lock
+	/** Readers wait queue
 	 *
 	 */
-	unsigned int num_read_waiting;
+	waitqueue_t read_wait_queue;
 	
-	/** Number of writers waiting to acquire the lock
+	/** Writers wait queue
 	 *
 	 */
-	unsigned int num_write_waiting;
+	waitqueue_t write_wait_queue;
 	
-	/** Readers wait queue
+	/** Lock class for the lock statistics
 	 *
 	 */
-	list_t read_wait_queue;
+	struct lock_class *class;
 	
-	/** Writers wait queue
+	/** Timestamp of the writer or of the first reader
+	 * entering the critical section for the lock statistics
 	 *
 	 */
-	list_t write_wait_queue;
+	unative_t acquired;
 };
 
 
+/** Initialize a read/write lock
+ *
+ * The initialization site defines the lock class of the lock.
+ *
+ * @param rwl Read/write lock to initialize.
+ *
+ */
+#define rwlock_init(rwl) \
+	do { \
+		LOCK_CLASS_DECLARE (__class, rwl); \
+		rwlock_init_class ((rwl), &__class); \
+	} while (0)
+
+
 /* Externals are commented with implementation */
-extern void rwlock_init (struct rwlock *rwl);
+extern void rwlock_init_class (struct rwlock *rwl, struct lock_class *class);
 extern void rwlock_destroy (struct rwlock *rwl);
 extern void rwlock_read_lock (struct rwlock *rwl);
 extern void rwlock_write_lock (struct rwlock *rwl);
@@ -0,0 +1,305 @@
+/**
+ * @file sem.c
+ *
+ * Semaphores.
+ *
+ * Threads waiting at a semaphore are served in FIFO order. A thread
+ * may acquire or release several units at once, in which case
+ * a single release wakes up as many waiting threads as the released
+ * units satisfy. A waiting thread is never overtaken by a thread
+ * arriving later, even if the later thread asks for fewer units.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/debug.h>
+#include <sched/sched.h>
+#include <proc/thread.h>
+
+#include <synch/sem.h>
+
+
+/** Initialize a semaphore of a lock class
+ *
+ * @param sem   Semaphore to initialize.
+ * @param value Initial value of the semaphore.
+ * @param limit Maximal value of the semaphore.
+ * @param class Lock class of the semaphore.
+ *
+ */
+void sem_init_class (struct semaphore *sem, const int value,
+    const int limit, struct lock_class *class)
+{
+	assert (sem != NULL);
+	assert (class != NULL);
+	assert ((value >= 0) && (value <= limit));
+	
+	spinlock_init (&sem->lock);
+	sem->value = value;
+	sem->limit = limit;
+	waitqueue_init (&sem->wait_queue, &sem->lock, WAITQUEUE_FIFO);
+	
+	lockstat_register (class);
+	sem->class = class;
+}
+
+
+/** Clean up a semaphore
+ *
+ * Clean up a semaphore. If there are threads still waiting
+ * at the semaphore, then trigger a kernel panic.
+ *
+ * @param sem Semaphore to clean up.
+ *
+ */
+void sem_destroy (struct semaphore *sem)
+{
+	assert (sem != NULL);
+	
+	if (!waitqueue_empty (&sem->wait_queue))
+		panic ("sem_destroy: request to destroy semaphore in use\n");
+}
+
+
+/** Get the value of a semaphore
+ *
+ * @param sem Semaphore to query.
+ *
+ * @return The current value of the semaphore.
+ *
+ */
+int sem_get_value (struct semaphore *sem)
+{
+	assert (sem != NULL);
+	
+	return sem->value;
+}
+
+
+/** Hand the available units over to the waiting threads
+ *
+ * Wake up the threads at the head of the wait queue for as long
+ * as the value of the semaphore satisfies them, all in one pass.
+ *
+ * Must be called with the semaphore locked.
+ *
+ * @param sem Semaphore whose threads to wake up.
+ *
+ */
+static void sem_wakeup (struct semaphore *sem)
+{
+	struct waiter *waiter;
+	
+	while ((waiter = waitqueue_first (&sem->wait_queue)) != NULL) {
+		if (waiter->data > sem->value)
+			break;
+		
+		sem->value -= waiter->data;
+		waitqueue_wake_waiter (&sem->wait_queue, waiter);
+	}
+}
+
+
+/** Release units of a semaphore
+ *
+ * Increment the value of the semaphore by the given number of units
+ * and wake up all the waiting threads the units satisfy. The value
+ * never exceeds the limit of the semaphore, the excess is lost.
+ *
+ * @param sem   Semaphore to release.
+ * @param count Number of units to release.
+ *
+ */
+void sem_up_n (struct semaphore *sem, const int count)
+{
+	assert (sem != NULL);
+	assert (count > 0);
+	
+	ipl_t state = spinlock_lock_irqsave (&sem->lock);
+	
+	sem->value += count;
+	sem_wakeup (sem);
+	
+	if (sem->value > sem->limit)
+		sem->value = sem->limit;
+	
+	spinlock_unlock_irqrestore (&sem->lock, state);
+}
+
+
+/** Release a semaphore
+ *
+ * Increment the value of the semaphore and wake
+ * up a waiting thread if it is satisfied.
+ *
+ * @param sem Semaphore to release.
+ *
+ */
+void sem_up (struct semaphore *sem)
+{
+	sem_up_n (sem, 1);
+}
+
+
+/** Acquire units of a semaphore with a timeout
+ *
+ * The shared functionality of sem_down_n() and sem_down_timeout().
+ *
+ * @param sem   Semaphore to acquire.
+ * @param count Number of units to acquire.
+ * @param usec  Timeout in microseconds, or WAITQUEUE_FOREVER.
+ *
+ * @return EOK if the units were acquired, ETIMEDOUT
+ *         if the timeout expired.
+ *
+ */
+static int sem_sleep (struct semaphore *sem, const int count,
+    const unsigned int usec)
+{
+	assert (sem != NULL);
+	assert ((count > 0) && (count <= sem->limit));
+	
+	int rc = EOK;
+	bool contended = false;
+	
+	unative_t start = lockstat_timestamp ();
+	ipl_t state = spinlock_lock_irqsave (&sem->lock);
+	
+	if ((waitqueue_empty (&sem->wait_queue)) && (sem->value >= count)) {
+		sem->value -= count;
+	} else {
+		/*
+		 * The units are handed over to the waiter by
+		 * sem_wakeup() before it is woken up.
+		 */
+		struct waiter waiter;
+		waiter_init (&waiter, WAITER_EXCLUSIVE, count);
+		
+		rc = waitqueue_sleep (&sem->wait_queue, &waiter, usec);
+		contended = true;
+		
+		/*
+		 * The threads queued behind might be
+		 * satisfied by the current value.
+		 */
+		if (rc == ETIMEDOUT)
+			sem_wakeup (sem);
+	}
+	
+	spinlock_unlock_irqrestore (&sem->lock, state);
+	
+	if ((rc == EOK) && (start != 0)) {
+		lockstat_acquired (sem->class, contended, start,
+		    lockstat_timestamp ());
+	}
+	
+	return rc;
+}
+
+
+/** Acquire units of a semaphore
+ *
+ * Decrement the value of the semaphore by the given number of
+ * units. If the value is not sufficient, or other threads are
+ * already waiting, then the current thread is put to sleep until
+ * the units are handed over to it by sem_up_n().
+ *
+ * @param sem   Semaphore to acquire.
+ * @param count Number of units to acquire.
+ *
+ */
+void sem_down_n (struct semaphore *sem, const int count)
+{
+	sem_sleep (sem, count, WAITQUEUE_FOREVER);
+}
+
+
+/** Acquire a semaphore
+ *
+ * Decrement the value of the semaphore. If the value would
+ * become negative, then the current thread is put to sleep.
+ *
+ * @param sem Semaphore to acquire.
+ *
+ */
+void sem_down (struct semaphore *sem)
+{
+	sem_sleep (sem, 1, WAITQUEUE_FOREVER);
+}
+
+
+/** Acquire a semaphore with a timeout
+ *
+ * Decrement the value of the semaphore. If the value would become
+ * negative, then the current thread is put to sleep for at most
+ * the given number of microseconds.
+ *
+ * @param sem  Semaphore to acquire.
+ * @param usec Timeout in microseconds.
+ *
+ * @return EOK if the semaphore was acquired, ETIMEDOUT
+ *         if the timeout expired.
+ *
+ */
+int sem_down_timeout (struct semaphore *sem, const unsigned int usec)
+{
+	return sem_sleep (sem, 1, usec);
+}
+
+
+/** Try to acquire units of a semaphore
+ *
+ * Decrement the value of the semaphore by the given number
+ * of units if the current value suffices. Never blocks.
+ *
+ * @param sem   Semaphore to acquire.
+ * @param count Number of units to acquire.
+ *
+ * @return EOK if the units were acquired, EAGAIN otherwise.
+ *
+ */
+int sem_try_down_n (struct semaphore *sem, const int count)
+{
+	assert (sem != NULL);
+	assert (count > 0);
+	
+	int rc = EAGAIN;
+	ipl_t state = spinlock_lock_irqsave (&sem->lock);
+	
+	if ((waitqueue_empty (&sem->wait_queue)) && (sem->value >= count)) {
+		sem->value -= count;
+		rc = EOK;
+	}
+	
+	spinlock_unlock_irqrestore (&sem->lock, state);
+	
+	if (rc == EOK) {
+		unative_t now = lockstat_timestamp ();
+		lockstat_acquired (sem->class, false, now, now);
+	}
+	
+	return rc;
+}
+
+
+/** Try to acquire a semaphore
+ *
+ * @param sem Semaphore to acquire.
+ *
+ * @return EOK if the semaphore was acquired, EAGAIN otherwise.
+ *
+ */
+int sem_try_down (struct semaphore *sem)
+{
+	return sem_try_down_n (sem, 1);
+}
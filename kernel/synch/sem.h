@@ -16,13 +16,30 @@
 #define SEM_H_
 
 
+#include <include/shared.h>
+#include <include/c.h>
+
 #include <adt/list.h>
+#include <synch/spinlock.h>
+#include <synch/waitqueue.h>
+#include <synch/lockstat.h>
+
+
+/** Default limit of the semaphore value
+ *
+ */
+#define SEM_VALUE_MAX  0x7fffffff
 
 
 /** Semaphore control structure.
  *
  */
 struct semaphore {
+	/*
+	 * Lock protecting the semaphore.
+	 */
+	spinlock_t lock;
+	
 	/*
 	 * The value of the semaphore.
 	 */
@@ -36,27 +53,59 @@ struct semaphore {
 	int limit;
 	
 	/*
-	 * The number of waiting threads.
+	 * Semaphore wait queue. The threads wait in FIFO
+	 * order, each for the number of units in the data
+	 * member of its waiter.
 	 */
-	unsigned int num_waiting;
+	waitqueue_t wait_queue;
 	
 	/*
-	 * Semaphore wait queue. Consists of a linked list
-	 * of thread waiting at the semaphore. The queue links
-	 * thread via their wq_item member.
+	 * Lock class for the lock statistics.
 	 */
-	list_t wait_queue;
+	struct lock_class *class;
 };
 
 
+/** Initialize a semaphore
+ *
+ * The initialization site defines the lock class of the semaphore.
+ *
+ * @param sem   Semaphore to initialize.
+ * @param value Initial value of the semaphore.
+ *
+ */
+#define sem_init(sem, value) \
+	sem_init_limit ((sem), (value), SEM_VALUE_MAX)
+
+
+/** Initialize a semaphore with a limit
+ *
+ * The initialization site defines the lock class of the semaphore.
+ *
+ * @param sem   Semaphore to initialize.
+ * @param value Initial value of the semaphore.
+ * @param limit Maximal value of the semaphore.
+ *
+ */
+#define sem_init_limit(sem, value, limit) \
+	do { \
+		LOCK_CLASS_DECLARE (__class, sem); \
+		sem_init_class ((sem), (value), (limit), &__class); \
+	} while (0)
+
+
 /* Externals are commented with implementation */
-extern void sem_init (struct semaphore *sem, const int value);
-extern void sem_init_limit (struct semaphore *sem, const int value,
-    const int limit);
+extern void sem_init_class (struct semaphore *sem, const int value,
+    const int limit, struct lock_class *class);
 extern void sem_destroy (struct semaphore *sem);
 extern int sem_get_value (struct semaphore *sem);
 extern void sem_up (struct semaphore *sem);
+extern void sem_up_n (struct semaphore *sem, const int count);
 extern void sem_down (struct semaphore *sem);
+extern void sem_down_n (struct semaphore *sem, const int count);
+extern int sem_try_down (struct semaphore *sem);
+extern int sem_try_down_n (struct semaphore *sem, const int count);
+extern int sem_down_timeout (struct semaphore *sem, const unsigned int usec);
 
 
 #endif /* SEM_H_ */
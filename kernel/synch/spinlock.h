@@ -0,0 +1,158 @@
+/**
+ * @file spinlock.h
+ *
+ * Spinlocks.
+ *
+ * Busy-waiting locks for short critical sections that must provide
+ * mutual exclusion between processors. A spinlock does not disable
+ * interrupts, the caller is expected to do so if the lock can also
+ * be taken from an interrupt handler, or use the irqsave variants.
+ *
+ * The spinlocks are ticket locks. Each processor takes a ticket
+ * and waits until the lock serves its ticket, which grants the lock
+ * in the order of arrival. The waiting processors only read the
+ * lock, its owner only writes it on release.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2016
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef SPINLOCK_H_
+#define SPINLOCK_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/atomic.h>
+
+
+/** Spinlock control structure
+ *
+ */
+typedef struct {
+	/** The next ticket to hand out */
+	atomic_t next;
+	
+	/** The ticket being served */
+	atomic_t owner;
+} spinlock_t;
+
+
+/** Static spinlock initializer */
+#define SPINLOCK_INITIALIZER  { .next = { 0 }, .owner = { 0 } }
+
+/** Macro for more elegant declaration of global spinlocks */
+#define SPINLOCK_DECLARE(name)  spinlock_t name = SPINLOCK_INITIALIZER
+
+
+/** Initialize a spinlock
+ *
+ * @param lock The spinlock to initialize.
+ *
+ */
+static inline void spinlock_init (spinlock_t *lock)
+{
+	atomic_set (&lock->next, 0);
+	atomic_set (&lock->owner, 0);
+}
+
+
+/** Try to acquire a spinlock
+ *
+ * A ticket is only taken if it would be served right away.
+ *
+ * @param lock The spinlock to acquire.
+ *
+ * @return True if the lock has been acquired.
+ *
+ */
+static inline bool spinlock_trylock (spinlock_t *lock)
+{
+	native_t owner = atomic_get (&lock->owner);
+	return atomic_cas (&lock->next, owner, owner + 1);
+}
+
+
+/** Acquire a spinlock
+ *
+ * Take a ticket and spin until it is served.
+ *
+ * @param lock The spinlock to acquire.
+ *
+ */
+static inline void spinlock_lock (spinlock_t *lock)
+{
+	native_t ticket = atomic_post_add (&lock->next, 1);
+	
+	while (atomic_get (&lock->owner) != ticket);
+	
+	/* Do not let the critical section run ahead of the lock. */
+	memory_barrier ();
+}
+
+
+/** Release a spinlock
+ *
+ * Serve the next ticket. Only the holder of the lock
+ * writes the ticket being served.
+ *
+ * @param lock The spinlock to release.
+ *
+ */
+static inline void spinlock_unlock (spinlock_t *lock)
+{
+	/* Publish the critical section before releasing the lock. */
+	memory_barrier ();
+	atomic_set (&lock->owner, atomic_get (&lock->owner) + 1);
+}
+
+
+/** Check whether a spinlock is held
+ *
+ * @param lock The spinlock to check.
+ *
+ * @return True if the lock is held or waited for.
+ *
+ */
+static inline bool spinlock_locked (spinlock_t *lock)
+{
+	return (atomic_get (&lock->next) != atomic_get (&lock->owner));
+}
+
+
+/** Disable interrupts and acquire a spinlock
+ *
+ * @param lock The spinlock to acquire.
+ *
+ * @return The previous interrupt state for spinlock_unlock_irqrestore().
+ *
+ */
+static inline ipl_t spinlock_lock_irqsave (spinlock_t *lock)
+{
+	ipl_t state = query_and_disable_interrupts ();
+	spinlock_lock (lock);
+	return state;
+}
+
+
+/** Release a spinlock and restore interrupts
+ *
+ * @param lock  The spinlock to release.
+ * @param state The interrupt state returned by spinlock_lock_irqsave().
+ *
+ */
+static inline void spinlock_unlock_irqrestore (spinlock_t *lock,
+    ipl_t state)
+{
+	spinlock_unlock (lock);
+	conditionally_enable_interrupts (state);
+}
+
+
+#endif /* SPINLOCK_H_ */
@@ -16,14 +16,54 @@
 #include <include/c.h>
 
 #include <mm/malloc.h>
+#include <mm/vmm.h>
 #include <proc/process.h>
 
 #include <synch/sys_mutex.h>
 
 
+/** Take a reference to a user space mutex
+ *
+ * Called from the handle lookup, the structure is not freed
+ * before the lookup leaves its RCU read-side critical section.
+ *
+ * @param object User space mutex control structure.
+ *
+ * @return False if the mutex is already going away.
+ *
+ */
+static bool umutex_ref (void *object)
+{
+	umutex_t umutex = (umutex_t) object;
+	native_t refcount;
+	
+	do {
+		refcount = atomic_get (&umutex->refcount);
+		if (refcount == 0)
+			return false;
+	} while (!atomic_cas (&umutex->refcount, refcount, refcount + 1));
+	
+	return true;
+}
+
+
+/** Free a user space mutex control structure
+ *
+ * @param head Deferred free of the structure.
+ *
+ */
+static void umutex_free (struct rcu_head *head)
+{
+	free (list_container_of (head, struct umutex, rcu));
+}
+
+
 /** Get user space mutex control structure
  *
  * Convert mutex ID to user space mutex control structure.
+ * The mutex ID is a handle in the handle table of the
+ * current process. The caller gets a reference to the
+ * structure, which has to be dropped by umutex_put().
  *
  * @param mid Mutex ID.
  *
@@ -34,24 +74,29 @@
 static umutex_t umutex_get (unative_t mid)
 {
 	process_t process = thread_get_process ();
-	umutex_t umutex = NULL;
 	
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
-	
-	// TODO: Convert the mutex ID to the actual user space mutex
-	//       control structure (umutex_t).
-	//
-	// Note that the process control structure (process_t) contains
-	// a list of valid user space mutexes.
-	(void) process;
-	
-	conditionally_enable_interrupts (state);
-	
-	return umutex;
+	return (umutex_t) handle_get (&process->handles, mid, HANDLE_UMUTEX,
+	    umutex_ref);
 }
 
 
+/** Drop a reference to a user space mutex
+ *
+ * The structure is freed with the last reference. It is
+ * freed only after a grace period, since a concurrent
+ * lookup might still be about to take a reference.
+ *
+ * @param umutex User space mutex control structure.
+ *
+ */
+static void umutex_put (umutex_t umutex)
+{
+	if (atomic_sub (&umutex->refcount, 1) == 0)
+		call_rcu (&umutex->rcu, umutex_free);
+}
+
+
+
 /** Initialize a mutex
  *
  * Initialize a mutex to the unlocked state.
@@ -68,14 +113,11 @@ unative_t sys_mutex_init (unative_t *mid)
 	 * Check whether it is safe to access the output
 	 * argument.
 	 */
+	if (!vma_check_user (mid, sizeof (unative_t)))
+		return EINVAL;
 	
-	// TODO: Make sure to check that the mid pointer points to a safely
-	//       mapped user memory. The check should be done using
-	//       vma_check_user().
-	
-	// TODO: Allocate the user space mutex control structure
-	
-	struct umutex *umutex = NULL;
+	struct umutex *umutex =
+	    (struct umutex *) malloc (sizeof (struct umutex));
 	if (!umutex)
 		return ENOMEM;
 	
@@ -83,19 +125,18 @@ unative_t sys_mutex_init (unative_t *mid)
 	
 	mutex_init (&umutex->mtx);
 	
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
+	/* The reference of the handle. */
+	atomic_set (&umutex->refcount, 1);
 	
-	// TODO: Add the newly created user space mutex to the list of mutexes
-	//       owned by the current process.
-	//
-	// Note that the process control structure (process_t) contains
-	// a list of valid user space mutexes.
-	(void) process;
-	
-	conditionally_enable_interrupts (state);
+	handle_t handle;
+	int rc = handle_alloc (&process->handles, HANDLE_UMUTEX, umutex,
+	    &handle);
+	if (rc != EOK) {
+		free (umutex);
+		return rc;
+	}
 	
-	(* mid) = (unative_t) umutex;
+	(* mid) = handle;
 	return EOK;
 }
 
@@ -114,7 +155,13 @@ unative_t sys_mutex_init (unative_t *mid)
  */
 unative_t sys_mutex_lock (unative_t mid)
 {
-	// TODO: Implement this syscall
+	umutex_t umutex = umutex_get (mid);
+	if (umutex == NULL)
+		return EINVAL;
+	
+	mutex_lock (&umutex->mtx);
+	umutex_put (umutex);
+	
 	return EOK;
 }
 
@@ -140,23 +187,16 @@ unative_t sys_mutex_unlock (unative_t mid)
 	if (umutex == NULL)
 		return EINVAL;
 	
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
+	int rc = mutex_unlock_checked (&umutex->mtx);
+	umutex_put (umutex);
 	
-	if ((umutex->mtx.owner) &&
-	    (umutex->mtx.owner != thread_get_current ())) {
-		conditionally_enable_interrupts (state);
+	if (rc != EOK) {
 		thread_finish (NULL);
 		
 		/* Unreachable */
 		return EOK;
 	}
 	
-	// TODO: Call the appropriate kernel function here
-	//       (this is not hard).
-	
-	conditionally_enable_interrupts (state);
-	
 	return EOK;
 }
 
@@ -164,7 +204,8 @@ unative_t sys_mutex_unlock (unative_t mid)
 /** Clean up a mutex
  *
  * Clean up a mutex. If the mutex is currently locked
- * then kill the thread.
+ * then kill the thread. The mutex is released once
+ * no other system call uses it.
  *
  * @param mid Mutex ID to clean up.
  *
@@ -178,25 +219,28 @@ unative_t sys_mutex_destroy (unative_t mid)
 	if (umutex == NULL)
 		return EINVAL;
 	
-	/* Disable interrupts while accessing shared structures. */
-	ipl_t state = query_and_disable_interrupts ();
+	ipl_t state = spinlock_lock_irqsave (&umutex->mtx.lock);
+	bool locked = (umutex->mtx.owner != NULL);
+	spinlock_unlock_irqrestore (&umutex->mtx.lock, state);
 	
-	if (umutex->mtx.owner) {
-		conditionally_enable_interrupts (state);
+	if (locked) {
+		umutex_put (umutex);
 		thread_finish (NULL);
 		
 		/* Unreachable */
 		return EOK;
 	}
 	
-	list_remove (&umutex->link);
-	
-	// TODO: Call the appropriate kernel function here
-	//       (this is not hard).
-	
-	conditionally_enable_interrupts (state);
+	process_t process = thread_get_process ();
+	if (handle_free (&process->handles, mid, HANDLE_UMUTEX) == NULL) {
+		/* Destroyed by another thread meanwhile. */
+		umutex_put (umutex);
+		return EINVAL;
+	}
 	
-	free (umutex);
+	/* Drop the reference of the lookup and of the handle. */
+	umutex_put (umutex);
+	umutex_put (umutex);
 	
 	return EOK;
 }
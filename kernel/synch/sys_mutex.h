@@ -17,18 +17,27 @@
 
 #include <include/shared.h>
 #include <include/c.h>
+#include <adt/atomic.h>
 #include <synch/mutex.h>
+#include <synch/rcu.h>
 
 
 /** User mutex control structure
+ *
+ * The structure is referenced by its handle and by the system
+ * calls using the mutex, it is freed with the last reference
+ * after an RCU grace period.
  *
  */
 typedef struct umutex {
-	/** An user mutex can be an item on a list */
-	link_t link;
-	
 	/** Kernel mutex */
 	struct mutex mtx;
+	
+	/** Reference count */
+	atomic_t refcount;
+	
+	/** Deferred free of the structure */
+	struct rcu_head rcu;
 } *umutex_t;
 
 
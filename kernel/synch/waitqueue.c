@@ -0,0 +1,366 @@
+/**
+ * @file waitqueue.c
+ *
+ * Wait queues.
+ *
+ * A wait queue holds the threads sleeping in a synchronization
+ * primitive. The primitive protects the wait queue with its own lock,
+ * which it holds while checking its state and deciding whether to
+ * sleep, and the wait queue drops the lock only after the thread has
+ * been queued, so that no wakeup gets lost.
+ *
+ * Waiters are either shared or exclusive. A wakeup of a given number
+ * of threads wakes up the waiters from the head of the queue until
+ * that number of exclusive waiters has been woken up, the shared
+ * waiters encountered on the way are woken up as well.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2017
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <lib/debug.h>
+#include <proc/thread.h>
+#include <sched/sched.h>
+#include <time/time.h>
+#include <time/hrtimer.h>
+
+#include <synch/waitqueue.h>
+
+
+/** Initialize a wait queue
+ *
+ * @param wq    Wait queue to initialize.
+ * @param lock  Lock of the synchronization primitive
+ *              protecting the wait queue.
+ * @param order Ordering of the waiters.
+ *
+ */
+void waitqueue_init (waitqueue_t *wq, spinlock_t *lock,
+    const waitqueue_order_t order)
+{
+	assert (wq != NULL);
+	assert (lock != NULL);
+	
+	wq->lock = lock;
+	wq->order = order;
+	wq->num_waiting = 0;
+	list_init (&wq->waiters);
+}
+
+
+/** Clean up a wait queue
+ *
+ * If there are threads still waiting in the wait queue,
+ * then trigger a kernel panic.
+ *
+ * @param wq Wait queue to clean up.
+ *
+ */
+void waitqueue_destroy (waitqueue_t *wq)
+{
+	assert (wq != NULL);
+	
+	if (!list_empty (&wq->waiters))
+		panic ("Request to destroy a wait queue with waiting threads.");
+}
+
+
+/** Check whether a wait queue is empty
+ *
+ * @param wq Wait queue to check.
+ *
+ * @return True if there are no waiting threads.
+ *
+ */
+bool waitqueue_empty (waitqueue_t *wq)
+{
+	assert (wq != NULL);
+	
+	return list_empty (&wq->waiters);
+}
+
+
+/** Initialize a waiter for the current thread
+ *
+ * @param waiter Waiter to initialize.
+ * @param flags  Waiter flags.
+ * @param data   Data of the synchronization primitive.
+ *
+ */
+void waiter_init (struct waiter *waiter, const waiter_flags_t flags,
+    const native_t data)
+{
+	assert (waiter != NULL);
+	
+	link_init (&waiter->link);
+	waiter->wq = NULL;
+	waiter->thread = thread_get_current ();
+	waiter->flags = flags;
+	waiter->data = data;
+	waiter->timed_out = false;
+}
+
+
+/** Put a waiter in a wait queue
+ *
+ * In a priority ordered queue, the waiter goes in front
+ * of the first waiter with a lower priority.
+ *
+ * @param wq     Wait queue to put the waiter in.
+ * @param waiter Waiter to put in the queue.
+ *
+ */
+static void waitqueue_enqueue (waitqueue_t *wq, struct waiter *waiter)
+{
+	waiter->wq = wq;
+	wq->num_waiting++;
+	
+	if (wq->order == WAITQUEUE_PRIORITY) {
+		unsigned int priority = waiter->thread->priority;
+		
+		list_foreach (wq->waiters, struct waiter, link, other) {
+			if (other->thread->priority < priority) {
+				list_insert_before (&waiter->link,
+				    &other->link);
+				return;
+			}
+		}
+	}
+	
+	list_append (&wq->waiters, &waiter->link);
+}
+
+
+/** Wait queue timeout handler
+ *
+ * Wake up the thread unless it has been woken up or removed
+ * from the wait queue meanwhile. Called directly from the
+ * timer interrupt handler.
+ *
+ */
+static void waitqueue_timeout_handler (struct hrtimer *timer, void *data)
+{
+	struct waiter *waiter = (struct waiter *) data;
+	waitqueue_t *wq = waiter->wq;
+	
+	ipl_t state = spinlock_lock_irqsave (wq->lock);
+	
+	if (link_connected (&waiter->link)) {
+		waiter->timed_out = true;
+		waitqueue_wake_waiter (wq, waiter);
+	}
+	
+	spinlock_unlock_irqrestore (wq->lock, state);
+}
+
+
+/** Sleep in a wait queue
+ *
+ * Put the current thread in the wait queue, release the lock
+ * of the wait queue and go to sleep. The lock is acquired again
+ * after the thread is woken up.
+ *
+ * Must be called with the lock of the wait queue held and
+ * interrupts disabled. With a zero timeout the thread does
+ * not go to sleep and the wait times out right away.
+ *
+ * @param wq     Wait queue to sleep in.
+ * @param waiter Waiter of the current thread.
+ * @param usec   Timeout in microseconds, or WAITQUEUE_FOREVER.
+ *
+ * @return EOK if the thread has been woken up or removed from
+ *         the wait queue, ETIMEDOUT if the timeout expired.
+ *
+ */
+int waitqueue_sleep (waitqueue_t *wq, struct waiter *waiter,
+    const unsigned int usec)
+{
+	assert (wq != NULL);
+	assert (waiter != NULL);
+	assert (waiter->thread == thread_get_current ());
+	
+	if (usec == 0) {
+		waiter->timed_out = true;
+		return ETIMEDOUT;
+	}
+	
+	thread_t current = waiter->thread;
+	waitqueue_enqueue (wq, waiter);
+	
+	current->state = THREAD_SLEEPING;
+	sched_remove (current);
+	
+	spinlock_unlock (wq->lock);
+	
+	/*
+	 * Setup a high-resolution timer to wake us up at the exact
+	 * cycle, the same way thread_usleep() does. The handler is
+	 * called directly from the timer interrupt handler.
+	 */
+	struct hrtimer timer;
+	if (usec != WAITQUEUE_FOREVER) {
+		hrtimer_init (&timer, waitqueue_timeout_handler, waiter);
+		hrtimer_start (&timer, cycles_get () + usec_to_cycles (usec));
+	}
+	
+	schedule ();
+	
+	/*
+	 * Cancel the timer. Waits for completion of the timer
+	 * handler, which might still be accessing the waiter.
+	 */
+	if (usec != WAITQUEUE_FOREVER)
+		hrtimer_cancel (&timer);
+	
+	spinlock_lock (wq->lock);
+	
+	return (waiter->timed_out) ? ETIMEDOUT : EOK;
+}
+
+
+/** Sleep in a wait queue until woken up
+ *
+ * Must be called with the lock of the wait queue held and
+ * interrupts disabled, see waitqueue_sleep().
+ *
+ * @param wq    Wait queue to sleep in.
+ * @param flags Waiter flags.
+ *
+ */
+void waitqueue_wait (waitqueue_t *wq, const waiter_flags_t flags)
+{
+	struct waiter waiter;
+	
+	waiter_init (&waiter, flags, 0);
+	waitqueue_sleep (wq, &waiter, WAITQUEUE_FOREVER);
+}
+
+
+/** Get the first waiter of a wait queue
+ *
+ * @param wq Wait queue to look at.
+ *
+ * @return The waiter to be woken up next or NULL
+ *         if the queue is empty.
+ *
+ */
+struct waiter *waitqueue_first (waitqueue_t *wq)
+{
+	assert (wq != NULL);
+	
+	if (list_empty (&wq->waiters))
+		return NULL;
+	
+	return list_item (wq->waiters.head.next, struct waiter, link);
+}
+
+
+/** Remove a waiter from a wait queue without waking it up
+ *
+ * The synchronization primitive becomes responsible for
+ * waking up the thread of the waiter.
+ *
+ * @param wq     Wait queue the waiter is in.
+ * @param waiter Waiter to remove.
+ *
+ */
+void waitqueue_remove (waitqueue_t *wq, struct waiter *waiter)
+{
+	assert (wq != NULL);
+	assert (waiter->wq == wq);
+	assert (link_connected (&waiter->link));
+	assert (wq->num_waiting > 0);
+	
+	list_remove (&waiter->link);
+	wq->num_waiting--;
+}
+
+
+/** Remove a waiter from a wait queue and wake it up
+ *
+ * The waiter might return as soon as it is woken
+ * up, it must not be touched afterwards.
+ *
+ * @param wq     Wait queue the waiter is in.
+ * @param waiter Waiter to wake up.
+ *
+ */
+void waitqueue_wake_waiter (waitqueue_t *wq, struct waiter *waiter)
+{
+	thread_t thread = waiter->thread;
+	
+	waitqueue_remove (wq, waiter);
+	thread_wakeup (thread);
+}
+
+
+/** Wake up waiters of a wait queue
+ *
+ * Wake up the waiters from the head of the queue until the given
+ * number of exclusive waiters has been woken up. All the shared
+ * waiters on the way are woken up as well.
+ *
+ * @param wq    Wait queue to wake up the waiters of.
+ * @param count Number of exclusive waiters to wake up.
+ *
+ * @return Number of woken up waiters.
+ *
+ */
+unsigned int waitqueue_wake_n (waitqueue_t *wq, const unsigned int count)
+{
+	assert (wq != NULL);
+	
+	unsigned int exclusive = 0;
+	unsigned int woken = 0;
+	
+	while (exclusive < count) {
+		struct waiter *waiter = waitqueue_first (wq);
+		if (waiter == NULL)
+			break;
+		
+		if (waiter->flags & WAITER_EXCLUSIVE)
+			exclusive++;
+		
+		waitqueue_wake_waiter (wq, waiter);
+		woken++;
+	}
+	
+	return woken;
+}
+
+
+/** Wake up a waiter of a wait queue
+ *
+ * @param wq Wait queue to wake up a waiter of.
+ *
+ * @return True if a waiter has been woken up.
+ *
+ */
+bool waitqueue_wake_one (waitqueue_t *wq)
+{
+	return (waitqueue_wake_n (wq, 1) > 0);
+}
+
+
+/** Wake up all the waiters of a wait queue
+ *
+ * @param wq Wait queue to wake up the waiters of.
+ *
+ * @return Number of woken up waiters.
+ *
+ */
+unsigned int waitqueue_wake_all (waitqueue_t *wq)
+{
+	assert (wq != NULL);
+	
+	return waitqueue_wake_n (wq, wq->num_waiting);
+}
@@ -0,0 +1,167 @@
+/**
+ * @file waitqueue.h
+ *
+ * Wait queues.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2017
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef WAITQUEUE_H_
+#define WAITQUEUE_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/list.h>
+#include <synch/spinlock.h>
+
+
+/** Timeout of a wait which never times out
+ *
+ * A zero timeout does not sleep at all, see waitqueue_sleep().
+ *
+ */
+#define WAITQUEUE_FOREVER  ((unsigned int) -1)
+
+
+/** Wait queue ordering.
+ *
+ */
+typedef enum {
+	/** Waiters are woken up in the order of arrival */
+	WAITQUEUE_FIFO,
+	
+	/** Waiters with a higher priority are woken up first,
+	 * waiters with the same priority in the order of arrival.
+	 */
+	WAITQUEUE_PRIORITY
+} waitqueue_order_t;
+
+
+/** Waiter flags.
+ *
+ */
+typedef enum {
+	/** The waiter does not count against the number of wakeups */
+	WAITER_SHARED = 0,
+	
+	/** The waiter counts against the number of wakeups */
+	WAITER_EXCLUSIVE = (1 << 0)
+} waiter_flags_t;
+
+
+/** Wait queue.
+ *
+ * The wait queue is protected by the lock of the synchronization
+ * primitive which embeds it. All the functions except initialization
+ * must be called with the lock held and interrupts disabled.
+ *
+ */
+typedef struct {
+	/** Lock protecting the wait queue */
+	spinlock_t *lock;
+	
+	/** Ordering of the waiters */
+	waitqueue_order_t order;
+	
+	/** Number of waiting threads */
+	unsigned int num_waiting;
+	
+	/** List of the waiters */
+	list_t waiters;
+} waitqueue_t;
+
+
+struct thread;
+
+
+/** Thread waiting in a wait queue.
+ *
+ * The structure lives on the stack of the waiting thread.
+ *
+ */
+struct waiter {
+	/** Link in the list of waiters */
+	link_t link;
+	
+	/** Wait queue the thread waits in */
+	waitqueue_t *wq;
+	
+	/** The waiting thread */
+	struct thread *thread;
+	
+	/** Waiter flags */
+	waiter_flags_t flags;
+	
+	/** Data of the synchronization primitive */
+	native_t data;
+	
+	/** The wait has timed out */
+	bool timed_out;
+};
+
+
+/** Static wait queue initializer.
+ *
+ * Declares a FIFO ordered wait queue protected by the given lock.
+ *
+ */
+#define WAITQUEUE_DECLARE(name, lck) \
+	waitqueue_t name = { \
+		.lock = (lck), \
+		.order = WAITQUEUE_FIFO, \
+		.num_waiting = 0, \
+		.waiters = { \
+			.head = { \
+				.prev = &(name).waiters.head, \
+				.next = &(name).waiters.head \
+			} \
+		} \
+	}
+
+
+/** Wait until a condition holds
+ *
+ * The condition is evaluated with the lock of the wait queue
+ * held and the waiter is woken up by any of the wakeup functions.
+ *
+ * @param wq   Wait queue to wait in.
+ * @param cond Condition to wait for.
+ *
+ */
+#define waitqueue_wait_event(wq, cond) \
+	do { \
+		ipl_t __state = spinlock_lock_irqsave ((wq)->lock); \
+		while (!(cond)) \
+			waitqueue_wait ((wq), WAITER_SHARED); \
+		spinlock_unlock_irqrestore ((wq)->lock, __state); \
+	} while (0)
+
+
+/* Externals are commented with implementation */
+extern void waitqueue_init (waitqueue_t *wq, spinlock_t *lock,
+    const waitqueue_order_t order);
+extern void waitqueue_destroy (waitqueue_t *wq);
+extern bool waitqueue_empty (waitqueue_t *wq);
+extern void waiter_init (struct waiter *waiter, const waiter_flags_t flags,
+    const native_t data);
+extern int waitqueue_sleep (waitqueue_t *wq, struct waiter *waiter,
+    const unsigned int usec);
+extern void waitqueue_wait (waitqueue_t *wq, const waiter_flags_t flags);
+extern struct waiter *waitqueue_first (waitqueue_t *wq);
+extern void waitqueue_remove (waitqueue_t *wq, struct waiter *waiter);
+extern void waitqueue_wake_waiter (waitqueue_t *wq, struct waiter *waiter);
+extern unsigned int waitqueue_wake_n (waitqueue_t *wq,
+    const unsigned int count);
+extern bool waitqueue_wake_one (waitqueue_t *wq);
+extern unsigned int waitqueue_wake_all (waitqueue_t *wq);
+
+
+#endif /* WAITQUEUE_H_ */
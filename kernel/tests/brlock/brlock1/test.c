@@ -0,0 +1,155 @@
+/***
+ * Big-reader lock test #1
+ */
+
+static char * desc =
+    "Big-reader lock test #1\n"
+    "Lets threads spread over all CPUs read a pair of counters which\n"
+    "a writer occasionally updates, first under a mutex and then under\n"
+    "a big-reader lock. Checks that readers never see the pair half\n"
+    "updated and reports the cost of a read-side critical section.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of threads, the number of critical sections
+ * entered by each thread and the ratio of reads to writes.
+ */
+#define THREAD_COUNT  (TASK_SIZE * 2)
+#define LOOP_COUNT    2000
+#define WRITE_PERIOD  64
+
+
+static struct mutex mtx;
+static struct brlock brl;
+static bool use_brlock;
+
+static volatile unsigned int first;
+static volatile unsigned int second;
+static atomic_t violations;
+
+
+static inline void
+read_lock (void)
+{
+	if (use_brlock)
+		brlock_read_lock (&brl);
+	else
+		mutex_lock (&mtx);
+}
+
+
+static inline void
+read_unlock (void)
+{
+	if (use_brlock)
+		brlock_read_unlock (&brl);
+	else
+		mutex_unlock (&mtx);
+}
+
+
+static inline void
+write_lock (void)
+{
+	if (use_brlock)
+		brlock_write_lock (&brl);
+	else
+		mutex_lock (&mtx);
+}
+
+
+static inline void
+write_unlock (void)
+{
+	if (use_brlock)
+		brlock_write_unlock (&brl);
+	else
+		mutex_unlock (&mtx);
+}
+
+
+static void *
+thread_proc (void * data)
+{
+	for (unsigned int cnt = 1; cnt <= LOOP_COUNT; cnt++) {
+		if ((cnt % WRITE_PERIOD) == 0) {
+			write_lock ();
+			
+			/* Deliberately non-atomic increments. */
+			first = first + 1;
+			second = second + 1;
+			
+			write_unlock ();
+		} else {
+			read_lock ();
+			
+			if (first != second)
+				atomic_add (&violations, 1);
+			
+			read_unlock ();
+		}
+	}
+	
+	return NULL;
+}
+
+
+static bool
+run_threads (bool brlock)
+{
+	thread_t threads [THREAD_COUNT];
+	
+	use_brlock = brlock;
+	first = 0;
+	second = 0;
+	
+	unative_t start = timer_get ();
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	unative_t ticks = timer_get () - start;
+	
+	printk ("%s: %u ticks per critical section.\n",
+	    brlock ? "Big-reader lock" : "Mutex",
+	    ticks / (THREAD_COUNT * LOOP_COUNT));
+	
+	return (first == THREAD_COUNT * (LOOP_COUNT / WRITE_PERIOD));
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	
+	mutex_init (&mtx);
+	brlock_init (&brl);
+	atomic_set (&violations, 0);
+	
+	if ((!run_threads (false)) || (!run_threads (true))) {
+		printk ("Lost writes.\nTest failed...\n");
+		return;
+	}
+	
+	brlock_destroy (&brl);
+	mutex_destroy (&mtx);
+	
+	if (atomic_get (&violations) != 0) {
+		printk ("Readers saw %u inconsistent states.\n"
+		    "Test failed...\n", atomic_get (&violations));
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,172 @@
+/***
+ * Condition variable timed wait test #1
+ */
+
+static char * desc =
+    "Condition variable timed wait test #1\n"
+    "Checks that a timed wait on a condition variable times out\n"
+    "with the mutex locked, that a signal ends the timed wait early\n"
+    "and that a broadcast moves the waiting threads to the wait queue\n"
+    "of the mutex instead of waking them all up at once.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of threads waiting for the broadcast, the timeout
+ * which should expire and the timeout which should not.
+ */
+#define THREAD_COUNT   TASK_SIZE
+#define SHORT_TIMEOUT  100000
+#define LONG_TIMEOUT   10000000
+
+
+static struct mutex mtx;
+static struct condvar cvar;
+static volatile unsigned int waiting;
+static volatile unsigned int woken;
+static volatile bool inside;
+static atomic_t violations;
+static volatile int result;
+
+
+static void *
+broadcast_proc (void * data)
+{
+	mutex_lock (&mtx);
+	
+	waiting++;
+	condvar_wait (&cvar, &mtx);
+	
+	if (mtx.owner != thread_get_current ())
+		atomic_add (&violations, 1);
+	
+	if (inside)
+		atomic_add (&violations, 1);
+	
+	inside = true;
+	thread_yield ();
+	inside = false;
+	
+	woken++;
+	mutex_unlock (&mtx);
+	
+	return NULL;
+}
+
+
+static void *
+timed_proc (void * data)
+{
+	mutex_lock (&mtx);
+	
+	waiting++;
+	result = condvar_timedwait (&cvar, &mtx, LONG_TIMEOUT);
+	
+	if (mtx.owner != thread_get_current ())
+		atomic_add (&violations, 1);
+	
+	mutex_unlock (&mtx);
+	
+	return NULL;
+}
+
+
+static void
+wait_for_waiters (unsigned int count)
+{
+	mutex_lock (&mtx);
+	while (waiting < count) {
+		mutex_unlock (&mtx);
+		thread_yield ();
+		mutex_lock (&mtx);
+	}
+}
+
+
+void test_run (void)
+{
+	thread_t threads [THREAD_COUNT];
+	
+	printk (desc);
+	
+	mutex_init (&mtx);
+	condvar_init (&cvar);
+	atomic_set (&violations, 0);
+	
+	/*
+	 * Nobody signals the condition variable.
+	 */
+	mutex_lock (&mtx);
+	int rc = condvar_timedwait (&cvar, &mtx, SHORT_TIMEOUT);
+	
+	if (rc != ETIMEDOUT) {
+		printk ("The timed wait returned %d instead of ETIMEDOUT.\n",
+		    rc);
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	if (mtx.owner != thread_get_current ()) {
+		printk ("The mutex is not locked after the timeout.\n");
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	mutex_unlock (&mtx);
+	
+	/*
+	 * Signal a thread in a timed wait.
+	 */
+	waiting = 0;
+	result = ETIMEDOUT;
+	thread_t thread = robust_thread_create (timed_proc, NULL, 0);
+	
+	wait_for_waiters (1);
+	condvar_signal (&cvar);
+	mutex_unlock (&mtx);
+	
+	robust_thread_join (thread);
+	
+	if (result != EOK) {
+		printk ("The signalled timed wait returned %d.\n", result);
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	/*
+	 * Broadcast with the mutex locked, all the threads
+	 * should end up waiting for the mutex.
+	 */
+	waiting = 0;
+	woken = 0;
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++)
+		threads [cnt] = robust_thread_create (broadcast_proc, NULL, 0);
+	
+	wait_for_waiters (THREAD_COUNT);
+	condvar_broadcast (&cvar);
+	
+	unsigned int requeued = mtx.num_waiting;
+	unsigned int left = cvar.wait_queue.num_waiting;
+	
+	mutex_unlock (&mtx);
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++)
+		robust_thread_join (threads [cnt]);
+	
+	printk ("Requeued %u threads, %u left on the condition variable, "
+	    "%u woken up.\n", requeued, left, woken);
+	
+	condvar_destroy (&cvar);
+	mutex_destroy (&mtx);
+	
+	if ((requeued != THREAD_COUNT) || (left != 0) ||
+	    (woken != THREAD_COUNT) || (atomic_get (&violations) != 0)) {
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,103 @@
+/***
+ * Disk test #2
+ */
+
+static const char * desc =
+    "Disk test #2\n\n"
+    "Submits asynchronous reads of the first blocks of the disk with\n"
+    "a completion callback, computes while they are in progress and\n"
+    "checks the content of the blocks once all of them complete.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+#define SEED_DEFAULT  0x00
+
+/*
+ * The maximum number of blocks read at once.
+ */
+#define REQUEST_COUNT  16
+
+
+static struct disk_request requests [REQUEST_COUNT];
+static atomic_t completed;
+static atomic_t failed;
+
+
+static inline uint8_t
+expected_value (size_t block, size_t offset, uint8_t seed)
+{
+	return ((unsigned long) seed ^ (unsigned long) block ^
+	    (unsigned long) offset) & 0xff;
+}
+
+
+static void
+read_done (struct disk_request *request)
+{
+	if (request->rc != EOK)
+		atomic_add (&failed, 1);
+	
+	atomic_add (&completed, 1);
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	
+	size_t blocks;
+	int rc = disk_get_nblocks (&blocks);
+	if (rc != EOK) {
+		printk ("Unable to determine number of blocks.\n");
+		return;
+	}
+	
+	size_t count = (blocks < REQUEST_COUNT) ? blocks : REQUEST_COUNT;
+	uint8_t *data = (uint8_t *) safe_malloc (count * DISK_BLOCK_SIZE);
+	
+	atomic_set (&completed, 0);
+	atomic_set (&failed, 0);
+	
+	for (size_t block = 0; block < count; block++) {
+		disk_request_init (&requests [block], DISK_READ, block,
+		    data + block * DISK_BLOCK_SIZE, read_done, NULL);
+		
+		if (disk_submit (&requests [block]) != EOK) {
+			printk ("Error submitting block %u.\nTest failed...\n",
+			    block);
+			return;
+		}
+	}
+	
+	/* Compute while the requests are in progress. */
+	unsigned int loops = 0;
+	while ((size_t) atomic_get (&completed) < count)
+		loops++;
+	
+	printk ("Computed %u loops during %u reads.\n", loops, count);
+	
+	if (atomic_get (&failed) != 0) {
+		printk ("Failed %u reads.\nTest failed...\n",
+		    atomic_get (&failed));
+		return;
+	}
+	
+	for (size_t block = 0; block < count; block++) {
+		for (size_t offset = 0; offset < DISK_BLOCK_SIZE; offset++) {
+			if (data [block * DISK_BLOCK_SIZE + offset] !=
+			    expected_value (block, offset, SEED_DEFAULT)) {
+				printk ("Corrupted content of block %u.\n"
+				    "Test failed...\n", block);
+				return;
+			}
+		}
+	}
+	
+	free (data);
+	
+	printk ("Test passed...\n");
+}
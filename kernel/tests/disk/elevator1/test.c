@@ -0,0 +1,137 @@
+/***
+ * Disk test #3
+ */
+
+static const char * desc =
+    "Disk test #3\n\n"
+    "Lets several threads read random blocks of the disk at once and\n"
+    "reports the throughput together with the statistics of the disk\n"
+    "request scheduler. Part of the reads goes to a small set of hot\n"
+    "blocks, which gives the scheduler a chance to merge requests.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+#include "../../include/tst_rand.h"
+
+
+#define SEED_DEFAULT  0x00
+
+/*
+ * The number of threads, the number of blocks read by each thread,
+ * the number of hot blocks and the ratio of reads of the hot blocks.
+ */
+#define THREAD_COUNT  8
+#define LOOP_COUNT    64
+#define HOT_BLOCKS    4
+#define HOT_PERIOD    4
+
+
+static size_t blocks;
+static atomic_t failed;
+
+
+static inline uint8_t
+expected_value (size_t block, size_t offset, uint8_t seed)
+{
+	return ((unsigned long) seed ^ (unsigned long) block ^
+	    (unsigned long) offset) & 0xff;
+}
+
+
+static void *
+thread_read (void *data)
+{
+	uint8_t *buffer = (uint8_t *) safe_malloc (DISK_BLOCK_SIZE);
+	
+	for (unsigned int cnt = 0; cnt < LOOP_COUNT; cnt++) {
+		/* The random number generator is not thread-safe. */
+		ipl_t status = query_and_disable_interrupts ();
+		size_t block = tst_rand ();
+		conditionally_enable_interrupts (status);
+		
+		if ((cnt % HOT_PERIOD) == 0)
+			block %= HOT_BLOCKS;
+		
+		block %= blocks;
+		
+		if (disk_read (block, buffer) != EOK) {
+			printk ("Error reading block %u.\n", block);
+			atomic_add (&failed, 1);
+			break;
+		}
+		
+		for (size_t offset = 0; offset < DISK_BLOCK_SIZE; offset++) {
+			if (buffer [offset] !=
+			    expected_value (block, offset, SEED_DEFAULT)) {
+				printk ("Corrupted content of block %u.\n",
+				    block);
+				atomic_add (&failed, 1);
+				break;
+			}
+		}
+	}
+	
+	free (buffer);
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	
+	int rc = disk_get_nblocks (&blocks);
+	if ((rc != EOK) || (blocks == 0)) {
+		printk ("Unable to determine number of blocks.\n");
+		return;
+	}
+	
+	atomic_set (&failed, 0);
+	
+	struct disk_stats before;
+	disk_get_stats (&before);
+	
+	thread_t threads [THREAD_COUNT];
+	unative_t start = timer_get ();
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_read, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	unative_t ticks = timer_get () - start;
+	
+	struct disk_stats after;
+	disk_get_stats (&after);
+	
+	unsigned int submitted = after.submitted - before.submitted;
+	unsigned int transfers = after.transfers - before.transfers;
+	unsigned int merged = after.merged - before.merged;
+	
+	printk ("Read %u blocks in %u ticks, %u ticks per block.\n",
+	    submitted, ticks, ticks / submitted);
+	printk ("Transfers: %u, merged: %u, expired: %u.\n",
+	    transfers, merged, after.expired - before.expired);
+	printk ("Queue depth: %u on average, %u at most.\n",
+	    (after.depth_sum - before.depth_sum) / submitted,
+	    after.max_depth);
+	
+	if (atomic_get (&failed) != 0) {
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	if ((submitted != THREAD_COUNT * LOOP_COUNT) ||
+	    (transfers + merged != submitted)) {
+		printk ("Inconsistent statistics.\nTest failed...\n");
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,186 @@
+/***
+ * Handle table test #1
+ */
+
+static char * desc =
+    "Handle table test #1\n"
+    "Allocates handles past the initial size of a handle table so that\n"
+    "the table grows, checks that every handle translates to its object\n"
+    "and that freed handles stay invalid after their entries are reused\n"
+    "with a new generation.\n\n";
+
+
+#include <api.h>
+#include <proc/handle.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of handles allocated at once, large
+ * enough for the table to grow several times.
+ */
+#define HANDLE_COUNT  (HANDLE_TABLE_INITIAL * 5)
+
+
+static struct handle_table table;
+static int objects [HANDLE_COUNT];
+static handle_t handles [HANDLE_COUNT];
+static handle_t stale [HANDLE_COUNT];
+
+
+static bool
+ref_refuse (void *object)
+{
+	return false;
+}
+
+
+static bool
+alloc_all (void)
+{
+	for (int i = 0; i < HANDLE_COUNT; i++) {
+		int rc = handle_alloc (&table, HANDLE_UMUTEX, &objects [i],
+		    &handles [i]);
+		if (rc != EOK) {
+			printk ("Unable to allocate handle %d (%d)\n", i, rc);
+			return false;
+		}
+		
+		if (handles [i] == 0) {
+			printk ("Handle %d is zero\n", i);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+static bool
+check_all (void)
+{
+	for (int i = 0; i < HANDLE_COUNT; i++) {
+		void *object = handle_get (&table, handles [i], HANDLE_UMUTEX,
+		    NULL);
+		if (object != &objects [i]) {
+			printk ("Handle %x translates to %p instead of %p\n",
+			    handles [i], object, &objects [i]);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+static bool
+check_stale (void)
+{
+	for (int i = 0; i < HANDLE_COUNT; i++) {
+		if (handle_get (&table, stale [i], HANDLE_UMUTEX,
+		    NULL) != NULL) {
+			printk ("Stale handle %x is still valid\n", stale [i]);
+			return false;
+		}
+		
+		if (handle_free (&table, stale [i], HANDLE_UMUTEX) != NULL) {
+			printk ("Stale handle %x freed again\n", stale [i]);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	
+	handle_table_init (&table);
+	
+	/*
+	 * The table grows from empty while the handles are allocated.
+	 */
+	if ((!alloc_all ()) || (!check_all ())) {
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	if (table.size < HANDLE_COUNT) {
+		printk ("Table has %u entries for %u handles\n",
+		    table.size, HANDLE_COUNT);
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	/*
+	 * A lookup fails with the wrong type or a refused reference.
+	 */
+	if (handle_get (&table, handles [0], HANDLE_FREE, NULL) != NULL) {
+		printk ("Handle translated with a wrong type\n");
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	if (handle_get (&table, handles [0], HANDLE_UMUTEX,
+	    ref_refuse) != NULL) {
+		printk ("Handle translated with a refused reference\n");
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	/*
+	 * Free all the handles, they are all stale afterwards.
+	 */
+	for (int i = 0; i < HANDLE_COUNT; i++) {
+		void *object = handle_free (&table, handles [i],
+		    HANDLE_UMUTEX);
+		if (object != &objects [i]) {
+			printk ("Handle %x freed %p instead of %p\n",
+			    handles [i], object, &objects [i]);
+			printk ("Test failed...\n");
+			return;
+		}
+		
+		stale [i] = handles [i];
+	}
+	
+	if (!check_stale ()) {
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	/*
+	 * The entries are reused without growing the table,
+	 * each with a generation different from the stale one.
+	 */
+	unsigned int size = table.size;
+	
+	if ((!alloc_all ()) || (!check_all ()) || (!check_stale ())) {
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	if (table.size != size) {
+		printk ("Table grew from %u to %u entries\n", size, table.size);
+		printk ("Test failed...\n");
+		return;
+	}
+	
+	for (int i = 0; i < HANDLE_COUNT; i++) {
+		for (int j = 0; j < HANDLE_COUNT; j++) {
+			if (handles [i] == stale [j]) {
+				printk ("Handle %x reused\n", handles [i]);
+				printk ("Test failed...\n");
+				return;
+			}
+		}
+	}
+	
+	for (int i = 0; i < HANDLE_COUNT; i++)
+		handle_free (&table, handles [i], HANDLE_UMUTEX);
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,97 @@
+/***
+ * Cross-CPU call test #1
+ */
+
+static char * desc =
+    "Cross-CPU call test #1\n"
+    "Calls a function on each of the other online CPUs and reports\n"
+    "the round-trip latency of a call, then runs an asynchronous call\n"
+    "on all CPUs at once and checks that every CPU ran it.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of calls to each CPU.
+ */
+#define LOOP_COUNT  100
+
+
+static atomic_t calls;
+static atomic_t ran_on;
+
+
+static void
+call_count (void *data)
+{
+	atomic_add (&calls, 1);
+}
+
+
+static void
+call_mark (void *data)
+{
+	/* Record the CPU, the call runs with interrupts disabled. */
+	atomic_t *mask = (atomic_t *) data;
+	
+	native_t old;
+	do {
+		old = atomic_get (mask);
+	} while (!atomic_cas (mask, old,
+	    old | CPUMASK_CPU (cpuid ())));
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	
+	cpumask_t online = sched_online_cpus ();
+	unsigned int expected = 0;
+	
+	atomic_set (&calls, 0);
+	
+	/*
+	 * Round-trip latency of synchronous calls.
+	 */
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++) {
+		if (((online & CPUMASK_CPU (cpu)) == 0) || (cpu == cpuid ()))
+			continue;
+		
+		unative_t start = timer_get ();
+		
+		for (unsigned int cnt = 0; cnt < LOOP_COUNT; cnt++)
+			smp_call_function_single (cpu, call_count, NULL);
+		
+		unative_t ticks = timer_get () - start;
+		expected += LOOP_COUNT;
+		
+		printk ("cpu%u: %u ticks per call.\n", cpu, ticks / LOOP_COUNT);
+	}
+	
+	if ((unsigned int) atomic_get (&calls) != expected) {
+		printk ("Ran %u of %u calls.\nTest failed...\n",
+		    atomic_get (&calls), expected);
+		return;
+	}
+	
+	/*
+	 * Asynchronous call on all CPUs.
+	 */
+	struct smp_call call;
+	atomic_set (&ran_on, 0);
+	
+	smp_call_async (&call, online, call_mark, &ran_on);
+	smp_call_wait (&call);
+	
+	if ((cpumask_t) atomic_get (&ran_on) != online) {
+		printk ("The call ran on CPUs %x instead of %x.\n"
+		    "Test failed...\n", atomic_get (&ran_on), online);
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,111 @@
+/***
+ * Adaptive mutex test #1
+ */
+
+static char * desc =
+    "Adaptive mutex test #1\n"
+    "Lets threads spread over all CPUs enter a short critical section\n"
+    "protected by a blocking and then by an adaptive mutex, checks that\n"
+    "the mutual exclusion holds and compares the throughput.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of threads, the number of times each thread
+ * enters the critical section and the length of the critical
+ * section in ticks.
+ */
+#define THREAD_COUNT   (TASK_SIZE * 2)
+#define LOOP_COUNT     500
+#define SECTION_TICKS  100
+
+
+static struct mutex mtx;
+static volatile unsigned int counter;
+static volatile unsigned int inside;
+static atomic_t violations;
+
+
+static void *
+thread_proc (void * data)
+{
+	for (unsigned int cnt = 0; cnt < LOOP_COUNT; cnt++) {
+		mutex_lock (&mtx);
+		
+		inside++;
+		if (inside != 1)
+			atomic_add (&violations, 1);
+		
+		/* A deliberately non-atomic increment. */
+		unsigned int value = counter;
+		unative_t start = timer_get ();
+		while (timer_get () - start < SECTION_TICKS);
+		counter = value + 1;
+		
+		inside--;
+		mutex_unlock (&mtx);
+	}
+	
+	return NULL;
+}
+
+
+static bool
+run_threads (bool adaptive)
+{
+	thread_t threads [THREAD_COUNT];
+	struct mutex_stats stats;
+	
+	mutex_init (&mtx);
+	mutex_set_adaptive (&mtx, adaptive);
+	counter = 0;
+	inside = 0;
+	
+	unative_t start = timer_get ();
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	unative_t ticks = timer_get () - start;
+	
+	mutex_get_stats (&mtx, &stats);
+	mutex_destroy (&mtx);
+	
+	printk ("%s mutex: %u ticks per critical section, %u locks, "
+	    "%u contended, %u spun, %u slept.\n",
+	    adaptive ? "Adaptive" : "Blocking",
+	    ticks / (THREAD_COUNT * LOOP_COUNT), stats.locked,
+	    stats.contended, stats.spun, stats.slept);
+	
+	return (counter == THREAD_COUNT * LOOP_COUNT);
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	atomic_set (&violations, 0);
+	
+	if ((!run_threads (false)) || (!run_threads (true))) {
+		printk ("Lost increments.\nTest failed...\n");
+		return;
+	}
+	
+	if (atomic_get (&violations) != 0) {
+		printk ("Mutual exclusion violated %u times.\n"
+		    "Test failed...\n", atomic_get (&violations));
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,141 @@
+/***
+ * Priority inheritance test #1
+ */
+
+static char * desc =
+    "Priority inheritance test #1\n"
+    "Runs a low, a medium and a high priority thread on a single CPU.\n"
+    "The low priority thread holds a mutex the high priority thread\n"
+    "waits for while the medium priority thread keeps the CPU busy.\n"
+    "Checks that the low priority thread inherits the high priority\n"
+    "and releases the mutex before the medium priority thread ends.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The time the high priority thread sleeps before locking
+ * the mutex and the time the medium priority thread keeps
+ * the CPU busy, both in microseconds.
+ */
+#define HIGH_DELAY_USEC  10000
+#define MEDIUM_BUSY_USEC  500000
+
+
+#define PRIORITY_LOW     THREAD_PRIORITY_DEFAULT
+#define PRIORITY_MEDIUM  (THREAD_PRIORITY_DEFAULT + 1)
+#define PRIORITY_HIGH    (THREAD_PRIORITY_DEFAULT + 2)
+
+
+static struct mutex mtx;
+static volatile bool low_locked;
+static volatile bool high_waiting;
+static volatile bool medium_done;
+static volatile bool high_early;
+static volatile unsigned int low_boost;
+
+
+static void
+pin_current (unsigned int priority)
+{
+	thread_t thread = thread_get_current ();
+	
+	thread_set_affinity (thread, CPUMASK_CPU (0));
+	thread_set_priority (thread, priority);
+}
+
+
+static void *
+low_proc (void * data)
+{
+	pin_current (PRIORITY_LOW);
+	
+	mutex_lock (&mtx);
+	low_locked = true;
+	
+	/*
+	 * The thread only gets the CPU back from the medium
+	 * priority thread once the high priority thread waits
+	 * for the mutex and lends its priority.
+	 */
+	while (!high_waiting);
+	
+	low_boost = thread_get_priority (thread_get_current ());
+	mutex_unlock (&mtx);
+	
+	return NULL;
+}
+
+
+static void *
+medium_proc (void * data)
+{
+	pin_current (PRIORITY_MEDIUM);
+	
+	uint64_t start = cycles_get ();
+	while (cycles_get () - start < usec_to_cycles (MEDIUM_BUSY_USEC));
+	
+	medium_done = true;
+	return NULL;
+}
+
+
+static void *
+high_proc (void * data)
+{
+	pin_current (PRIORITY_HIGH);
+	thread_usleep (HIGH_DELAY_USEC);
+	
+	high_waiting = true;
+	mutex_lock (&mtx);
+	high_early = !medium_done;
+	mutex_unlock (&mtx);
+	
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	
+	mutex_init (&mtx);
+	pin_current (THREAD_PRIORITY_MAX);
+	
+	thread_t low = robust_thread_create (low_proc, THREAD_MAGIC, 0);
+	while (!low_locked)
+		thread_usleep (1000);
+	
+	thread_t medium = robust_thread_create (medium_proc, THREAD_MAGIC, 0);
+	thread_t high = robust_thread_create (high_proc, THREAD_MAGIC, 0);
+	
+	robust_thread_join (high);
+	robust_thread_join (medium);
+	robust_thread_join (low);
+	
+	mutex_destroy (&mtx);
+	
+	if (low_boost != PRIORITY_HIGH) {
+		printk ("Low priority thread ran with priority %u "
+		    "instead of %u.\nTest failed...\n",
+		    low_boost, PRIORITY_HIGH);
+		return;
+	}
+	
+	if (!high_early) {
+		printk ("High priority thread waited for the medium "
+		    "priority thread.\nTest failed...\n");
+		return;
+	}
+	
+	if (thread_get_priority (thread_get_current ()) !=
+	    THREAD_PRIORITY_MAX) {
+		printk ("Priority not restored.\nTest failed...\n");
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
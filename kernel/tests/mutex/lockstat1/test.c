@@ -0,0 +1,100 @@
+/***
+ * Lock statistics test #1
+ */
+
+static char * desc =
+    "Lock statistics test #1\n"
+    "Lets threads lock a mutex with the lock statistics switched on,\n"
+    "checks the acquisitions counted for the class of the mutex and\n"
+    "that nothing is counted once the statistics are switched off.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of threads, the number of times each thread
+ * enters the critical section and the length of the critical
+ * section in ticks.
+ */
+#define THREAD_COUNT   TASK_SIZE
+#define LOOP_COUNT     200
+#define SECTION_TICKS  100
+
+
+static struct mutex mtx;
+
+
+static void *
+thread_proc (void * data)
+{
+	for (unsigned int cnt = 0; cnt < LOOP_COUNT; cnt++) {
+		mutex_lock (&mtx);
+		
+		unative_t start = timer_get ();
+		while (timer_get () - start < SECTION_TICKS);
+		
+		mutex_unlock (&mtx);
+	}
+	
+	return NULL;
+}
+
+
+static void
+run_threads (void)
+{
+	thread_t threads [THREAD_COUNT];
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	
+	mutex_init (&mtx);
+	
+	lockstat_reset ();
+	lockstat_enable (true);
+	run_threads ();
+	lockstat_enable (false);
+	
+	lockstat_dump ();
+	
+	unsigned int acquisitions = mtx.class->acquisitions;
+	if (acquisitions != THREAD_COUNT * LOOP_COUNT) {
+		printk ("Counted %u acquisitions instead of %u.\n"
+		    "Test failed...\n", acquisitions,
+		    THREAD_COUNT * LOOP_COUNT);
+		return;
+	}
+	
+	if (mtx.class->hold_max < SECTION_TICKS) {
+		printk ("Maximal hold time %u below %u.\n"
+		    "Test failed...\n", mtx.class->hold_max, SECTION_TICKS);
+		return;
+	}
+	
+	run_threads ();
+	
+	if (mtx.class->acquisitions != acquisitions) {
+		printk ("Acquisitions counted while switched off.\n"
+		    "Test failed...\n");
+		return;
+	}
+	
+	mutex_destroy (&mtx);
+	
+	printk ("Test passed...\n");
+}
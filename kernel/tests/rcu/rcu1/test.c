@@ -0,0 +1,154 @@
+/***
+ * RCU test #1
+ */
+
+static char * desc =
+    "RCU test #1\n"
+    "Lets threads spread over all CPUs read a shared object through\n"
+    "an RCU protected pointer while a writer keeps replacing the object\n"
+    "and retires the old copies with call_rcu() and synchronize_rcu().\n"
+    "Checks that no reader ever sees a retired object.\n\n";
+
+
+#include <api.h>
+#include <synch/rcu.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of reading threads, the number of lookups
+ * done by each reader and the number of updates.
+ */
+#define THREAD_COUNT  (TASK_SIZE * 2)
+#define LOOP_COUNT    5000
+#define UPDATE_COUNT  200
+
+
+struct object {
+	struct rcu_head rcu;
+	unsigned int first;
+	unsigned int second;
+	volatile bool retired;
+};
+
+
+static struct object *volatile shared;
+static atomic_t violations;
+static atomic_t reclaimed;
+
+
+static void *
+reader_proc (void * data)
+{
+	for (unsigned int cnt = 0; cnt < LOOP_COUNT; cnt++) {
+		ipl_t state = rcu_read_lock ();
+		
+		struct object *object = shared;
+		unsigned int first = object->first;
+		
+		/* Give the writer a chance to replace the object. */
+		for (volatile unsigned int i = 0; i < 10; i++);
+		
+		if ((object->retired) || (object->second != first))
+			atomic_add (&violations, 1);
+		
+		rcu_read_unlock (state);
+	}
+	
+	return NULL;
+}
+
+
+static void
+object_reclaim (struct rcu_head *head)
+{
+	struct object *object = list_container_of (head, struct object, rcu);
+	
+	/* Not freed, so that a late reader would notice. */
+	object->retired = true;
+	atomic_add (&reclaimed, 1);
+}
+
+
+static void *
+writer_proc (void * data)
+{
+	for (unsigned int cnt = 1; cnt <= UPDATE_COUNT; cnt++) {
+		struct object *object =
+		    (struct object *) safe_malloc (sizeof (struct object));
+		
+		object->first = cnt;
+		object->second = cnt;
+		object->retired = false;
+		
+		/* Publish the object only after it is filled in. */
+		memory_barrier ();
+		
+		struct object *old = shared;
+		shared = object;
+		
+		if ((cnt % 2) == 0) {
+			call_rcu (&old->rcu, object_reclaim);
+		} else {
+			synchronize_rcu ();
+			object_reclaim (&old->rcu);
+		}
+		
+		thread_yield ();
+	}
+	
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	thread_t readers [THREAD_COUNT];
+	struct object initial;
+	
+	printk (desc);
+	
+	initial.first = 0;
+	initial.second = 0;
+	initial.retired = false;
+	shared = &initial;
+	
+	atomic_set (&violations, 0);
+	atomic_set (&reclaimed, 0);
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		readers [cnt] = robust_thread_create (
+		    reader_proc, THREAD_MAGIC, 0);
+	}
+	
+	thread_t writer = robust_thread_create (writer_proc, THREAD_MAGIC, 0);
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (readers [cnt]);
+	}
+	
+	robust_thread_join (writer);
+	
+	/*
+	 * Wait for the callbacks of the last updates, which might
+	 * still be running on another CPU after the first grace
+	 * period completes.
+	 */
+	synchronize_rcu ();
+	synchronize_rcu ();
+	
+	if (atomic_get (&violations) != 0) {
+		printk ("Readers saw %u retired or inconsistent objects.\n"
+		    "Test failed...\n", atomic_get (&violations));
+		return;
+	}
+	
+	if (atomic_get (&reclaimed) != UPDATE_COUNT) {
+		printk ("Reclaimed %u objects instead of %u.\n"
+		    "Test failed...\n", atomic_get (&reclaimed), UPDATE_COUNT);
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
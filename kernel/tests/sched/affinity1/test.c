@@ -0,0 +1,116 @@
+/***
+ * Thread affinity test #1
+ */
+
+static char * desc =
+    "Thread affinity test #1\n"
+    "Pins the main thread to every CPU in turn and starts worker threads\n"
+    "pinned to the individual CPUs. The workers repeatedly sleep and wake\n"
+    "up and check that they are never placed outside of their affinity.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of worker threads and the number
+ * of sleeps done by each worker thread.
+ */
+#define THREAD_COUNT  TASK_SIZE
+#define SLEEP_COUNT   20
+
+
+/*
+ * Number of workers which ran outside of their affinity.
+ */
+static atomic_t violations;
+
+
+static void *
+thread_proc (void * data)
+{
+	unsigned int cpu = (unsigned int) data;
+	thread_t self = thread_get_current ();
+	
+	if (thread_set_affinity (self, CPUMASK_CPU (cpu)) != EOK) {
+		printk ("Unable to pin worker to cpu%u.\n", cpu);
+		atomic_add (&violations, 1);
+		return NULL;
+	}
+	
+	for (unsigned int cnt = 0; cnt < SLEEP_COUNT; cnt++) {
+		if (cpuid () != cpu) {
+			atomic_add (&violations, 1);
+			break;
+		}
+		
+		thread_usleep (1000 + (cnt % 3) * 500);
+	}
+	
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	thread_t threads [THREAD_COUNT];
+	unsigned int cpus [MAX_CPU];
+	unsigned int cpu_count = 0;
+	
+	printk (desc);
+	atomic_set (&violations, 0);
+	
+	/*
+	 * Find the running CPUs by pinning the current thread
+	 * to each of them. Setting an affinity which contains
+	 * no running CPU fails.
+	 */
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++) {
+		thread_t self = thread_get_current ();
+		if (thread_set_affinity (self, CPUMASK_CPU (cpu)) != EOK)
+			continue;
+		
+		if (cpuid () != cpu) {
+			printk ("Main thread not migrated to cpu%u.\n"
+			    "Test failed...\n", cpu);
+			return;
+		}
+		
+		cpus [cpu_count] = cpu;
+		cpu_count++;
+	}
+	
+	printk ("Found %u running CPU(s).\n", cpu_count);
+	
+	if (thread_set_affinity (thread_get_current (), 0) != EINVAL) {
+		printk ("Empty affinity accepted.\nTest failed...\n");
+		return;
+	}
+	
+	thread_set_affinity (thread_get_current (), CPUMASK_ALL);
+	
+	/*
+	 * Start the workers, spread over the running CPUs.
+	 */
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (thread_proc,
+		    (void *) cpus [cnt % cpu_count], 0);
+	}
+	
+	/*
+	 * Wait for the workers to finish.
+	 */
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	if (atomic_get (&violations) != 0) {
+		printk ("%u worker(s) ran outside of their affinity.\n"
+		    "Test failed...\n", atomic_get (&violations));
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,115 @@
+/***
+ * Idle test #1
+ */
+
+static char * desc =
+    "Idle test #1\n"
+    "Runs threads which mostly sleep and reports how much time each CPU\n"
+    "spent idle and how much of it was spent waiting for an interrupt\n"
+    "rather than spinning in the idle loop. Compile with IDLE_SPIN=1\n"
+    "to compare with idle threads which keep yielding the processor.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of worker threads, the number of sleeps
+ * done by each thread and the length of a sleep.
+ */
+#define THREAD_COUNT  TASK_SIZE
+#define SLEEP_COUNT   10
+#define SLEEP_USEC    5000
+
+/*
+ * Number of iterations of the work done between the sleeps.
+ */
+#define WORK_ITERATIONS  200
+
+
+/*
+ * Statistics of all CPUs at the beginning of the test.
+ */
+static struct sched_idle_stats start_stats [MAX_CPU];
+
+
+static void *
+thread_proc (void * data)
+{
+	assert (data == THREAD_MAGIC);
+	
+	unsigned int seed = (unsigned int) thread_get_current ();
+	volatile unsigned int sink = 0;
+	
+	for (unsigned int cnt = 0; cnt < SLEEP_COUNT; cnt++) {
+		for (unsigned int i = 0; i < WORK_ITERATIONS; i++)
+			sink += random (&seed);
+		
+		thread_usleep (SLEEP_USEC);
+	}
+	
+	return NULL;
+}
+
+
+/*
+ * Convert a cycle count to kilocycles without a 64-bit division.
+ */
+static unsigned int
+kcycles (uint64_t cycles)
+{
+	return (unsigned int) (cycles >> 10);
+}
+
+
+void
+test_run (void)
+{
+	thread_t threads [THREAD_COUNT];
+	
+	printk (desc);
+	
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++)
+		sched_get_idle_stats (cpu, &start_stats [cpu]);
+	
+	unative_t start = timer_get ();
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	/*
+	 * The cycle counters of the CPUs are not synchronized,
+	 * the elapsed time on the current CPU is only an estimate.
+	 */
+	unsigned int elapsed = kcycles (timer_get () - start);
+	if (elapsed == 0)
+		elapsed = 1;
+	
+	printk ("Elapsed %u kcycles.\n", elapsed);
+	
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++) {
+		struct sched_idle_stats stats;
+		if (!sched_get_idle_stats (cpu, &stats))
+			continue;
+		
+		unsigned int idle = kcycles (stats.idle_cycles -
+		    start_stats [cpu].idle_cycles);
+		unsigned int wait = kcycles (stats.wait_cycles -
+		    start_stats [cpu].wait_cycles);
+		unsigned int loops = stats.idle_loops -
+		    start_stats [cpu].idle_loops;
+		
+		printk ("  cpu%u: idle %u kcycles (%u%%), waiting %u kcycles, "
+		    "%u idle loops\n", cpu, idle, (idle * 100) / elapsed,
+		    wait, loops);
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,116 @@
+/***
+ * Scheduler test #1
+ */
+
+static char * desc =
+    "Scheduler test #1\n"
+    "Runs an embarrassingly parallel workload in a number of threads\n"
+    "and reports the throughput and the distribution of the work among\n"
+    "the CPUs. Run with different numbers of CPUs to see how the load\n"
+    "balancing scales.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of worker threads.
+ */
+#define THREAD_COUNT  (TASK_SIZE * 2)
+
+/*
+ * The number of work chunks done by each worker thread
+ * and the number of iterations in each work chunk.
+ */
+#define CHUNK_COUNT       64
+#define CHUNK_ITERATIONS  2000
+
+
+/*
+ * Number of work chunks done on each CPU.
+ */
+static atomic_t chunks_done [MAX_CPU];
+
+
+static void *
+thread_proc (void * data)
+{
+	assert (data == THREAD_MAGIC);
+	
+	unsigned int seed = (unsigned int) thread_get_current ();
+	volatile unsigned int sink = 0;
+	
+	for (unsigned int chunk = 0; chunk < CHUNK_COUNT; chunk++) {
+		/* Pure computation without any shared data. */
+		for (unsigned int i = 0; i < CHUNK_ITERATIONS; i++)
+			sink += random (&seed);
+		
+		/* Account the chunk to the CPU it has finished on. */
+		atomic_add (&chunks_done [cpuid ()], 1);
+	}
+	
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	thread_t threads [THREAD_COUNT];
+	
+	printk (desc);
+	
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++)
+		atomic_set (&chunks_done [cpu], 0);
+	
+	unsigned int start = jiffies_get ();
+	
+	/*
+	 * Start the workers. All of them are created on the current
+	 * CPU, it is up to the load balancing to spread them.
+	 */
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	/*
+	 * Wait for the workers to finish.
+	 */
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	unsigned int elapsed = jiffies_get () - start;
+	if (elapsed == 0)
+		elapsed = 1;
+	
+	/*
+	 * Report the results.
+	 */
+	unsigned int total = 0;
+	unsigned int cpus = 0;
+	
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++) {
+		unsigned int done = atomic_get (&chunks_done [cpu]);
+		if (done == 0)
+			continue;
+		
+		printk ("  cpu%u: %u chunks\n", cpu, done);
+		total += done;
+		cpus++;
+	}
+	
+	printk ("Done %u chunks on %u CPU(s) in %u jiffies "
+	    "(%u chunks per 1000 jiffies).\n", total, cpus, elapsed,
+	    (total * 1000) / elapsed);
+	
+	if (total != THREAD_COUNT * CHUNK_COUNT) {
+		printk ("Expected %u chunks.\nTest failed...\n",
+		    THREAD_COUNT * CHUNK_COUNT);
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
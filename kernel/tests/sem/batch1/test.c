@@ -0,0 +1,167 @@
+/***
+ * Semaphore batch test #1
+ */
+
+static char * desc =
+    "Semaphore batch test #1\n"
+    "Producers and consumers move items through a bounded queue in\n"
+    "batches, first one unit at a time and then with sem_up_n() and\n"
+    "sem_down_n(), and the throughput is compared. Then checks that\n"
+    "sem_try_down() does not block and that sem_down_timeout()\n"
+    "times out.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of producers and consumers, the number of batches
+ * each producer moves, the number of items in a batch and the
+ * length of the queue.
+ */
+#define THREAD_COUNT   (TASK_SIZE / 2)
+#define ROUND_COUNT    (TASK_SIZE * 20)
+#define BATCH_SIZE     8
+#define QUEUE_LENGTH   (BATCH_SIZE * 4)
+#define TOTAL_ITEMS    (THREAD_COUNT * ROUND_COUNT * BATCH_SIZE)
+
+/*
+ * The timeout of a wait which should expire.
+ */
+#define TIMEOUT  100000
+
+
+static struct semaphore queue_free;
+static struct semaphore queue_full;
+static atomic_t consumed;
+static volatile bool batched;
+
+
+static void
+sem_take (struct semaphore * sem)
+{
+	if (batched)
+		sem_down_n (sem, BATCH_SIZE);
+	else {
+		for (unsigned int cnt = 0; cnt < BATCH_SIZE; cnt++)
+			sem_down (sem);
+	}
+}
+
+
+static void
+sem_give (struct semaphore * sem)
+{
+	if (batched)
+		sem_up_n (sem, BATCH_SIZE);
+	else {
+		for (unsigned int cnt = 0; cnt < BATCH_SIZE; cnt++)
+			sem_up (sem);
+	}
+}
+
+
+static void *
+producer_proc (void * data)
+{
+	for (unsigned int cnt = 0; cnt < ROUND_COUNT; cnt++) {
+		sem_take (&queue_free);
+		sem_give (&queue_full);
+	}
+	
+	return NULL;
+}
+
+
+static void *
+consumer_proc (void * data)
+{
+	for (unsigned int cnt = 0; cnt < ROUND_COUNT; cnt++) {
+		sem_take (&queue_full);
+		atomic_add (&consumed, BATCH_SIZE);
+		sem_give (&queue_free);
+	}
+	
+	return NULL;
+}
+
+
+static bool
+run_threads (bool batch)
+{
+	thread_t producers [THREAD_COUNT];
+	thread_t consumers [THREAD_COUNT];
+	
+	sem_init (&queue_free, QUEUE_LENGTH);
+	sem_init (&queue_full, 0);
+	atomic_set (&consumed, 0);
+	batched = batch;
+	
+	unative_t start = timer_get ();
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		producers [cnt] = robust_thread_create (
+		    producer_proc, THREAD_MAGIC, 0);
+		consumers [cnt] = robust_thread_create (
+		    consumer_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (producers [cnt]);
+		robust_thread_join (consumers [cnt]);
+	}
+	
+	unative_t ticks = timer_get () - start;
+	
+	printk ("%s: %u ticks per item, %u items consumed.\n",
+	    batch ? "Batched" : "Single", ticks / TOTAL_ITEMS,
+	    atomic_get (&consumed));
+	
+	bool ok = ((atomic_get (&consumed) == TOTAL_ITEMS) &&
+	    (sem_get_value (&queue_free) == QUEUE_LENGTH) &&
+	    (sem_get_value (&queue_full) == 0));
+	
+	sem_destroy (&queue_free);
+	sem_destroy (&queue_full);
+	
+	return ok;
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	
+	if ((!run_threads (false)) || (!run_threads (true))) {
+		printk ("Lost items.\nTest failed...\n");
+		return;
+	}
+	
+	sem_init (&queue_full, 0);
+	
+	if (sem_try_down (&queue_full) != EAGAIN) {
+		printk ("Acquired an empty semaphore.\nTest failed...\n");
+		return;
+	}
+	
+	if (sem_down_timeout (&queue_full, TIMEOUT) != ETIMEDOUT) {
+		printk ("The timeout did not expire.\nTest failed...\n");
+		return;
+	}
+	
+	sem_up_n (&queue_full, 2);
+	
+	if ((sem_try_down (&queue_full) != EOK) ||
+	    (sem_down_timeout (&queue_full, TIMEOUT) != EOK) ||
+	    (sem_get_value (&queue_full) != 0)) {
+		printk ("Failed to acquire a released semaphore.\n"
+		    "Test failed...\n");
+		return;
+	}
+	
+	sem_destroy (&queue_full);
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,126 @@
+/***
+ * Spinlock test #1
+ */
+
+static char * desc =
+    "Spinlock test #1\n"
+    "Lets threads spread over all CPUs increment shared counters\n"
+    "protected by a ticket spinlock and by an MCS lock, checks that\n"
+    "no increment is lost and reports the cost of a lock round trip.\n\n";
+
+
+#include <api.h>
+#include <synch/mcslock.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of threads and the number of
+ * increments done by each thread.
+ */
+#define THREAD_COUNT  (TASK_SIZE * 2)
+#define LOOP_COUNT    2000
+
+
+static SPINLOCK_DECLARE (ticket_lock);
+static MCSLOCK_DECLARE (mcs_lock);
+
+static volatile unsigned int ticket_counter;
+static volatile unsigned int mcs_counter;
+
+static atomic_t ticket_ticks;
+static atomic_t mcs_ticks;
+
+
+static void *
+thread_proc (void * data)
+{
+	unative_t start = timer_get ();
+	
+	for (unsigned int cnt = 0; cnt < LOOP_COUNT; cnt++) {
+		ipl_t state = spinlock_lock_irqsave (&ticket_lock);
+		
+		/* A deliberately non-atomic increment. */
+		unsigned int value = ticket_counter;
+		ticket_counter = value + 1;
+		
+		spinlock_unlock_irqrestore (&ticket_lock, state);
+	}
+	
+	atomic_add (&ticket_ticks, timer_get () - start);
+	start = timer_get ();
+	
+	for (unsigned int cnt = 0; cnt < LOOP_COUNT; cnt++) {
+		struct mcs_node node;
+		ipl_t state = mcslock_lock_irqsave (&mcs_lock, &node);
+		
+		/* A deliberately non-atomic increment. */
+		unsigned int value = mcs_counter;
+		mcs_counter = value + 1;
+		
+		mcslock_unlock_irqrestore (&mcs_lock, &node, state);
+	}
+	
+	atomic_add (&mcs_ticks, timer_get () - start);
+	
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	thread_t threads [THREAD_COUNT];
+	
+	printk (desc);
+	
+	ticket_counter = 0;
+	mcs_counter = 0;
+	atomic_set (&ticket_ticks, 0);
+	atomic_set (&mcs_ticks, 0);
+	
+	/*
+	 * The trylock has to fail on a held lock.
+	 */
+	if (!spinlock_trylock (&ticket_lock)) {
+		printk ("Unable to trylock a free spinlock.\nTest failed...\n");
+		return;
+	}
+	
+	if ((spinlock_trylock (&ticket_lock)) ||
+	    (!spinlock_locked (&ticket_lock))) {
+		printk ("Held spinlock acquired again.\nTest failed...\n");
+		return;
+	}
+	
+	spinlock_unlock (&ticket_lock);
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	printk ("Ticket lock: %u ticks per round trip.\n",
+	    atomic_get (&ticket_ticks) / (THREAD_COUNT * LOOP_COUNT));
+	printk ("MCS lock: %u ticks per round trip.\n",
+	    atomic_get (&mcs_ticks) / (THREAD_COUNT * LOOP_COUNT));
+	
+	if ((ticket_counter != THREAD_COUNT * LOOP_COUNT) ||
+	    (mcs_counter != THREAD_COUNT * LOOP_COUNT)) {
+		printk ("Lost increments: ticket %u, MCS %u of %u.\n"
+		    "Test failed...\n", ticket_counter, mcs_counter,
+		    THREAD_COUNT * LOOP_COUNT);
+		return;
+	}
+	
+	if (spinlock_locked (&ticket_lock)) {
+		printk ("Spinlock left locked.\nTest failed...\n");
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,145 @@
+/***
+ * High-resolution timer test #1
+ */
+
+static char * desc =
+    "High-resolution timer test #1\n"
+    "Lets a number of threads sleep for short periods and fires\n"
+    "high-resolution timers, checks that nothing wakes up early\n"
+    "and reports how many cycles late the wake-ups are.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of sleeping threads, the number of sleeps done
+ * by each thread and the longest sleep in microseconds.
+ */
+#define THREAD_COUNT  TASK_SIZE
+#define SLEEP_COUNT   50
+#define SLEEP_USEC    200
+
+/*
+ * The number of times the timer is restarted from its
+ * handler and the longest timeout in cycles.
+ */
+#define TIMER_ROUNDS   100
+#define TIMER_CYCLES   3000
+
+
+static atomic_t sleeps;
+static atomic_t early;
+static atomic_t late_cycles;
+static atomic_t max_late;
+
+static struct hrtimer timer;
+static unsigned int timer_seed;
+static volatile unsigned int timer_rounds;
+
+
+static void
+account (uint64_t expires, uint64_t now)
+{
+	if (now < expires) {
+		atomic_add (&early, 1);
+		return;
+	}
+	
+	unsigned int late = (unsigned int) (now - expires);
+	atomic_add (&late_cycles, late);
+	if (late > (unsigned int) atomic_get (&max_late))
+		atomic_set (&max_late, late);
+	
+	atomic_add (&sleeps, 1);
+}
+
+
+static void
+timer_proc (struct hrtimer * tmr, void * data)
+{
+	assert (tmr == &timer);
+	assert (data == &timer_seed);
+	
+	account (tmr->expires, cycles_get ());
+	
+	timer_rounds++;
+	if (timer_rounds < TIMER_ROUNDS) {
+		hrtimer_start (tmr, cycles_get () +
+		    1 + random (&timer_seed) % TIMER_CYCLES);
+	}
+}
+
+
+static void *
+thread_proc (void * data)
+{
+	unsigned int seed = (unsigned int) thread_get_current ();
+	
+	for (unsigned int cnt = 0; cnt < SLEEP_COUNT; cnt++) {
+		unsigned int usec = 1 + random (&seed) % SLEEP_USEC;
+		
+		uint64_t start = cycles_get ();
+		thread_usleep (usec);
+		account (start + usec_to_cycles (usec), cycles_get ());
+	}
+	
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	thread_t threads [THREAD_COUNT];
+	
+	printk (desc);
+	
+	atomic_set (&sleeps, 0);
+	atomic_set (&early, 0);
+	atomic_set (&late_cycles, 0);
+	atomic_set (&max_late, 0);
+	
+	timer_seed = 1;
+	timer_rounds = 0;
+	hrtimer_init (&timer, timer_proc, &timer_seed);
+	hrtimer_start (&timer, cycles_get () + TIMER_CYCLES);
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	while (timer_rounds < TIMER_ROUNDS)
+		thread_usleep (1000);
+	
+	hrtimer_cancel (&timer);
+	
+	unsigned int total = atomic_get (&sleeps);
+	
+	printk ("Woken up %u times, %u times early.\n", total,
+	    atomic_get (&early));
+	
+	if (total > 0) {
+		printk ("Average lateness %u cycles, maximum %u cycles.\n",
+		    atomic_get (&late_cycles) / total, atomic_get (&max_late));
+	}
+	
+	if (atomic_get (&early) > 0) {
+		printk ("Woken up before the expiration.\nTest failed...\n");
+		return;
+	}
+	
+	if (total != THREAD_COUNT * SLEEP_COUNT + TIMER_ROUNDS) {
+		printk ("Expected %u wake-ups.\nTest failed...\n",
+		    THREAD_COUNT * SLEEP_COUNT + TIMER_ROUNDS);
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
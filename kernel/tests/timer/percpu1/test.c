@@ -0,0 +1,149 @@
+/***
+ * Per-CPU timer test #1
+ */
+
+static char * desc =
+    "Per-CPU timer test #1\n"
+    "Starts plain and interrupt-safe timers from threads pinned to the\n"
+    "individual CPUs and checks that the handlers run on the CPU the\n"
+    "timers were started on, the interrupt-safe ones directly from\n"
+    "the timer interrupt handler.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of worker threads and the number
+ * of timers started by each worker thread.
+ */
+#define THREAD_COUNT  TASK_SIZE
+#define TIMER_ROUNDS  20
+
+
+struct test_timer {
+	struct timer timer;
+	unsigned int cpu;
+	volatile bool fired;
+};
+
+
+static atomic_t fired_irqsafe;
+static atomic_t fired_thread;
+static atomic_t violations;
+
+
+static void
+timer_proc (struct timer * timer, void * data)
+{
+	struct test_timer * tmr = (struct test_timer *) data;
+	assert (timer == &tmr->timer);
+	
+	ipl_t state = query_and_disable_interrupts ();
+	conditionally_enable_interrupts (state);
+	
+	bool irqsafe = ((timer->flags & TIMER_IRQSAFE) == TIMER_IRQSAFE);
+	
+	/* Interrupt-safe handlers run with disabled interrupts. */
+	if ((cpuid () != tmr->cpu) || ((irqsafe) && (state)) ||
+	    ((!irqsafe) && (!state)))
+		atomic_add (&violations, 1);
+	
+	if (irqsafe)
+		atomic_add (&fired_irqsafe, 1);
+	else
+		atomic_add (&fired_thread, 1);
+	
+	tmr->fired = true;
+}
+
+
+static void *
+thread_proc (void * data)
+{
+	unsigned int cpu = (unsigned int) data;
+	struct test_timer tmr;
+	
+	if (thread_set_affinity (thread_get_current (),
+	    CPUMASK_CPU (cpu)) != EOK) {
+		printk ("Unable to pin worker to cpu%u.\n", cpu);
+		atomic_add (&violations, 1);
+		return NULL;
+	}
+	
+	for (unsigned int cnt = 0; cnt < TIMER_ROUNDS; cnt++) {
+		timer_flags_t flags = ((cnt % 2) == 0) ?
+		    TIMER_IRQSAFE : TIMER_NONE;
+		
+		tmr.cpu = cpu;
+		tmr.fired = false;
+		timer_init_flags (&tmr.timer, 1 + cnt % 5, timer_proc,
+		    &tmr, flags);
+		timer_start (&tmr.timer);
+		
+		while (!tmr.fired)
+			thread_yield ();
+		
+		timer_destroy (&tmr.timer);
+	}
+	
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	thread_t threads [THREAD_COUNT];
+	unsigned int cpus [MAX_CPU];
+	unsigned int cpu_count = 0;
+	
+	printk (desc);
+	
+	atomic_set (&fired_irqsafe, 0);
+	atomic_set (&fired_thread, 0);
+	atomic_set (&violations, 0);
+	
+	/*
+	 * Find the running CPUs, setting an affinity
+	 * which contains no running CPU fails.
+	 */
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++) {
+		if (thread_set_affinity (thread_get_current (),
+		    CPUMASK_CPU (cpu)) == EOK) {
+			cpus [cpu_count] = cpu;
+			cpu_count++;
+		}
+	}
+	
+	thread_set_affinity (thread_get_current (), CPUMASK_ALL);
+	printk ("Found %u running CPU(s).\n", cpu_count);
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (thread_proc,
+		    (void *) cpus [cnt % cpu_count], 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	printk ("Fired %u interrupt-safe and %u thread timers.\n",
+	    atomic_get (&fired_irqsafe), atomic_get (&fired_thread));
+	
+	if (atomic_get (&violations) != 0) {
+		printk ("%u handler(s) ran in a wrong context.\n"
+		    "Test failed...\n", atomic_get (&violations));
+		return;
+	}
+	
+	if (atomic_get (&fired_irqsafe) + atomic_get (&fired_thread) !=
+	    THREAD_COUNT * TIMER_ROUNDS) {
+		printk ("Expected %u timers.\nTest failed...\n",
+		    THREAD_COUNT * TIMER_ROUNDS);
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,159 @@
+/***
+ * Timer slack test #1
+ */
+
+static char * desc =
+    "Timer slack test #1\n"
+    "Lets many threads sleep on timers with random timeouts, first\n"
+    "without and then with a slack, checks that no thread wakes up\n"
+    "early and reports how many timer interrupts the slack saves.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of sleeping threads, the number of sleeps done
+ * by each thread and the range of the timeouts in jiffies.
+ */
+#define THREAD_COUNT  (TASK_SIZE * 4)
+#define SLEEP_COUNT   10
+#define SLEEP_MIN     20
+#define SLEEP_RANGE   80
+
+/*
+ * The slack of the timers is the timeout shifted
+ * right by the given number of bits.
+ */
+#define SLACK_SHIFT  3
+
+
+static atomic_t early;
+static atomic_t late_jiffies;
+static bool use_slack;
+
+
+static void
+timer_proc (struct timer * timer, void * data)
+{
+	thread_wakeup ((thread_t) data);
+}
+
+
+static void *
+thread_proc (void * data)
+{
+	unsigned int seed = (unsigned int) thread_get_current ();
+	struct timer tmr;
+	
+	for (unsigned int cnt = 0; cnt < SLEEP_COUNT; cnt++) {
+		unsigned int timeout = SLEEP_MIN + random (&seed) % SLEEP_RANGE;
+		
+		timer_init_flags (&tmr, timeout, timer_proc,
+		    thread_get_current (), TIMER_IRQSAFE);
+		if (use_slack)
+			timer_set_slack (&tmr, timeout >> SLACK_SHIFT);
+		
+		/*
+		 * The timer runs on the current CPU, disabling interrupts
+		 * thus makes sure it does not expire before the suspend.
+		 */
+		ipl_t state = query_and_disable_interrupts ();
+		
+		unsigned int start = jiffies_get ();
+		timer_start (&tmr);
+		thread_suspend ();
+		unsigned int slept = jiffies_get () - start;
+		
+		conditionally_enable_interrupts (state);
+		timer_destroy (&tmr);
+		
+		if (slept < timeout)
+			atomic_add (&early, 1);
+		else
+			atomic_add (&late_jiffies, slept - timeout);
+	}
+	
+	return NULL;
+}
+
+
+static void
+get_stats (struct timer_stats * total)
+{
+	struct timer_stats stats;
+	
+	total->interrupts = 0;
+	total->expired = 0;
+	total->batches = 0;
+	total->deferred = 0;
+	
+	for (unsigned int cpu = 0; cpu < MAX_CPU; cpu++) {
+		if (!timers_get_stats (cpu, &stats))
+			continue;
+		
+		total->interrupts += stats.interrupts;
+		total->expired += stats.expired;
+		total->batches += stats.batches;
+		total->deferred += stats.deferred;
+	}
+}
+
+
+static unsigned int
+run_sleepers (bool slack)
+{
+	thread_t threads [THREAD_COUNT];
+	struct timer_stats before;
+	struct timer_stats after;
+	
+	use_slack = slack;
+	atomic_set (&late_jiffies, 0);
+	get_stats (&before);
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	get_stats (&after);
+	
+	unsigned int expired = after.expired - before.expired;
+	unsigned int batches = after.batches - before.batches;
+	
+	printk ("%s slack: %u timers expired in %u interrupts "
+	    "(%u total, %u deferred), average lateness %u jiffies.\n",
+	    slack ? "With" : "Without", expired, batches,
+	    after.interrupts - before.interrupts,
+	    after.deferred - before.deferred,
+	    atomic_get (&late_jiffies) / (THREAD_COUNT * SLEEP_COUNT));
+	
+	return batches;
+}
+
+
+void
+test_run (void)
+{
+	printk (desc);
+	atomic_set (&early, 0);
+	
+	unsigned int exact = run_sleepers (false);
+	unsigned int coalesced = run_sleepers (true);
+	
+	printk ("Timer interrupts saved: %d.\n",
+	    (int) exact - (int) coalesced);
+	
+	if (atomic_get (&early) > 0) {
+		printk ("%u thread(s) woken up early.\nTest failed...\n",
+		    atomic_get (&early));
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
@@ -0,0 +1,165 @@
+/***
+ * Timing wheel test #1
+ */
+
+static char * desc =
+    "Timing wheel test #1\n"
+    "Keeps thousands of timers with random timeouts pending together\n"
+    "with a number of sleeping threads and reports the cost of starting\n"
+    "a timer and how late the timers fire.\n\n";
+
+
+#include <api.h>
+#include "../../include/defs.h"
+
+
+/*
+ * The number of timers, the number of times each timer
+ * is started and the longest timeout in jiffies.
+ */
+#define TIMER_COUNT    2000
+#define TIMER_ROUNDS   5
+#define TIMER_TIMEOUT  600
+
+/*
+ * The number of sleeping threads and the number
+ * of sleeps done by each thread.
+ */
+#define THREAD_COUNT  (TASK_SIZE * 4)
+#define SLEEP_COUNT   10
+
+/*
+ * The duration of the test in seconds after
+ * which the test is considered to have failed.
+ */
+#define TEST_DURATION  60
+
+
+struct test_timer {
+	struct timer timer;
+	unsigned int rounds;
+	unsigned int seed;
+};
+
+
+static struct test_timer * timers;
+
+static atomic_t fired;
+static atomic_t late_jiffies;
+static atomic_t max_late;
+static atomic_t start_ticks;
+
+
+static void
+start_timer (struct test_timer * tmr)
+{
+	tmr->timer.timeout = 1 + random (&tmr->seed) % TIMER_TIMEOUT;
+	
+	unative_t start = timer_get ();
+	timer_start (&tmr->timer);
+	atomic_add (&start_ticks, timer_get () - start);
+}
+
+
+static void
+timer_proc (struct timer * timer, void * data)
+{
+	struct test_timer * tmr = (struct test_timer *) data;
+	assert (timer == &tmr->timer);
+	
+	/* A timer is due once the jiffies exceed its expiration. */
+	unsigned int late = jiffies_get () - timer->expires - 1;
+	atomic_add (&late_jiffies, late);
+	if (late > (unsigned int) atomic_get (&max_late))
+		atomic_set (&max_late, late);
+	
+	atomic_add (&fired, 1);
+	
+	tmr->rounds++;
+	if (tmr->rounds < TIMER_ROUNDS)
+		start_timer (tmr);
+}
+
+
+static void *
+thread_proc (void * data)
+{
+	unsigned int seed = (unsigned int) thread_get_current ();
+	
+	for (unsigned int cnt = 0; cnt < SLEEP_COUNT; cnt++)
+		thread_usleep (1000 + random (&seed) % 100000);
+	
+	return NULL;
+}
+
+
+void
+test_run (void)
+{
+	thread_t threads [THREAD_COUNT];
+	
+	printk (desc);
+	
+	timers = (struct test_timer *)
+	    safe_malloc (TIMER_COUNT * sizeof (struct test_timer));
+	
+	atomic_set (&fired, 0);
+	atomic_set (&late_jiffies, 0);
+	atomic_set (&max_late, 0);
+	atomic_set (&start_ticks, 0);
+	
+	unsigned int start = jiffies_get ();
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		threads [cnt] = robust_thread_create (
+		    thread_proc, THREAD_MAGIC, 0);
+	}
+	
+	for (unsigned int cnt = 0; cnt < TIMER_COUNT; cnt++) {
+		struct test_timer * tmr = &timers [cnt];
+		
+		tmr->rounds = 0;
+		tmr->seed = cnt;
+		timer_init_jiffies (&tmr->timer, 0, timer_proc, tmr);
+		start_timer (tmr);
+	}
+	
+	/*
+	 * Wait for all the timers to fire.
+	 */
+	unsigned int seconds = 0;
+	while ((atomic_get (&fired) < TIMER_COUNT * TIMER_ROUNDS) &&
+	    (seconds < TEST_DURATION)) {
+		thread_sleep (1);
+		seconds++;
+	}
+	
+	for (unsigned int cnt = 0; cnt < THREAD_COUNT; cnt++) {
+		robust_thread_join (threads [cnt]);
+	}
+	
+	for (unsigned int cnt = 0; cnt < TIMER_COUNT; cnt++)
+		timer_destroy (&timers [cnt].timer);
+	
+	unsigned int total = atomic_get (&fired);
+	
+	printk ("Fired %u timers in %u jiffies.\n", total,
+	    jiffies_get () - start);
+	
+	if (total > 0) {
+		printk ("Average %u ticks per timer start, "
+		    "average lateness %u jiffies, maximum %u jiffies.\n",
+		    atomic_get (&start_ticks) / total,
+		    atomic_get (&late_jiffies) / total, atomic_get (&max_late));
+	}
+	
+	free (timers);
+	
+	if (total != TIMER_COUNT * TIMER_ROUNDS) {
+		printk ("Expected %u timers.\nTest failed...\n",
+		    TIMER_COUNT * TIMER_ROUNDS);
+		return;
+	}
+	
+	printk ("Test passed...\n");
+}
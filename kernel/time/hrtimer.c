@@ -0,0 +1,261 @@
+/**
+ * @file hrtimer.c
+ *
+ * High-resolution timers.
+ *
+ * Unlike the timers based on jiffies, the high-resolution timers expire
+ * at an exact cycle of the CPU they were started on. Each CPU keeps its
+ * timers in a red-black tree sorted by the expiration time and programs
+ * its timer interrupt for the first one. The handlers are called from
+ * the timer interrupt handler with disabled interrupts and must not
+ * block.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/rbtree.h>
+#include <sched/sched.h>
+#include <synch/spinlock.h>
+#include <drivers/dorder.h>
+#include <mm/percpu.h>
+
+#include <time/hrtimer.h>
+
+
+/** High-resolution timers of a single CPU
+ *
+ * The structure is valid when zero-initialized.
+ *
+ */
+struct hrtimer_base {
+	/** Lock protecting the tree */
+	spinlock_t lock;
+	
+	/** Tree of pending timers sorted by expiration */
+	struct rbtree tree;
+	
+	/** The first timer to expire */
+	struct hrtimer *first;
+	
+	/** Timer whose handler is running */
+	struct hrtimer *running;
+};
+
+
+/** High-resolution timers of each CPU */
+static DEFINE_PER_CPU (struct hrtimer_base, hrtimer_base);
+
+
+/** Insert a timer into the tree of a CPU
+ *
+ * Timers with the same expiration time are kept
+ * in the order in which they were started.
+ *
+ * Must be called with the lock of the base held.
+ *
+ * @param base  Timers of the CPU.
+ * @param timer Timer to insert.
+ *
+ * @return True if the timer is the first to expire.
+ *
+ */
+static bool hrtimer_enqueue (struct hrtimer_base *base, struct hrtimer *timer)
+{
+	struct rbnode **link = &base->tree.root;
+	struct rbnode *parent = RBTREE_NULL;
+	bool first = true;
+	
+	while (rbtree_is_node (*link)) {
+		parent = *link;
+		struct hrtimer *other =
+		    rbtree_item (parent, struct hrtimer, node);
+		
+		if (timer->expires < other->expires)
+			link = &parent->left;
+		else {
+			link = &parent->right;
+			first = false;
+		}
+	}
+	
+	rbtree_insert (&base->tree, &timer->node, parent, link);
+	timer->queued = true;
+	
+	if (first)
+		base->first = timer;
+	
+	return first;
+}
+
+
+/** Remove a timer from the tree of a CPU
+ *
+ * Must be called with the lock of the base held.
+ *
+ * @param base  Timers of the CPU.
+ * @param timer Timer to remove.
+ *
+ */
+static void hrtimer_dequeue (struct hrtimer_base *base, struct hrtimer *timer)
+{
+	if (base->first == timer) {
+		struct rbnode *next = rbtree_next (&timer->node);
+		base->first = rbtree_is_node (next) ?
+		    rbtree_item (next, struct hrtimer, node) : NULL;
+	}
+	
+	rbtree_delete (&base->tree, &timer->node);
+	timer->queued = false;
+}
+
+
+/** Initialize a high-resolution timer
+ *
+ * @param timer   Timer to initialize.
+ * @param handler Timer handler function called at expiration.
+ * @param data    Data to be passed to the handler.
+ *
+ */
+void hrtimer_init (struct hrtimer *timer, hrtimer_fn handler, void *data)
+{
+	rbtree_init (&timer->node);
+	timer->expires = 0;
+	timer->cpu = 0;
+	timer->queued = false;
+	timer->handler = handler;
+	timer->data = data;
+}
+
+
+/** Start a high-resolution timer
+ *
+ * The timer is put in the tree of the current CPU, which
+ * reprograms its timer interrupt if the timer is the first
+ * to expire. A pending timer is restarted. The function
+ * can be called from the handler of the timer.
+ *
+ * @param timer   Timer to start.
+ * @param expires Absolute expiration time in cycles of the current CPU.
+ *
+ */
+void hrtimer_start (struct hrtimer *timer, const uint64_t expires)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	struct hrtimer_base *base = &per_cpu (hrtimer_base, timer->cpu);
+	
+	spinlock_lock (&base->lock);
+	if (timer->queued)
+		hrtimer_dequeue (base, timer);
+	spinlock_unlock (&base->lock);
+	
+	timer->cpu = cpuid ();
+	timer->expires = expires;
+	base = &per_cpu (hrtimer_base, timer->cpu);
+	
+	spinlock_lock (&base->lock);
+	bool first = hrtimer_enqueue (base, timer);
+	spinlock_unlock (&base->lock);
+	
+	if (first)
+		sched_timers_changed (timer->cpu);
+	
+	conditionally_enable_interrupts (state);
+}
+
+
+/** Cancel a high-resolution timer
+ *
+ * If the handler of the timer is running, wait for it to complete.
+ * The function must not be called from the handler of the timer.
+ *
+ * @param timer Timer to cancel.
+ *
+ * @return True if the timer was pending.
+ *
+ */
+bool hrtimer_cancel (struct hrtimer *timer)
+{
+	/* Disable interrupts while accessing shared structures. */
+	ipl_t state = query_and_disable_interrupts ();
+	
+	struct hrtimer_base *base = &per_cpu (hrtimer_base, timer->cpu);
+	
+	spinlock_lock (&base->lock);
+	bool pending = timer->queued;
+	if (pending)
+		hrtimer_dequeue (base, timer);
+	spinlock_unlock (&base->lock);
+	
+	/* The handler runs on the CPU of the timer with disabled interrupts. */
+	while (base->running == timer)
+		memory_barrier ();
+	
+	conditionally_enable_interrupts (state);
+	return pending;
+}
+
+
+/** Run the expired high-resolution timers of the current CPU
+ *
+ * This function is called from sched_timer() with disabled
+ * interrupts. The lock is released while a handler runs so
+ * that the handler can start the timer again.
+ *
+ */
+void hrtimers_run (void)
+{
+	struct hrtimer_base *base = &this_cpu (hrtimer_base);
+	uint64_t now = cycles_get ();
+	
+	spinlock_lock (&base->lock);
+	
+	while ((base->first != NULL) && (base->first->expires <= now)) {
+		struct hrtimer *timer = base->first;
+		hrtimer_dequeue (base, timer);
+		base->running = timer;
+		
+		spinlock_unlock (&base->lock);
+		timer->handler (timer, timer->data);
+		spinlock_lock (&base->lock);
+		
+		base->running = NULL;
+	}
+	
+	spinlock_unlock (&base->lock);
+}
+
+
+/** Find the nearest high-resolution timer expiration
+ *
+ * This function is called by the scheduler with disabled
+ * interrupts to program the timer interrupt.
+ *
+ * @param expires Storage for the expiration time in cycles.
+ *
+ * @return True if there is a pending timer on the current CPU.
+ *
+ */
+bool hrtimers_next_expiry (uint64_t *expires)
+{
+	struct hrtimer_base *base = &this_cpu (hrtimer_base);
+	
+	spinlock_lock (&base->lock);
+	
+	bool pending = (base->first != NULL);
+	if (pending)
+		*expires = base->first->expires;
+	
+	spinlock_unlock (&base->lock);
+	return pending;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file hrtimer.h
+ *
+ * High-resolution timers.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#ifndef HRTIMER_H_
+#define HRTIMER_H_
+
+
+#include <include/shared.h>
+#include <include/c.h>
+
+#include <adt/rbtree.h>
+
+
+/** High-resolution timer callback function.
+ *
+ */
+struct hrtimer;
+
+typedef void (* hrtimer_fn) (struct hrtimer *timer, void *data);
+
+
+/** High-resolution timer control structure.
+ *
+ */
+struct hrtimer {
+	/** A timer is a node of the tree of its CPU */
+	struct rbnode node;
+	
+	/** Absolute expiration time in cycles */
+	uint64_t expires;
+	
+	/** CPU whose tree the timer is in */
+	unsigned int cpu;
+	
+	/** The timer is in the tree */
+	bool queued;
+	
+	/** Callback handler */
+	hrtimer_fn handler;
+	
+	/** Callback data */
+	void *data;
+};
+
+
+/* Externals are commented with implementation */
+extern void hrtimer_init (struct hrtimer *timer, hrtimer_fn handler,
+    void *data);
+extern void hrtimer_start (struct hrtimer *timer, const uint64_t expires);
+extern bool hrtimer_cancel (struct hrtimer *timer);
+extern void hrtimers_run (void);
+extern bool hrtimers_next_expiry (uint64_t *expires);
+
+
+#endif /* HRTIMER_H_ */
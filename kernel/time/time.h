@@ -28,6 +28,12 @@
  */
 #define TIMER_PERIOD  1000
 
+/** Number of CPU cycles in a jiffy */
+#define JIFFY_CYCLES  4000
+
+/** Number of CPU cycles in a microsecond */
+#define CYCLES_PER_USEC  ((JIFFY_CYCLES * TIMER_PERIOD) / 1000000)
+
 
 /** Convert relative time from seconds to jiffies
  *
@@ -69,4 +75,54 @@ static inline unsigned int jiffies_to_usec (unsigned int jiffies)
 }
 
 
+/** Convert relative time from microseconds to cycles
+ *
+ */
+static inline uint64_t usec_to_cycles (unsigned int usec)
+{
+	return ((uint64_t) usec) * CYCLES_PER_USEC;
+}
+
+
+/** Convert relative time from nanoseconds to cycles
+ *
+ * Always rounds up towards the higher value.
+ *
+ */
+static inline uint64_t nsec_to_cycles (unsigned int nsec)
+{
+	return usec_to_cycles (nsec / 1000) +
+	    ((nsec % 1000) * CYCLES_PER_USEC + 999) / 1000;
+}
+
+
+/** Convert relative time from cycles to microseconds
+ *
+ * Always rounds up towards the higher value, saturates
+ * at the highest representable value. The number of cycles
+ * per microsecond is a power of two, the division thus
+ * compiles to a shift.
+ *
+ */
+static inline unsigned int cycles_to_usec (uint64_t cycles)
+{
+	uint64_t usec = (cycles + CYCLES_PER_USEC - 1) / CYCLES_PER_USEC;
+	return (usec > 0xffffffffU) ? 0xffffffffU : (unsigned int) usec;
+}
+
+
+/** Convert relative time from cycles to nanoseconds
+ *
+ * Saturates at the highest representable value.
+ *
+ */
+static inline unsigned int cycles_to_nsec (uint64_t cycles)
+{
+	if (cycles > 0xffffffffU / 1000)
+		return 0xffffffffU;
+	
+	return (((unsigned int) cycles) * 1000) / CYCLES_PER_USEC;
+}
+
+
 #endif /* TIME_H_ */
@@ -3,6 +3,24 @@
  *
  * Timers.
  *
+ * The pending timers are kept in a hierarchical timing wheel. The first
+ * level has a slot for each of the next TIMER_ROOT_SLOTS jiffies, each
+ * of the other levels covers TIMER_LEVEL_SLOTS times longer period with
+ * the same number of slots. Starting and destroying a timer is a matter
+ * of linking it to or unlinking it from a slot. As the time advances,
+ * the slots of the higher levels are cascaded into the lower levels,
+ * which makes the expiry processing amortized constant per timer.
+ *
+ * Each CPU has its own timing wheel, which holds the timers started on
+ * that CPU and is processed by its timer interrupt. The handlers of the
+ * timers flagged TIMER_IRQSAFE are called directly from the interrupt
+ * handler, the other handlers are called by the timer thread of the CPU.
+ *
+ * A timer can tolerate a delay of its expiration, called the slack. The
+ * expiration is then rounded up to a boundary shared with other timers
+ * expiring at about the same time, so that a single timer interrupt
+ * expires them together.
+ *
  * Kalisto
  *
  * Copyright (c) 2001-2015
@@ -17,15 +35,76 @@
 
 #include <proc/thread.h>
 #include <sched/sched.h>
+#include <synch/spinlock.h>
+#include <drivers/dorder.h>
 
 #include <time/timer.h>
 
 
-/** List of timers */
-static list_t timers_list;
+/** Number of bits of the expiration time covered by the first level */
+#define TIMER_ROOT_BITS  8
+
+/** Number of bits of the expiration time covered by the other levels */
+#define TIMER_LEVEL_BITS  6
+
+/** Number of levels above the first one (together covering 32 bits) */
+#define TIMER_LEVELS  4
+
+#define TIMER_ROOT_SLOTS   (1 << TIMER_ROOT_BITS)
+#define TIMER_LEVEL_SLOTS  (1 << TIMER_LEVEL_BITS)
+#define TIMER_ROOT_MASK    (TIMER_ROOT_SLOTS - 1)
+#define TIMER_LEVEL_MASK   (TIMER_LEVEL_SLOTS - 1)
+
+/** Number of low bits of the expiration time below a level */
+#define TIMER_LEVEL_SHIFT(level) \
+	(TIMER_ROOT_BITS + (level) * TIMER_LEVEL_BITS)
+
+
+/** Timers of a single CPU
+ *
+ * Aligned to the cache line size, the timers of a CPU
+ * are mostly accessed by the CPU alone.
+ *
+ */
+struct timer_base {
+	/** Lock protecting the timing wheel and the lists of expired timers */
+	spinlock_t lock;
+	
+	/** First level of the timing wheel, one slot per jiffy */
+	list_t root[TIMER_ROOT_SLOTS];
+	
+	/** Higher levels of the timing wheel */
+	list_t levels[TIMER_LEVELS][TIMER_LEVEL_SLOTS];
+	
+	/** Expired timers waiting for the timer thread */
+	list_t expired;
+	
+	/** Expired timers whose handlers run in the interrupt handler */
+	list_t expired_irqsafe;
+	
+	/** The next jiffy to be processed by the timing wheel */
+	unsigned int jiffies;
+	
+	/** Number of started timers whose handler has not been run yet */
+	unsigned int pending;
+	
+	/** Nearest jiffy at which the timing wheel needs attention
+	    (can be earlier than necessary, never later) */
+	unsigned int next;
+	
+	/** The nearest jiffy has to be looked up again */
+	bool next_stale;
+	
+	/** Statistics */
+	struct timer_stats stats;
+	
+	/** Timer thread of the CPU */
+	thread_t thread;
+} __attribute__((aligned (CACHE_LINE_SIZE)));
+
 
-/** Timer thread */
-static thread_t timer_thread;
+/** Timers of all CPUs */
+static struct timer_base timer_bases[MAX_CPU];
 
 
 /** Check if timer is pending.
@@ -37,140 +116,503 @@ static int timer_pending (struct timer *timer)
 }
 
 
-/** Remove timer from the list of timers
+/** Remove timer from the timing wheel of its CPU
+ *
+ * Must be called with the lock of the timer base held.
  *
  */
-static void timer_remove (struct timer *timer)
+static void timer_remove (struct timer_base *base, struct timer *timer)
 {
 	list_remove (&timer->link);
+	base->pending--;
+}
+
+
+/** Link a timer to the slot of the timing wheel it expires in
+ *
+ * The level is chosen by the distance of the expiration time from
+ * the next jiffy to be processed. A timer that has already expired
+ * is put in the slot that is processed next.
+ *
+ * Must be called with the lock of the timer base held.
+ *
+ * @param base  Timers of the CPU.
+ * @param timer Timer to link.
+ *
+ */
+static void timer_enqueue (struct timer_base *base, struct timer *timer)
+{
+	unsigned int distance = timer->expires - base->jiffies;
+	list_t *slot;
+	
+	if ((native_t) distance < 0)
+		slot = &base->root[base->jiffies & TIMER_ROOT_MASK];
+	else if (distance < TIMER_ROOT_SLOTS)
+		slot = &base->root[timer->expires & TIMER_ROOT_MASK];
+	else {
+		unsigned int level = 0;
+		while ((level < TIMER_LEVELS - 1) &&
+		    (distance >= (1U << TIMER_LEVEL_SHIFT (level + 1))))
+			level++;
+		
+		unsigned int shift = TIMER_LEVEL_SHIFT (level);
+		slot = &base->levels[level][(timer->expires >> shift) &
+		    TIMER_LEVEL_MASK];
+	}
+	
+	list_append (slot, &timer->link);
+}
+
+
+/** Cascade a slot of a higher level into the lower levels
+ *
+ * Must be called with the lock of the timer base held.
+ *
+ * @param base  Timers of the CPU.
+ * @param level Level of the slot.
+ * @param index Index of the slot within the level.
+ *
+ * @return The index of the slot.
+ *
+ */
+static unsigned int timers_cascade (struct timer_base *base,
+    unsigned int level, unsigned int index)
+{
+	list_t *slot = &base->levels[level][index];
+	link_t *link;
+	
+	while ((link = list_pop (slot)) != NULL)
+		timer_enqueue (base, list_item (link, struct timer, link));
+	
+	return index;
+}
+
+
+/** Move the timing wheel forward
+ *
+ * Processes all jiffies up to the current time. The timers
+ * in the slot of each processed jiffy are moved to one of the
+ * lists of expired timers. Whenever the first level wraps around,
+ * the next slot of the higher levels is cascaded.
+ *
+ * Must be called with the lock of the timer base held.
+ *
+ * @param base    Timers of the CPU.
+ * @param jiffies Current time.
+ *
+ */
+static void timers_advance (struct timer_base *base, unsigned int jiffies)
+{
+	/* With no timers, there is nothing to process on the way. */
+	if (base->pending == 0) {
+		base->jiffies = jiffies;
+		return;
+	}
+	
+	unsigned int expired = 0;
+	
+	/* A timer is run once the jiffies exceed its expiration. */
+	while ((native_t) (jiffies - base->jiffies) > 0) {
+		unsigned int index = base->jiffies & TIMER_ROOT_MASK;
+		
+		/*
+		 * Cascade the next slot of each level whose
+		 * lower level has just wrapped around.
+		 */
+		unsigned int level = 0;
+		bool wrapped = (index == 0);
+		
+		while ((wrapped) && (level < TIMER_LEVELS)) {
+			unsigned int slot = (base->jiffies >>
+			    TIMER_LEVEL_SHIFT (level)) & TIMER_LEVEL_MASK;
+			
+			wrapped = (timers_cascade (base, level, slot) == 0);
+			level++;
+		}
+		
+		link_t *link;
+		while ((link = list_pop (&base->root[index])) != NULL) {
+			struct timer *timer =
+			    list_item (link, struct timer, link);
+			
+			base->stats.expired++;
+			expired++;
+			
+			if ((timer->flags & TIMER_IRQSAFE) == TIMER_IRQSAFE)
+				list_append (&base->expired_irqsafe, link);
+			else
+				list_append (&base->expired, link);
+		}
+		
+		base->jiffies++;
+	}
+	
+	if (expired > 0)
+		base->stats.batches++;
+	
+	if ((native_t) (base->next - base->jiffies) < 0)
+		base->next_stale = true;
+}
+
+
+/** Look up the nearest jiffy at which the timing wheel needs attention
+ *
+ * On the first level, this is the expiration of the nearest timer.
+ * On the higher levels, the expiration is only known to be no sooner
+ * than the cascade of the slot, which is used instead.
+ *
+ * Must be called with the lock of the timer base held.
+ *
+ * @param base Timers of the CPU.
+ *
+ * @return The nearest jiffy.
+ *
+ */
+static unsigned int timers_lookup_next (struct timer_base *base)
+{
+	unsigned int next = base->jiffies + (1U << 30);
+	
+	for (unsigned int i = 0; i < TIMER_ROOT_SLOTS; i++) {
+		unsigned int jiffy = base->jiffies + i;
+		
+		if (!list_empty (&base->root[jiffy & TIMER_ROOT_MASK])) {
+			next = jiffy;
+			break;
+		}
+	}
+	
+	for (unsigned int level = 0; level < TIMER_LEVELS; level++) {
+		unsigned int shift = TIMER_LEVEL_SHIFT (level);
+		unsigned int period = base->jiffies >> shift;
+		
+		for (unsigned int i = 1; i <= TIMER_LEVEL_SLOTS; i++) {
+			unsigned int index = (period + i) & TIMER_LEVEL_MASK;
+			
+			if (!list_empty (&base->levels[level][index])) {
+				unsigned int cascade = (period + i) << shift;
+				if ((native_t) (cascade - next) < 0)
+					next = cascade;
+				
+				break;
+			}
+		}
+	}
+	
+	return next;
+}
+
+
+/** Pop an expired timer and mark its handler as running
+ *
+ * Must be called with the lock of the timer base held.
+ *
+ * @param base    Timers of the CPU.
+ * @param expired List of expired timers.
+ *
+ * @return The expired timer or NULL if there is none.
+ *
+ */
+static struct timer *timers_pop_expired (struct timer_base *base,
+    list_t *expired)
+{
+	link_t *link = list_pop (expired);
+	if (link == NULL)
+		return NULL;
+	
+	struct timer *timer = list_item (link, struct timer, link);
+	base->pending--;
+	timer->running = true;
+	
+	return timer;
 }
 
 
 /** Process expired timers
  *
  * If there are any expired timers, they are executed within
- * the context of this thread.
- *
- * TODO: The performance of this code is really poor. This could
- * be improved by sorting the list of timers according to the
- * expiration time.
+ * the context of this thread. The thread is bound to the CPU
+ * whose timers it processes.
  *
  */
 static void *timer_thread_func (void *data)
 {
+	struct timer_base *base = (struct timer_base *) data;
+	
 	while (true) {
 		/*
 		 * Handle expired timers.
 		 */
 		
 		struct timer *expired_timer;
-		timer_fn handler;
-		void *data;
 		
 		do {
-			expired_timer = NULL;
-			handler = NULL;
-			data = NULL;
-			
-			ipl_t status = query_and_disable_interrupts ();
-			
-			list_foreach (timers_list, struct timer, link, timer) {
-				if (timer->expires < jiffies) {
-					expired_timer = timer;
-					break;
-				}
-			}
-			
-			if (expired_timer != NULL) {
-				timer_remove (expired_timer);
-				expired_timer->running = true;
-				handler = expired_timer->handler;
-				data = expired_timer->data;
-			}
-			
-			conditionally_enable_interrupts (status);
+			ipl_t status = spinlock_lock_irqsave (&base->lock);
+			expired_timer =
+			    timers_pop_expired (base, &base->expired);
+			spinlock_unlock_irqrestore (&base->lock, status);
 			
 			/* Run the timer */
-			if (handler != NULL)
-				handler (expired_timer, data);
-			
-			status = query_and_disable_interrupts ();
-			
-			if (expired_timer != NULL)
+			if (expired_timer != NULL) {
+				expired_timer->handler (expired_timer,
+				    expired_timer->data);
 				expired_timer->running = false;
-			
-			conditionally_enable_interrupts (status);
+			}
 		} while (expired_timer != NULL);
 		
-		thread_suspend ();
+		/*
+		 * The timers expire on the same CPU the thread is bound to,
+		 * disabling interrupts thus makes sure that no timer expires
+		 * between the check and the suspend.
+		 */
+		ipl_t status = query_and_disable_interrupts ();
+		
+		spinlock_lock (&base->lock);
+		bool idle = list_empty (&base->expired);
+		spinlock_unlock (&base->lock);
+		
+		if (idle)
+			thread_suspend ();
+		
+		conditionally_enable_interrupts (status);
 	}
 	
 	return NULL;
 }
 
-/** Initialize the timers framework
+/** Initialize the timers of the current CPU
+ *
+ * Called by each CPU once its scheduler is initialized.
  *
  */
 int timers_init (void)
 {
-	/* Initialize the list of schedulable threads. */
-	list_init (&timers_list);
+	unsigned int cpu = cpuid ();
+	struct timer_base *base = &timer_bases[cpu];
+	
+	/* Initialize the timing wheel. */
+	spinlock_init (&base->lock);
+	
+	for (unsigned int i = 0; i < TIMER_ROOT_SLOTS; i++)
+		list_init (&base->root[i]);
+	
+	for (unsigned int level = 0; level < TIMER_LEVELS; level++) {
+		for (unsigned int i = 0; i < TIMER_LEVEL_SLOTS; i++)
+			list_init (&base->levels[level][i]);
+	}
+	
+	list_init (&base->expired);
+	list_init (&base->expired_irqsafe);
+	
+	base->jiffies = jiffies_get ();
+	base->pending = 0;
+	base->next_stale = true;
 	
 	/* Create the timer thread. */
-	return thread_create (&timer_thread, timer_thread_func, NULL, 0);
+	int rc = thread_create (&base->thread, timer_thread_func, base, 0);
+	if (rc != EOK)
+		return rc;
+	
+	/* The timers are run by the CPU they were started on. */
+	return thread_set_affinity (base->thread, CPUMASK_CPU (cpu));
 }
 
 
 /** Check for expired timers
  *
- * If there are any expired timers, the timer thread is woken up
- * to service them.
+ * The timing wheel of the current CPU is moved forward to the
+ * current time. The handlers of the expired TIMER_IRQSAFE timers
+ * are run right away, with the lock released so that they can
+ * start timers. If there are any other expired timers, the timer
+ * thread is woken up to service them.
  *
  * This function is called from sched_timer() with disabled
- * interrupts. Therefore it is safe to access the timer list.
- *
- * TODO: The performance of this code is really poor. This could
- * be improved by sorting the list of timers according to the
- * expiration time.
+ * interrupts.
  *
  */
 void timers_run (void)
 {
-	list_foreach (timers_list, struct timer, link, timer) {
-		if (timer->expires < jiffies) {
-			thread_wakeup (timer_thread);
-			break;
+	struct timer_base *base = &timer_bases[cpuid ()];
+	
+	spinlock_lock (&base->lock);
+	
+	base->stats.interrupts++;
+	timers_advance (base, jiffies_get ());
+	
+	struct timer *timer;
+	while ((timer = timers_pop_expired (base,
+	    &base->expired_irqsafe)) != NULL) {
+		spinlock_unlock (&base->lock);
+		
+		timer->handler (timer, timer->data);
+		timer->running = false;
+		
+		spinlock_lock (&base->lock);
+	}
+	
+	bool expired = !list_empty (&base->expired);
+	
+	spinlock_unlock (&base->lock);
+	
+	if (expired)
+		thread_wakeup (base->thread);
+}
+
+
+/** Find the nearest timer expiration on the current CPU
+ *
+ * The result might be earlier than the expiration of any timer,
+ * in which case the timing wheel is just moved forward then.
+ *
+ * This function is called by the scheduler with disabled
+ * interrupts to program the timer interrupt.
+ *
+ * @param expires Storage for the expiration time in jiffies.
+ *
+ * @return True if there is a pending timer.
+ *
+ */
+bool timers_next_expiry (unsigned int *expires)
+{
+	struct timer_base *base = &timer_bases[cpuid ()];
+	
+	spinlock_lock (&base->lock);
+	
+	bool pending = (base->pending > 0);
+	
+	if (pending) {
+		if (base->next_stale) {
+			base->next = timers_lookup_next (base);
+			base->next_stale = false;
 		}
+		
+		/* The wheel processes a jiffy once the jiffies exceed it. */
+		*expires = base->next;
 	}
+	
+	spinlock_unlock (&base->lock);
+	return pending;
 }
 
 
-/** Initialize timer
+/** Get the timer statistics of a CPU
+ *
+ * @param cpu   CPU to get the statistics for.
+ * @param stats Storage for the statistics.
+ *
+ * @return True if the timers of the CPU are initialized.
+ *
+ */
+bool timers_get_stats (unsigned int cpu, struct timer_stats *stats)
+{
+	struct timer_base *base = &timer_bases[cpu];
+	
+	ipl_t state = spinlock_lock_irqsave (&base->lock);
+	*stats = base->stats;
+	bool initialized = (base->thread != NULL);
+	spinlock_unlock_irqrestore (&base->lock, state);
+	
+	return initialized;
+}
+
+
+/** Initialize timer with flags
  *
  * Initialize the timer control structure with a timeout specified
- * in jiffies.
+ * in jiffies. The handler of a timer with the TIMER_IRQSAFE flag is
+ * called from the timer interrupt handler, it must not block and
+ * must not destroy the timer.
  *
  * @param @timer  Timer to initialize.
  * @param timeout Timeout in jiffies.
  * @param handle  Timer handler function called at expiration.
  * @param data    Data to be passed to the handler.
+ * @param flags   Timer flags.
  *
  */
-void timer_init_jiffies (struct timer *timer, unsigned int timeout,
-    timer_fn handler, void *data)
+void timer_init_flags (struct timer *timer, unsigned int timeout,
+    timer_fn handler, void *data, const timer_flags_t flags)
 {
 	link_init (&timer->link);
 	timer->expires = 0;
 	timer->timeout = timeout;
+	timer->slack = 0;
+	timer->cpu = 0;
+	timer->flags = flags;
 	timer->running = false;
 	timer->handler = handler;
 	timer->data = data;
 }
 
 
+/** Initialize timer
+ *
+ * Initialize the timer control structure with a timeout specified
+ * in jiffies. The handler is called by the timer thread.
+ *
+ * @param @timer  Timer to initialize.
+ * @param timeout Timeout in jiffies.
+ * @param handle  Timer handler function called at expiration.
+ * @param data    Data to be passed to the handler.
+ *
+ */
+void timer_init_jiffies (struct timer *timer, unsigned int timeout,
+    timer_fn handler, void *data)
+{
+	timer_init_flags (timer, timeout, handler, data, TIMER_NONE);
+}
+
+
+/** Set the slack of a timer
+ *
+ * The timer can then expire up to the given number of jiffies
+ * later than its timeout. Takes effect when the timer is started.
+ *
+ * @param timer Timer to set the slack of.
+ * @param slack Tolerated delay in jiffies.
+ *
+ */
+void timer_set_slack (struct timer *timer, unsigned int slack)
+{
+	timer->slack = slack;
+}
+
+
+/** Round an expiration time up within the slack
+ *
+ * All bits below the highest bit in which the expiration time
+ * differs from the latest tolerated time are cleared in the
+ * latter, which yields the coarsest boundary within the slack.
+ *
+ * @param expires Absolute expiration time.
+ * @param slack   Tolerated delay.
+ *
+ * @return The rounded expiration time.
+ *
+ */
+static unsigned int timer_apply_slack (unsigned int expires,
+    unsigned int slack)
+{
+	unsigned int limit = expires + slack;
+	unsigned int mask = expires ^ limit;
+	
+	if (mask == 0)
+		return expires;
+	
+	mask |= mask >> 1;
+	mask |= mask >> 2;
+	mask |= mask >> 4;
+	mask |= mask >> 8;
+	mask |= mask >> 16;
+	
+	return limit & ~(mask >> 1);
+}
+
+
 /** Activate timer
  *
- * Add the timer into the list of pending timers.
+ * Add the timer into the timing wheel of the current CPU.
+ * A pending timer is removed from its timing wheel first.
+ * The expiration is rounded up within the slack of the timer.
  *
  * @param timer Timer to activate.
  *
@@ -179,8 +621,50 @@ void timer_start (struct timer *timer)
 {
 	ipl_t status = query_and_disable_interrupts ();
 	
-	timer->expires = jiffies + timer->timeout;
-	list_append (&timers_list, &timer->link);
+	struct timer_base *base = &timer_bases[timer->cpu];
+	
+	spinlock_lock (&base->lock);
+	if (timer_pending (timer))
+		timer_remove (base, timer);
+	spinlock_unlock (&base->lock);
+	
+	timer->cpu = cpuid ();
+	base = &timer_bases[timer->cpu];
+	
+	spinlock_lock (&base->lock);
+	
+	unsigned int jiffies = jiffies_get ();
+	
+	/* An empty timing wheel has not been moved forward. */
+	if (base->pending == 0)
+		base->jiffies = jiffies;
+	
+	timer->expires = timer_apply_slack (jiffies + timer->timeout,
+	    timer->slack);
+	if (timer->expires != jiffies + timer->timeout)
+		base->stats.deferred++;
+	
+	timer_enqueue (base, timer);
+	
+	/*
+	 * Only a timer expiring sooner than the others requires
+	 * the timer interrupt to be programmed again.
+	 */
+	bool sooner = base->next_stale;
+	
+	if ((base->pending == 0) || ((!base->next_stale) &&
+	    ((native_t) (timer->expires - base->next) < 0))) {
+		base->next = timer->expires;
+		base->next_stale = false;
+		sooner = true;
+	}
+	
+	base->pending++;
+	
+	spinlock_unlock (&base->lock);
+	
+	if (sooner)
+		sched_timers_changed (timer->cpu);
 	
 	conditionally_enable_interrupts (status);
 }
@@ -188,7 +672,7 @@ void timer_start (struct timer *timer)
 
 /** Destroy a timer.
  *
- * Delete the timer from the list of timers and clean up the timer
+ * Delete the timer from the timing wheel and clean up the timer
  * control structure. If the timer handler is running, wait for it to
  * complete.
  *
@@ -201,10 +685,16 @@ void timer_destroy (struct timer *timer)
 	
 	do {
 		/*
-		 * If the timer is pending, remove it.
+		 * If the timer is pending, remove it. The handler
+		 * might start the timer on another CPU meanwhile.
 		 */
-		if (timer_pending (timer))
-			timer_remove (timer);
+		struct timer_base *base = &timer_bases[timer->cpu];
+		
+		spinlock_lock (&base->lock);
+		if ((timer_pending (timer)) &&
+		    (&timer_bases[timer->cpu] == base))
+			timer_remove (base, timer);
+		spinlock_unlock (&base->lock);
 		
 		/*
 		* Wait for the handler to finish.
@@ -22,6 +22,33 @@
 #include <adt/list.h>
 
 
+/** Timer flags.
+ *
+ */
+typedef enum {
+	TIMER_NONE = 0,
+	TIMER_IRQSAFE = (1 << 0)
+} timer_flags_t;
+
+
+/** Timer statistics of a CPU
+ *
+ */
+struct timer_stats {
+	/** Number of timer interrupts */
+	unsigned int interrupts;
+	
+	/** Number of expired timers */
+	unsigned int expired;
+	
+	/** Number of timer interrupts which expired some timers */
+	unsigned int batches;
+	
+	/** Number of timers whose expiration was deferred by the slack */
+	unsigned int deferred;
+};
+
+
 /** Timer callback function.
  *
  */
@@ -43,6 +70,15 @@ struct timer {
 	/** Absolute expiration time */
 	unsigned int expires;
 	
+	/** Tolerated delay of the expiration */
+	unsigned int slack;
+	
+	/** CPU whose timing wheel the timer is in */
+	unsigned int cpu;
+	
+	/** Timer flags */
+	timer_flags_t flags;
+	
 	/** Timer handler is running */
 	bool running;
 	
@@ -57,8 +93,13 @@ struct timer {
 /* Externals are commented with implementation */
 extern int timers_init (void);
 extern void timers_run (void);
+extern bool timers_next_expiry (unsigned int *expires);
+extern bool timers_get_stats (unsigned int cpu, struct timer_stats *stats);
+extern void timer_init_flags (struct timer *timer, unsigned int timeout,
+    timer_fn handler, void *data, const timer_flags_t flags);
 extern void timer_init_jiffies (struct timer *timer, unsigned int timeout,
     timer_fn handler, void *data);
+extern void timer_set_slack (struct timer *timer, unsigned int slack);
 extern void timer_start (struct timer *timer);
 extern void timer_destroy (struct timer *timer);
 
@@ -0,0 +1,52 @@
+#! /bin/bash
+
+#
+# Kalisto
+#
+# Copyright (c) 2001-2016
+#   Department of Distributed and Dependable Systems
+#   Faculty of Mathematics and Physics
+#   Charles University, Czech Republic
+#
+# Compile and boot with the big-reader lock tests. Each test
+# is run on a machine with 1, 2 and 4 processors to
+# show how the locks scale. The correct
+# result of each test is signaled by
+#
+# Test passed...
+#
+
+fail() {
+	rm -f test.log
+	echo
+	echo "Failure: $1"
+	exit 1
+}
+
+# Don't output command executed by make unless run with -v
+if [ "$1" == "-v" ] ; then
+	SILENT_MAKE=""
+else
+	SILENT_MAKE="--silent"
+fi
+
+emake() {
+	echo "Running make $SILENT_MAKE $@"
+	make $SILENT_MAKE "$@"
+}
+
+for TEST in \
+    tests/brlock/brlock1/test.c \
+    ; do
+	emake distclean || fail "Cleanup before compilation"
+	emake "KERNEL_TEST=$TEST" || fail "Compilation"
+	for CONF in msim.conf msim-smp2.conf msim-smp4.conf ; do
+		msim -c "$CONF" | tee test.log || fail "Execution"
+		grep '^Test passed\.\.\.$' test.log > /dev/null || fail "Test $TEST ($CONF)"
+		rm -f test.log
+	done
+	emake distclean || fail "Cleanup after compilation"
+done
+
+echo
+echo "All tests passed..."
@@ -36,6 +36,7 @@ emake() {
 for TEST in \
     tests/condvar/condvar1/test.c \
     tests/condvar/condvar2/test.c \
+    tests/condvar/timedwait1/test.c \
     ; do
 	emake distclean || fail "Cleanup before compilation"
 	emake "KERNEL_TEST=$TEST" || fail "Compilation"
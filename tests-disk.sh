@@ -37,6 +37,8 @@ test() {
 
 for TEST in \
     tests/disk/disk1/test.c \
+    tests/disk/async1/test.c \
+    tests/disk/elevator1/test.c \
     ; do
 	test "${TEST}"
 done
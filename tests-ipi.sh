@@ -35,5 +35,18 @@ for TEST in \
 	emake distclean || fail "Cleanup after compilation"
 done
 
+for TEST in \
+    tests/ipi/call1/test.c \
+    ; do
+	emake distclean || fail "Cleanup before compilation"
+	emake "KERNEL_TEST=$TEST" || fail "Compilation"
+	for CONF in msim.conf msim-smp2.conf msim-smp4.conf ; do
+		msim -c "$CONF" | tee test.log || fail "Execution"
+		grep '^Test passed\.\.\.$' test.log > /dev/null || fail "Test $TEST ($CONF)"
+		rm -f test.log
+	done
+	emake distclean || fail "Cleanup after compilation"
+done
+
 echo
 echo "All tests passed..."
@@ -56,6 +56,9 @@ for TEST in \
     tests/mutex/mutex1/test.c \
     tests/mutex/mutex2/test.c \
     tests/mutex/mutex3/test.c \
+    tests/mutex/adaptive1/test.c \
+    tests/mutex/inherit1/test.c \
+    tests/mutex/lockstat1/test.c \
     ; do
 	emake distclean || fail "Cleanup before compilation"
 	emake "KERNEL_TEST=$TEST" || fail "Compilation"
@@ -37,6 +37,7 @@ for TEST in \
     tests/sem/sem1/test.c \
     tests/sem/sem2/test.c \
     tests/sem/sem3/test.c \
+    tests/sem/batch1/test.c \
     ; do
 	emake distclean || fail "Cleanup before compilation"
 	emake "KERNEL_TEST=$TEST" || fail "Compilation"
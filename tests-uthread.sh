@@ -29,6 +29,8 @@ emake() {
 for TEST in \
     tests/thread/uspace1/test.c \
     tests/thread/thread1/test.c \
+    tests/thread/affinity1/test.c \
+    tests/thread/nanosleep1/test.c \
     ; do
 	emake distclean || fail "Cleanup before compilation"
 	emake "USER_TEST=$TEST" || fail "Compilation"
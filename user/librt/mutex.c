@@ -3,6 +3,13 @@
  *
  * User space mutexes.
  *
+ * The mutex word is unlocked, locked, or locked with possibly
+ * waiting threads. Locking an unlocked mutex and unlocking a mutex
+ * nobody waits for only takes an atomic instruction sequence. A
+ * thread which finds the mutex locked marks it as contended and
+ * waits in the kernel, the unlocking thread then wakes up one of
+ * the waiting threads, which retries the lock.
+ *
  * Kalisto
  *
  * Copyright (c) 2001-2015
@@ -13,10 +20,89 @@
  */
 
 #include <syscall.h>
+#include <thread.h>
 
 #include <mutex.h>
 
 
+/** Compare and swap the mutex state
+ *
+ * The new state is stored only if the mutex
+ * is in the expected state.
+ *
+ * @param mtx Mutex to update.
+ * @param old The expected state.
+ * @param val The new state.
+ *
+ * @return The original state.
+ *
+ */
+static inline unative_t mutex_cas (struct mutex *mtx, const unative_t old,
+    const unative_t val)
+{
+	unative_t orig, result;
+	
+	asm volatile (
+		".set push\n"
+		".set noreorder\n"
+		
+		"1: ll %[orig], %[state]\n"
+		"   bne %[orig], %[old], 2f\n"
+		"   move %[result], %[val]\n"
+		"   sc %[result], %[state]\n"
+		"   beqz %[result], 1b\n"
+		"   nop\n"
+		
+		"2: sync\n"
+		
+		".set pop\n"
+		: [orig] "=&r" (orig),
+		  [result] "=&r" (result),
+		  [state] "+m" (mtx->state)
+		: [old] "r" (old),
+		  [val] "r" (val)
+		: "memory"
+	);
+	
+	return orig;
+}
+
+
+/** Exchange the mutex state
+ *
+ * @param mtx Mutex to update.
+ * @param val The new state.
+ *
+ * @return The original state.
+ *
+ */
+static inline unative_t mutex_swap (struct mutex *mtx, const unative_t val)
+{
+	unative_t orig, result;
+	
+	asm volatile (
+		".set push\n"
+		".set noreorder\n"
+		
+		"   sync\n"
+		"1: ll %[orig], %[state]\n"
+		"   move %[result], %[val]\n"
+		"   sc %[result], %[state]\n"
+		"   beqz %[result], 1b\n"
+		"   nop\n"
+		
+		".set pop\n"
+		: [orig] "=&r" (orig),
+		  [result] "=&r" (result),
+		  [state] "+m" (mtx->state)
+		: [val] "r" (val)
+		: "memory"
+	);
+	
+	return orig;
+}
+
+
 /** Initialize a mutex
  *
  * Initialize a mutex to the unlocked state.
@@ -26,9 +112,7 @@
  */
 int mutex_init (struct mutex *mtx)
 {
-	// TODO: Call the SYS_MUTEX_INIT syscall
-	//       (the first argument is an output argument, pointing
-	//       to the memory location where to store the mutex ID)
+	mtx->state = MUTEX_UNLOCKED;
 	return EOK;
 }
 
@@ -43,8 +127,9 @@ int mutex_init (struct mutex *mtx)
  */
 int mutex_destroy (struct mutex *mtx)
 {
-	// TODO: Call the SYS_MUTEX_DESTROY syscall
-	//       (simply pass the mutex ID)
+	if (mtx->state != MUTEX_UNLOCKED)
+		thread_finish (NULL);
+	
 	return EOK;
 }
 
@@ -60,8 +145,27 @@ int mutex_destroy (struct mutex *mtx)
  */
 int mutex_lock (struct mutex *mtx)
 {
-	// TODO: Call the SYS_MUTEX_LOCK syscall
-	//       (simply pass the mutex ID)
+	/* Fast path, the mutex is unlocked. */
+	unative_t state = mutex_cas (mtx, MUTEX_UNLOCKED, MUTEX_LOCKED);
+	if (state == MUTEX_UNLOCKED)
+		return EOK;
+	
+	/*
+	 * Mark the mutex as contended so that the owner wakes
+	 * the current thread up on unlock. The mutex has to be
+	 * locked as contended afterwards, there might be other
+	 * threads waiting for it.
+	 */
+	do {
+		if ((state == MUTEX_CONTENDED) ||
+		    (mutex_cas (mtx, MUTEX_LOCKED, MUTEX_CONTENDED) !=
+		    MUTEX_UNLOCKED))
+			SYSCALL2 (SYS_FUTEX_WAIT, (unative_t) &mtx->state,
+			    MUTEX_CONTENDED);
+		
+		state = mutex_cas (mtx, MUTEX_UNLOCKED, MUTEX_CONTENDED);
+	} while (state != MUTEX_UNLOCKED);
+	
 	return EOK;
 }
 
@@ -69,18 +173,16 @@ int mutex_lock (struct mutex *mtx)
 /** Unlock a mutex.
  *
  * Unlock the mutex owned by the current thread. If there is
- * a thread waiting for the mutex, then pass the ownership
- * to that thread and wake it up.
- *
- * If the mutex is being unlocked by a different thread than
- * the owner then kill the thread.
+ * a thread waiting for the mutex, then wake it up.
  *
  * @param mtx Mutex to unlock.
  *
  */
 int mutex_unlock (struct mutex *mtx)
 {
-	// TODO: Call the SYS_MUTEX_UNLOCK syscall
-	//       (simply pass the mutex ID)
+	/* Fast path, nobody is waiting. */
+	if (mutex_swap (mtx, MUTEX_UNLOCKED) == MUTEX_CONTENDED)
+		SYSCALL2 (SYS_FUTEX_WAKE, (unative_t) &mtx->state, 1);
+	
 	return EOK;
 }
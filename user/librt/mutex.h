@@ -19,12 +19,24 @@
 #include <types.h>
 
 
+/** User space mutex states
+ *
+ */
+#define MUTEX_UNLOCKED   0
+#define MUTEX_LOCKED     1
+#define MUTEX_CONTENDED  2
+
+
 /** User space mutex control structure.
+ *
+ * The mutex is a futex word manipulated with atomic instructions,
+ * the kernel is only entered to wait for the mutex when it is
+ * locked and to wake up a waiting thread when it is contended.
  *
  */
 struct mutex {
-	/** Kernel mutex ID */
-	unative_t id;
+	/** Mutex state */
+	volatile unative_t state;
 };
 
 
@@ -0,0 +1,50 @@
+/**
+ * @file sched.c
+ *
+ * User space scheduling support.
+ *
+ * Kalisto
+ *
+ * Copyright (c) 2001-2015
+ *   Department of Distributed and Dependable Systems
+ *   Faculty of Mathematics and Physics
+ *   Charles University, Czech Republic
+ *
+ */
+
+#include <syscall.h>
+
+#include <thread.h>
+
+
+/** Suspend the current thread for given number of nanoseconds
+ *
+ * Suspend the currently executing thread for the given
+ * number of nanoseconds. Unlike thread_usleep(), the
+ * thread is woken up at the exact CPU cycle rather
+ * than at the next timer tick.
+ *
+ * @param nsec Number of nanoseconds to suspend the thread.
+ *
+ */
+void thread_nanosleep (const unsigned int nsec)
+{
+	SYSCALL1 (SYS_THREAD_NANOSLEEP, nsec);
+}
+
+
+/** Set the CPU affinity of the current thread
+ *
+ * Restrict the set of CPUs the current thread is allowed
+ * to run on. Bit n of the set stands for CPU number n.
+ *
+ * @param affinity Set of CPUs the thread is allowed to run on.
+ *
+ * @return EOK if the affinity was set.
+ * @return EINVAL if the set does not contain any running CPU.
+ *
+ */
+int thread_set_affinity (const unative_t affinity)
+{
+	return (int) SYSCALL1 (SYS_THREAD_SET_AFFINITY, affinity);
+}
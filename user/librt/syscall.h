@@ -38,7 +38,12 @@ typedef enum {
 	SYS_MUTEX_INIT,
 	SYS_MUTEX_LOCK,
 	SYS_MUTEX_UNLOCK,
-	SYS_MUTEX_DESTROY
+	SYS_MUTEX_DESTROY,
+	SYS_THREAD_SET_AFFINITY,
+	SYS_THREAD_NANOSLEEP,
+	SYS_FUTEX_WAIT,
+	SYS_FUTEX_WAKE,
+	SYS_LOCKSTAT_DUMP
 } syscall_t;
 
 
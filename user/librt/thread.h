@@ -30,8 +30,10 @@ extern int thread_create (thread_t *thread_ptr, void *(*thread_start)(void *),
 extern thread_t thread_self (void);
 extern void thread_sleep (const unsigned int sec);
 extern void thread_usleep (const unsigned int usec);
+extern void thread_nanosleep (const unsigned int nsec);
 extern int thread_join (thread_t thr, void **thread_retval);
 extern void thread_finish (void *thread_retval);
+extern int thread_set_affinity (const unative_t affinity);
 extern void exit (int retval);
 
 
@@ -0,0 +1,78 @@
+/***
+ * Thread affinity test #1
+ */
+
+static char * desc =
+    "Test of setting the CPU affinity of user space threads.\n";
+
+
+#include <librt.h>
+#include "../../include/defs.h"
+
+/*
+ * Affinity sets used by the test.
+ */
+#define AFFINITY_NONE  ((unative_t) 0)
+#define AFFINITY_CPU0  ((unative_t) 1)
+#define AFFINITY_ALL   ((unative_t) -1)
+
+
+static void * thread_proc (void * data)
+{
+	if (thread_set_affinity (AFFINITY_CPU0) != EOK)
+		return "Failed to bind the created thread to CPU 0";
+	
+	thread_usleep (1000);
+	
+	if (thread_set_affinity (AFFINITY_ALL) != EOK)
+		return "Failed to unbind the created thread";
+	
+	return NULL;
+}
+
+/*
+ * Intermediate function to make robust_* definitions that return pointers work
+ */
+static void * main_thread (void)
+{
+	/*
+	 * An empty set contains no running CPU.
+	 */
+	if (thread_set_affinity (AFFINITY_NONE) != EINVAL)
+		return "Empty affinity set not rejected";
+	
+	if (thread_set_affinity (AFFINITY_CPU0) != EOK)
+		return "Failed to bind the main thread to CPU 0";
+	
+	thread_usleep (1000);
+	
+	if (thread_set_affinity (AFFINITY_ALL) != EOK)
+		return "Failed to unbind the main thread";
+	
+	/*
+	 * The affinity of another thread is set from that thread.
+	 */
+	void * result;
+	thread_t thread = robust_thread_create (thread_proc, NULL);
+	
+	if (thread_join (thread, &result) != EOK)
+		return "Failed to join the thread";
+	
+	return result;
+}
+
+int main (void)
+{
+	printf (desc);
+	
+	char * ret = main_thread ();
+	
+	// print the result
+	if (ret == NULL) {
+		printf ("\nTest passed...\n\n");
+		return 0;
+	} else {
+		printf ("\n%s\n\n", ret);
+		return 1;
+	}
+}
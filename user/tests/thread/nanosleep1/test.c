@@ -0,0 +1,81 @@
+/***
+ * Thread nanosleep test #1
+ */
+
+static char * desc =
+    "Test of suspending user space threads "
+    "with nanosecond resolution.\n";
+
+
+#include <librt.h>
+#include "../../include/defs.h"
+
+/*
+ * Sleep lengths in nanoseconds.
+ */
+#define SLEEP_SHORT  1000000
+#define SLEEP_LONG   500000000
+
+/*
+ * Number of short sleeps of the main thread.
+ */
+#define SLEEP_COUNT  10
+
+
+static volatile int woken;
+
+
+static void * thread_proc (void * data)
+{
+	printf ("Thread: sleeping for %u ns\n", SLEEP_LONG);
+	thread_nanosleep (SLEEP_LONG);
+	
+	woken = 1;
+	
+	printf ("Thread: exitting\n");
+	return NULL;
+}
+
+/*
+ * Intermediate function to make robust_* definitions that return pointers work
+ */
+static void * main_thread (void)
+{
+	woken = 0;
+	thread_t thread = robust_thread_create (thread_proc, NULL);
+	
+	/*
+	 * The short sleeps together last less than the long one.
+	 */
+	int cnt;
+	for (cnt = 0; cnt < SLEEP_COUNT; cnt++) {
+		thread_nanosleep (SLEEP_SHORT);
+		
+		if (woken)
+			return "Thread woken up too early";
+	}
+	
+	if (thread_join (thread, NULL) != EOK)
+		return "Failed to join the thread";
+	
+	if (!woken)
+		return "Thread not woken up";
+	
+	return NULL;
+}
+
+int main (void)
+{
+	printf (desc);
+	
+	char * ret = main_thread ();
+	
+	// print the result
+	if (ret == NULL) {
+		printf ("\nTest passed...\n\n");
+		return 0;
+	} else {
+		printf ("\n%s\n\n", ret);
+		return 1;
+	}
+}